@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Counts heap allocations made through malloc, calloc and realloc, which is
+// where both operator new and the Qt containers end up. Counting is compiled
+// in only with the GTKWAVE_COUNT_ALLOCATIONS CMake option, on glibc, since it
+// replaces the allocator entry points for the whole process.
+namespace allocation_counter
+{
+bool isEnabled();
+// Allocations since the process started; always zero when disabled.
+quint64 count();
+} // namespace allocation_counter
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QStringList>
+
+// Command-line benchmarks, run with `--benchmark`. Results are printed to
+// stdout as one line per measurement so they can be compared across builds.
+namespace benchmark
+{
+// Load throughput of each trace in full, hierarchy-only, from its cache and,
+// when `signalFilter` is given, with only the matching signals decoded.
+int runLoadBenchmark(const QStringList &files, int iterations, const QStringList &signalFilter = QStringList());
+// Per-change cost of routing value changes to their signals by handle,
+// through the reader's SignalTable and, for comparison, through a QMap.
+int runSignalTableBenchmark(int iterations);
+// Frame time of the waveform with many long rows, with the same span shown
+// at the start, middle and end of the trace, and for the whole trace with
+// and without summaries.
+int runPaintBenchmark(int iterations);
+} // namespace benchmark
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QWaitCondition>
+#include <memory>
+
+class QFile;
+
+namespace fst
+{
+// Decompresses a gzip or zstd file on a thread of its own. The output is
+// handed to the consumer in large chunks through a short queue, so reading
+// the file, decompressing it and parsing the result all overlap, and nothing
+// is written to disk. The queue bounds the memory held by the stream to a
+// few chunks however far the decompressor could run ahead.
+class CompressedStream
+{
+public:
+    enum class Format
+    {
+        None,
+        Gzip,
+        Zstd,
+    };
+
+    // Recognizes a compressed file by its magic bytes.
+    static Format detect(const QByteArray &header);
+
+    CompressedStream(const QString &filePath, Format format);
+    // Stops the decompression thread and waits for it.
+    ~CompressedStream();
+    CompressedStream(const CompressedStream &) = delete;
+    CompressedStream &operator=(const CompressedStream &) = delete;
+
+    Format format() const { return m_format; }
+
+    void start();
+    // Waits for the next chunk of output; an empty chunk marks the end of the
+    // data. Returns false if decompression failed, see errorString().
+    bool read(QByteArray &chunk);
+    // Compressed bytes consumed so far, for progress reports.
+    qint64 bytesRead() const;
+    QString errorString() const;
+
+private:
+    class Worker;
+
+    void run();
+    bool inflateGzip(QFile &file);
+    bool decompressZstd(QFile &file);
+    // Queues a chunk, waiting while the queue is full. Returns false once
+    // the stream is being destroyed.
+    bool push(const QByteArray &chunk);
+    void fail(const QString &error);
+
+    const QString m_filePath;
+    const Format m_format;
+    std::unique_ptr<Worker> m_worker;
+    QAtomicInteger<qint64> m_bytesRead = 0;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_changed;
+    QList<QByteArray> m_queue;
+    QString m_error;
+    bool m_finished = false;
+    bool m_stopped = false;
+};
+} // namespace fst
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#include <limits>
+
+namespace fst
+{
+// Decoder for the binary FST container written by GTKWave's fstapi. The file
+// is memory mapped and every block (header, geometry, hierarchy and value
+// changes) is decoded in-process; no temporary files or helper tools are used.
+class FstBinaryReader
+{
+public:
+    struct Header
+    {
+        quint64 startTime = 0;
+        quint64 endTime = 0;
+        quint64 scopeCount = 0;
+        quint64 varCount = 0;
+        quint64 maxHandle = 0;
+        quint64 valueBlockCount = 0;
+        qint8 timescale = 0;
+        qint64 timeZero = 0;
+        QString version;
+        QString date;
+    };
+
+    struct VarDeclaration
+    {
+        int type = 0;
+        int direction = 0;
+        QByteArray name;
+        quint32 length = 0;
+        quint32 handle = 0;
+        bool alias = false;
+    };
+
+    class Visitor
+    {
+    public:
+        virtual ~Visitor() = default;
+        virtual void beginScope(int scopeType, const QByteArray &name) = 0;
+        virtual void endScope() = 0;
+        virtual void declareVar(const VarDeclaration &var) = 0;
+        // `value` holds one ASCII character per bit ('0', '1', 'x', 'z', ...)
+        // for logic signals and a %.16g rendering for reals.
+        virtual void valueChange(quint32 handle, quint64 time, const char *value, int length) = 0;
+        // Called after each value-change block with the file offset reached;
+        // returning false stops readValueChanges().
+        virtual bool valueBlockDone(qint64 fileOffset)
+        {
+            Q_UNUSED(fileOffset);
+            return true;
+        }
+    };
+
+    FstBinaryReader();
+    ~FstBinaryReader();
+
+    static bool isFstFile(const QByteArray &leadingBytes);
+
+    bool open(const QString &filePath);
+    void close();
+
+    const Header &header() const;
+    bool readHierarchy(Visitor &visitor);
+    // `selected` is indexed by handle - 1; when it is empty every signal is
+    // decoded, otherwise streams of unselected handles are skipped without
+    // being decompressed. Blocks that end before `windowStart` or begin after
+    // `windowEnd` are skipped; the frame of the first block read then gives
+    // the values at the window start.
+    bool readValueChanges(Visitor &visitor, const QVector<bool> &selected = QVector<bool>(), quint64 windowStart = 0,
+                          quint64 windowEnd = std::numeric_limits<quint64>::max());
+
+    QString lastError() const;
+
+    static QString scopeTypeName(int scopeType);
+    static QString varTypeName(int varType);
+    static QString directionName(int direction);
+    static bool isRealType(int varType);
+
+private:
+    struct Block
+    {
+        int type = 0;
+        qint64 offset = 0; // position of the section length field
+        qint64 length = 0; // section length, including the length field itself
+    };
+
+    bool indexBlocks(const uchar *data, qint64 size);
+    bool readHeader(const Block &block);
+    bool readGeometry(const Block &block);
+    bool decodeHierarchy(const Block &block, QByteArray &output);
+    bool readValueBlock(const Block &block, bool emitFrame, quint64 frameTime, const QVector<bool> &selected, Visitor &visitor);
+    bool emitSignalChanges(quint32 handle, const uchar *stream, qint64 length, const QVector<quint64> &timeTable, Visitor &visitor);
+    int formatReal(const uchar *bytes, char *buffer) const;
+    bool fail(const QString &message);
+
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    QByteArray m_unwrapped;
+    QVector<Block> m_blocks;
+    Header m_header;
+    bool m_doubleEndianMatch = true;
+    QVector<quint32> m_signalLengths;
+    QVector<bool> m_signalIsReal;
+    QByteArray m_valueBuffer;
+    QString m_lastError;
+};
+} // namespace fst
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QByteArray>
+#include <QtGlobal>
+
+namespace fst
+{
+// Block decompressors used by the FST container format. Each function expands
+// exactly `destLength` bytes into `dest` and returns false on malformed input.
+bool inflateZlib(const uchar *source, qint64 sourceLength, uchar *dest, qint64 destLength);
+bool decompressLz4(const uchar *source, qint64 sourceLength, uchar *dest, qint64 destLength);
+bool decompressFastLz(const uchar *source, qint64 sourceLength, uchar *dest, qint64 destLength);
+
+// Inflates a complete gzip member (as written by gzwrite) into `output`.
+// `expectedLength` is only a capacity hint and may be zero.
+bool inflateGzip(const uchar *source, qint64 sourceLength, QByteArray &output, qint64 expectedLength = 0);
+
+// Compressors for writing FST files. deflateZlib() produces what
+// inflateZlib() reads, deflateGzip() a single gzip member. `level` is a zlib
+// compression level.
+bool deflateZlib(const char *source, int sourceLength, QByteArray &output, int level);
+bool deflateGzip(const char *source, int sourceLength, QByteArray &output, int level);
+} // namespace fst
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <memory>
+#include <vector>
+
+namespace fst
+{
+// Bump allocator for the data of one load. Memory is handed out from a few
+// large blocks and is only ever released all at once, when the arena is
+// destroyed, so the stores placed in it cost no allocation of their own and
+// tearing down a trace frees a handful of blocks instead of every column.
+// Not thread-safe.
+class LoadArena
+{
+public:
+    LoadArena() = default;
+    LoadArena(const LoadArena &) = delete;
+    LoadArena &operator=(const LoadArena &) = delete;
+
+    // Returns `bytes` of uninitialized memory aligned to `alignment`, which
+    // must be a power of two no larger than alignof(std::max_align_t).
+    void *allocate(qint64 bytes, int alignment = 8);
+
+    int blockCount() const { return static_cast<int>(m_blocks.size()); }
+    // Bytes reserved from the system, including unused block tails.
+    qint64 capacity() const { return m_capacity; }
+
+private:
+    static constexpr qint64 kFirstBlockSize = 1024 * 1024;
+    static constexpr qint64 kMaxBlockSize = 64 * 1024 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    char *m_cursor = nullptr;
+    qint64 m_remaining = 0;
+    qint64 m_nextBlockSize = kFirstBlockSize;
+    qint64 m_capacity = 0;
+};
+} // namespace fst
@@ -4,14 +4,19 @@
 #include <memory>
 
 #include "signal_tree.h"
+#include "trace_exporter.h"
+#include "trace_loader.h"
 #include "waveform_view.h"
 #include "simple_fst_reader.h"
 
 class QAction;
 class QActionGroup;
+class QFileSystemWatcher;
 class QSplitter;
 class QLabel;
 class QLineEdit;
+class QProgressBar;
+class QTimer;
 class QWidget;
 
 class MainWindow : public QMainWindow
@@ -22,6 +27,16 @@ public:
     ~MainWindow() override;
 
     void openFstFile(const QString &filePath);
+    // Signal patterns for the loads that follow (see LoadOptions::signalFilter).
+    // The matching signals are decoded while loading and shown in the waveform.
+    void setSignalFilter(const QStringList &patterns);
+    // Memory for signal values in bytes, or 0 for no limit (see
+    // LoadOptions::memoryBudget). Applies to the loads that follow.
+    void setMemoryBudget(qint64 bytes);
+    // Whether the loads that follow decode every value up front so that a
+    // trace cache can be written for the next open, instead of opening
+    // lazily. Off by default.
+    void setCacheWriting(bool enabled);
 
 protected:
     void closeEvent(QCloseEvent *event) override;
@@ -30,8 +45,17 @@ private slots:
     void openFstFileDialog();
     void addSignalToWaveform(const fst::Signal &signal);
     void updateStatusBar(qint64 primary, qint64 delta);
+    void touchVisibleSignals(const QVector<int> &handles);
     void filterSignals(const QString &text);
     void clearFilter();
+    void setFollowEnabled(bool enabled);
+    void readAppendedData();
+    void showLoadedHierarchy();
+    void showLoadProgress(const fst::LoadProgress &progress);
+    void finishLoading(bool ok, bool canceled, const QString &error);
+    void exportSignalsDialog();
+    void showExportProgress(qint64 written, qint64 total);
+    void finishExport(bool ok, bool canceled, const QString &error, qint64 transitions);
 
 private:
     void createActions();
@@ -40,20 +64,34 @@ private:
     void createStatusBar();
     QWidget *createLeftPane();
     void applyDarkPalette();
-    void loadFstFile(const QString &filePath);
+    void loadFstFile(const QString &filePath, bool keepSignals = false);
+    void reloadCurrentFile();
+    void updateWatchedFile();
 
     SignalTree *m_signalTree = nullptr;
     WaveformView *m_waveformView = nullptr;
-    fst::SimpleFstReader m_reader;
+    std::unique_ptr<fst::SimpleFstReader> m_reader = std::make_unique<fst::SimpleFstReader>();
+    TraceLoader *m_loader = nullptr;
+    TraceExporter *m_exporter = nullptr;
+    QString m_currentFile;
+    QStringList m_signalFilter;
+    qint64 m_memoryBudget = 0;
+    bool m_writeCache = false;
+    QFileSystemWatcher *m_fileWatcher = nullptr;
+    QTimer *m_followTimer = nullptr;
 
     QAction *m_openAction = nullptr;
+    QAction *m_cancelLoadAction = nullptr;
+    QAction *m_exportAction = nullptr;
     QAction *m_exitAction = nullptr;
     QAction *m_zoomInAction = nullptr;
     QAction *m_zoomOutAction = nullptr;
     QAction *m_resetViewAction = nullptr;
+    QAction *m_followAction = nullptr;
     QLabel *m_primaryCursorLabel = nullptr;
     QLabel *m_deltaLabel = nullptr;
     QLabel *m_referenceCursorLabel = nullptr;
+    QProgressBar *m_loadProgress = nullptr;
     QLineEdit *m_filterEdit = nullptr;
     qint64 m_lastReferenceTime = -1;
     qint64 m_lastPrimaryTime = -1;
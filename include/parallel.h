@@ -0,0 +1,17 @@
+#pragma once
+
+#include <functional>
+
+// Minimal data-parallel helpers on top of the global QThreadPool.
+namespace parallel
+{
+// Number of threads a parallel loop may use, including the calling thread.
+int threadCount();
+
+// Calls `body(i)` for every i in [0, count) and returns once all calls have
+// finished. Indices are handed out dynamically, so uneven work balances out.
+// The calling thread takes part in the loop, and helpers are only started
+// while the pool has idle threads. Nested or concurrent loops therefore
+// cannot deadlock waiting for the pool.
+void forEach(int count, const std::function<void(int)> &body);
+} // namespace parallel
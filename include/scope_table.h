@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "signal_table.h"
+
+namespace fst
+{
+// Scope hierarchy of a trace as one flat array. Each scope refers to its
+// parent, first child and next sibling by index and to its name and type by
+// an interned id, and the signals of a scope are chained by handle. Scopes
+// are only ever appended, so building the tree never copies a subtree and
+// index order is the pre-order of the declarations. Full paths are not
+// stored; path() and signalPath() put them together when asked.
+class ScopeTable
+{
+public:
+    static constexpr int kRoot = 0;
+
+    ScopeTable();
+
+    // Drops everything but the root scope.
+    void clear();
+
+    // Appends a scope as the last child of `parent` and returns its index.
+    int addScope(int parent, const QString &name, const QString &type);
+    // Appends `handle` to the signals of `scope`. Handles must be added in
+    // increasing order.
+    void addSignal(int scope, int handle);
+    // Returns the shared copy of `text`, so that equal signal names and
+    // types are stored once.
+    QString intern(const QString &text);
+    // Same for UTF-8 text, without decoding names that were seen before.
+    QString intern(const QByteArray &utf8);
+
+    int size() const { return m_scopes.size(); }
+    const QString &name(int scope) const { return m_names.at(m_scopes.at(scope).name); }
+    const QString &type(int scope) const { return m_names.at(m_scopes.at(scope).type); }
+    int parent(int scope) const { return m_scopes.at(scope).parent; }
+    int firstChild(int scope) const { return m_scopes.at(scope).firstChild; }
+    int nextSibling(int scope) const { return m_scopes.at(scope).nextSibling; }
+    // Signals of a scope: start at firstSignal() and follow nextSignal()
+    // until it returns -1.
+    int firstSignal(int scope) const { return m_scopes.at(scope).firstSignal; }
+    int nextSignal(int handle) const { return m_nextSignal.value(handle, -1); }
+
+    // Dot-separated path of `scope` below the root; empty for the root.
+    QString path(int scope) const;
+    QString signalPath(const Signal &signal) const;
+
+private:
+    struct Entry
+    {
+        int name = 0;
+        int type = 0;
+        int parent = -1;
+        int firstChild = -1;
+        int lastChild = -1;
+        int nextSibling = -1;
+        int firstSignal = -1;
+        int lastSignal = -1;
+    };
+
+    int internId(const QString &text);
+
+    QVector<Entry> m_scopes;
+    QVector<int> m_nextSignal; // next handle in the same scope, by handle
+    QVector<QString> m_names;
+    QHash<QString, int> m_nameIds;
+    QHash<QByteArray, int> m_utf8Ids;
+};
+} // namespace fst
@@ -0,0 +1,11 @@
+#pragma once
+
+// Behavioural checks, run with `--self-test` and by ctest. Each check builds
+// its own traces in a temporary directory and compares what the loaders
+// read back with what was written, printing one PASS or FAIL line with the
+// first difference found.
+namespace selftest
+{
+// Returns 0 when every check passes.
+int runSelfTests();
+} // namespace selftest
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+namespace fst
+{
+// Selects signals by their dot-separated hierarchical path. A pattern is a
+// wildcard (`top.cpu.*`, where `*` also crosses scope levels and the whole
+// path has to match) or, written between slashes, a regular expression that
+// may match anywhere in the path (`/alu\.r[0-9]+$/`). A signal is selected
+// when any pattern matches it; an empty filter selects nothing.
+class SignalFilter
+{
+public:
+    SignalFilter() = default;
+    explicit SignalFilter(const QStringList &patterns);
+
+    bool isEmpty() const { return m_expressions.isEmpty(); }
+    // False if a pattern does not compile; errorString() names it.
+    bool isValid() const { return m_errorString.isEmpty(); }
+    QString errorString() const { return m_errorString; }
+
+    bool matches(const QString &path) const;
+
+    // Splits a command-line list at commas. Regular expressions are taken
+    // whole, so they may contain commas themselves.
+    static QStringList splitPatterns(const QString &text);
+
+private:
+    QVector<QRegularExpression> m_expressions;
+    QString m_errorString;
+};
+} // namespace fst
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+#include "value_store.h"
+
+namespace fst
+{
+struct Signal
+{
+    int handle = -1;
+    QString name;
+    int scope = -1; // index in the ScopeTable; ScopeTable::signalPath() gives the full path
+    QString type;
+    QString direction;
+    int bitWidth = 1;
+    bool isEnum = false;
+    bool valuesLoaded = true; // false until a lazily opened signal is decoded
+    // Handle of the signal this one is an alias of (same VCD identifier or
+    // FST handle), or -1. Values are only ever decoded into that signal;
+    // an alias holds an implicitly shared copy of its store.
+    int aliasOf = -1;
+    ValueStore values;
+};
+
+// Signals of a trace indexed by handle. Every loader hands out handles
+// sequentially from 1, so the signals are kept in one contiguous array and
+// a lookup is a bounds check and an index, which keeps the per-change path
+// of the parsers free of tree walks. Slots of handles that were never
+// inserted are skipped by iteration.
+class SignalTable
+{
+public:
+    template <typename Value> class Iterator
+    {
+    public:
+        Iterator(Value *current, Value *end)
+            : m_current(current)
+            , m_end(end)
+        {
+            skipEmpty();
+        }
+
+        Value &operator*() const { return *m_current; }
+        Value *operator->() const { return m_current; }
+        Iterator &operator++()
+        {
+            ++m_current;
+            skipEmpty();
+            return *this;
+        }
+        bool operator==(const Iterator &other) const { return m_current == other.m_current; }
+        bool operator!=(const Iterator &other) const { return m_current != other.m_current; }
+
+    private:
+        void skipEmpty()
+        {
+            while (m_current != m_end && m_current->handle < 0)
+            {
+                ++m_current;
+            }
+        }
+
+        Value *m_current;
+        Value *m_end;
+    };
+
+    using iterator = Iterator<Signal>;
+    using const_iterator = Iterator<const Signal>;
+
+    int size() const { return m_count; }
+    bool isEmpty() const { return m_count == 0; }
+    // Upper bound of the handles in the table.
+    int maxHandle() const { return m_slots.size(); }
+    bool contains(int handle) const { return find(handle) != nullptr; }
+
+    const Signal *find(int handle) const
+    {
+        if (handle < 1 || handle > m_slots.size())
+        {
+            return nullptr;
+        }
+        const Signal &signal = m_slots.at(handle - 1);
+        return signal.handle == handle ? &signal : nullptr;
+    }
+
+    Signal *find(int handle)
+    {
+        if (handle < 1 || handle > m_slots.size())
+        {
+            return nullptr;
+        }
+        Signal &signal = m_slots[handle - 1];
+        return signal.handle == handle ? &signal : nullptr;
+    }
+
+    // Stores `signal` in the slot of its handle, replacing any signal that
+    // was there. Handles below 1 are ignored.
+    void insert(const Signal &signal)
+    {
+        if (signal.handle < 1)
+        {
+            return;
+        }
+        if (signal.handle > m_slots.size())
+        {
+            m_slots.resize(signal.handle);
+        }
+        Signal &slot = m_slots[signal.handle - 1];
+        if (slot.handle < 0)
+        {
+            ++m_count;
+        }
+        slot = signal;
+    }
+
+    void reserve(int handles) { m_slots.reserve(handles); }
+    void squeeze() { m_slots.squeeze(); }
+    void clear()
+    {
+        m_slots.clear();
+        m_count = 0;
+    }
+
+    iterator begin() { return iterator(m_slots.data(), m_slots.data() + m_slots.size()); }
+    iterator end() { return iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size()); }
+    const_iterator begin() const { return const_iterator(m_slots.constData(), m_slots.constData() + m_slots.size()); }
+    const_iterator end() const
+    {
+        return const_iterator(m_slots.constData() + m_slots.size(), m_slots.constData() + m_slots.size());
+    }
+
+private:
+    QVector<Signal> m_slots; // slot i holds handle i + 1
+    int m_count = 0;
+};
+} // namespace fst
@@ -10,16 +10,18 @@ class SignalTree : public QTreeWidget
 public:
     explicit SignalTree(QWidget *parent = nullptr);
 
-    void populate(const fst::Scope &rootScope, const QMap<int, fst::Signal> &signalMap);
+    // Both tables must outlive the tree's contents; they are read in place.
+    void populate(const fst::ScopeTable &scopeTable, const fst::SignalTable &signalTable);
     void filter(const QString &text);
 
 signals:
     void signalActivated(const fst::Signal &signal);
 
 private:
-    void addScopeItem(QTreeWidgetItem *parentItem, const fst::Scope &scope);
+    void addScopeItem(QTreeWidgetItem *parentItem, int scope);
     bool filterItem(QTreeWidgetItem *item, const QString &pattern);
 
-    const QMap<int, fst::Signal> *m_signals = nullptr;
+    const fst::ScopeTable *m_scopes = nullptr;
+    const fst::SignalTable *m_signals = nullptr;
 };
 
@@ -1,40 +1,99 @@
 #pragma once
 
-#include <QMap>
 #include <QObject>
+#include <QPair>
 #include <QString>
+#include <QStringList>
 #include <QVector>
+#include <limits>
 #include <memory>
 
+#include "scope_table.h"
+#include "signal_table.h"
+
+class QFile;
 class QIODevice;
 
 namespace fst
 {
-struct SignalValue
+class CompressedStream;
+class SignalFilter;
+class LoadArena;
+class SpillFile;
+
+struct LoadStatistics
 {
-    qint64 time = 0;
-    QString value;
+    qint64 bytes = 0;
+    qint64 elapsedNs = 0;
+    int signalCount = 0;
+    qint64 transitionCount = 0;
+    int threadCount = 1;
+    qint64 valueBytes = 0; // memory held by the value stores after loading
+    bool fromCache = false;
+
+    double megabytesPerSecond() const;
+    double bytesPerTransition() const;
 };
 
-struct Signal
+struct LoadProgress
 {
-    int handle = -1;
-    QString name;
-    QString path;
-    QString type;
-    QString direction;
-    int bitWidth = 1;
-    bool isEnum = false;
-    QVector<SignalValue> values;
+    qint64 bytesRead = 0;
+    qint64 totalBytes = 0;
+    int signalCount = 0;
+    qint64 transitionCount = 0; // value changes parsed so far
 };
 
-struct Scope
+// Follows a SimpleFstReader::load() in progress. progress() and isCanceled()
+// may be called from any thread that takes part in the load.
+class LoadObserver
 {
-    QString name;
-    QString path;
-    QString type;
-    QVector<Scope> children;
-    QVector<int> signalHandles;
+public:
+    virtual ~LoadObserver() = default;
+    // Called once per load as soon as the hierarchy is complete, typically
+    // while values are still being read.
+    virtual void hierarchyReady(const ScopeTable &scopeTable, const SignalTable &signalTable) = 0;
+    virtual void progress(const LoadProgress &progress) = 0;
+    // Once this returns true the load stops as soon as possible and fails.
+    virtual bool isCanceled() const = 0;
+};
+
+struct LoadOptions
+{
+    // Only read the hierarchy while opening. Value changes are decoded per
+    // signal by SimpleFstReader::ensureLoaded() when first needed.
+    bool lazy = false;
+    // Re-open the trace from its TraceCache sidecar when that is still valid.
+    // Otherwise the trace is loaded as usual; a full load then writes the
+    // cache for the next time, while a lazy one stays lazy and writes none,
+    // as its values are not all decoded.
+    bool useCache = false;
+    QString cacheDirectory; // empty for the per-user cache location
+    // Keep a VCD open after loading so that data appended to it later can be
+    // parsed with SimpleFstReader::readAppended(). Disables the cache.
+    bool follow = false;
+    // Time window to keep. Changes after windowEnd are not stored, and the
+    // changes before windowStart collapse into a single entry at windowStart
+    // holding each signal's value there, so memory scales with the window.
+    // FST blocks outside the window and VCD data past its end are not read.
+    // A windowed load does not use the cache.
+    qint64 windowStart = std::numeric_limits<qint64>::min();
+    qint64 windowEnd = std::numeric_limits<qint64>::max();
+    // SignalFilter patterns naming the signals whose values are decoded while
+    // loading; empty decodes every signal. The whole hierarchy is still read,
+    // and the other signals are left unloaded for ensureLoaded(), as in a
+    // lazy load. A filtered load does not use the cache.
+    QStringList signalFilter;
+    // Bytes of value columns to keep in memory, or 0 for no limit. Beyond
+    // it, the columns of the least recently used signals are spilled to a
+    // mapped temporary file (in `cacheDirectory` when set) and copied back
+    // by touch(). Signals mapped from the cache count as spilled already.
+    qint64 memoryBudget = 0;
+    LoadObserver *observer = nullptr;
+
+    bool hasWindow() const
+    {
+        return windowStart != std::numeric_limits<qint64>::min() || windowEnd != std::numeric_limits<qint64>::max();
+    }
 };
 
 class SimpleFstReader
@@ -43,26 +102,97 @@ public:
     SimpleFstReader();
     ~SimpleFstReader();
 
-    bool load(const QString &filePath);
+    bool load(const QString &filePath, const LoadOptions &options = LoadOptions());
+    // Decodes the value changes of those `handles` that are not loaded yet.
+    bool ensureLoaded(const QVector<int> &handles);
+    // Parses whatever was appended to a followed VCD since the last call and
+    // appends it to the loaded signals. Fails if the file was truncated.
+    bool readAppended();
+    bool isFollowing() const;
 
-    const Scope &rootScope() const;
-    const QMap<int, Signal> &signalMap() const;
+    const ScopeTable &scopeTable() const;
+    const SignalTable &signalTable() const;
+    // Handles matched by LoadOptions::signalFilter, in handle order.
+    const QVector<int> &selectedHandles() const;
+    // Marks signals as just used, e.g. because they are on screen. Under a
+    // memory budget their spilled columns are brought back into memory, and
+    // the least recently used other signals are spilled to make room.
+    // ensureLoaded() touches the signals it is given. Returns false if
+    // spilling failed, which leaves the signals in memory.
+    bool touch(const QVector<int> &handles);
+    // Bytes of value columns currently held in memory.
+    qint64 residentValueBytes() const;
 
     QString lastError() const;
     qint64 maxTime() const;
+    const LoadStatistics &loadStatistics() const;
 
 private:
+    struct VcdValueSection;
+    struct LazyVcdSource;
+    struct LazyFstSource;
+    struct LazyVcdStream;
+    struct VcdFollowState;
+
     void clear();
+    bool loadFile(const QString &filePath);
     bool loadFromPseudoText(QIODevice &device);
-    bool loadFromVcd(QIODevice &device);
+    // Reads `compressed` instead of `file` when given; such a trace is parsed
+    // as a stream, without following. It is loaded in full, unless a signal
+    // filter is set: then only the selected signals are decoded, and the
+    // others by streaming the value section again when they are needed.
+    bool loadFromVcd(QFile &file, CompressedStream *compressed = nullptr);
+    // Reads the next chunk of a VCD that is streamed rather than mapped.
+    // `atEnd` is set with the last one, and `bytesRead` counts file bytes.
+    bool readVcdChunk(QFile &file, CompressedStream *compressed, QByteArray &chunk, bool &atEnd, qint64 &bytesRead);
+    // Streams the value section again, decoding the `wanted` symbols only.
+    bool loadStreamedValues(const LazyVcdStream &stream, const QVector<bool> &wanted);
+    // Parses the changes of the `wanted` symbols (all when empty) into their
+    // stores. `ranges` restricts parsing to those byte ranges of the section,
+    // given as offsets from its start in file order, each starting at a
+    // timestamp line; empty parses the whole section.
+    bool loadVcdValues(const VcdValueSection &section, const QVector<bool> &wanted,
+                       const QVector<QPair<qint64, qint64>> &ranges = QVector<QPair<qint64, qint64>>());
+    // Pre-scan of a lazily opened VCD, recording in which blocks of the
+    // value section each symbol changes.
+    bool indexVcdValues(LazyVcdSource &lazy);
     bool loadFromFstBinary(const QString &filePath);
-    bool finalizeHierarchy(QVector<Scope> &scopeStack);
-    void appendSignalValue(int handle, qint64 time, const QString &value);
+    // Sorts the stores that received changes out of time order, in parallel
+    // across signals. Stores that stayed monotonic are left alone.
+    void sortUnsortedStores();
+    // Handles of the signals whose path `filter` matches, in handle order.
+    QVector<int> matchSignals(const SignalFilter &filter) const;
+    bool loadSelectedSignals(const SignalFilter &filter);
+    void publishHierarchy();
+    void reportProgress(qint64 bytesRead, qint64 transitionCount) const;
+    bool isCanceled() const;
+    // Aliases drop their copies of the shared stores before those are
+    // appended to or squeezed, which would otherwise detach them, and get
+    // fresh copies afterwards.
+    void releaseAliasValues();
+    void shareAliasValues();
+    bool enforceMemoryBudget();
+    // Compacts the columns of a store that has finished loading.
+    void finishValues(ValueStore &values);
+    void appendSignalValue(int handle, qint64 time, const char *value, int length);
+    void appendScalarValue(int handle, qint64 time, char value);
 
-    Scope m_rootScope;
-    QMap<int, Signal> m_signals;
+    ScopeTable m_scopes;
+    SignalTable m_signals;
     QString m_lastError;
     qint64 m_timeEnd = 0;
+    LoadStatistics m_statistics;
+    LoadOptions m_options;
+    QVector<int> m_selected;
+    QVector<quint64> m_lastUse; // by handle, in ticks of m_useClock
+    quint64 m_useClock = 0;
+    std::unique_ptr<SpillFile> m_spill;
+    std::shared_ptr<LoadArena> m_arena; // columns of completely loaded stores
+    bool m_hierarchyPublished = false;
+    std::unique_ptr<LazyVcdSource> m_lazyVcd;
+    std::unique_ptr<LazyFstSource> m_lazyFst;
+    std::unique_ptr<LazyVcdStream> m_lazyStream;
+    std::unique_ptr<VcdFollowState> m_follow;
 };
 
 } // namespace fst
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include <memory>
+
+class QTemporaryFile;
+
+namespace fst
+{
+class ValueStore;
+
+// Temporary backing file for value stores moved out of memory. spill()
+// writes the columns of a batch of stores to the file, maps what it wrote
+// and points the stores at the mapping, the way TraceCache points them at a
+// mapped cache. Mapped pages are clean, so the system drops them under
+// memory pressure and reads them back when the stores are next accessed.
+// Once no store uses a batch any more, its bytes are free for later batches,
+// and free space at the end of the file is cut off, so the file stays about
+// as large as what is still spilled. The file is deleted once neither the
+// SpillFile nor any store uses it.
+class SpillFile
+{
+public:
+    // Creates the file in `directory`, or in the system temporary
+    // directory when `directory` is empty, on the first spill().
+    explicit SpillFile(const QString &directory = QString());
+    ~SpillFile();
+    SpillFile(const SpillFile &) = delete;
+    SpillFile &operator=(const SpillFile &) = delete;
+
+    // Returns false, leaving the stores in memory, if the file cannot be
+    // written or mapped.
+    bool spill(const QVector<ValueStore *> &stores);
+    // Size of the file, including free space between live batches.
+    qint64 size() const;
+    QString errorString() const;
+
+private:
+    struct Space;
+    class Mapping;
+
+    QString m_directory;
+    std::shared_ptr<Space> m_space;
+    QString m_errorString;
+};
+} // namespace fst
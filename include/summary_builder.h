@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <memory>
+
+#include "value_summary.h"
+
+class QThread;
+
+// Builds ValueSummary pyramids on a worker thread for the waveform. Each
+// request works on a copy of the store, which shares its columns, so the
+// trace may be appended to or reloaded meanwhile; a summary that no longer
+// matches its store is simply not used. Finished summaries are handed over
+// on the builder's own thread.
+class SummaryBuilder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SummaryBuilder(QObject *parent = nullptr);
+    ~SummaryBuilder() override;
+
+    // Latest summary built for `handle`, or nullptr.
+    const fst::ValueSummary *summary(int handle) const;
+    // Queues a build of `values` for `handle` unless one is already queued
+    // or running for it.
+    void request(int handle, const fst::ValueStore &values);
+    // Drops every summary and queued build; a build still running is
+    // discarded when it finishes.
+    void clear();
+
+signals:
+    void summaryReady(int handle);
+
+private slots:
+    void deliverResults(int generation);
+
+private:
+    class Job;
+
+    void stop();
+
+    std::shared_ptr<Job> m_job;
+    QThread *m_thread = nullptr;
+    int m_generation = 0;
+    QHash<int, std::shared_ptr<const fst::ValueSummary>> m_summaries;
+};
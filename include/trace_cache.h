@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QString>
+
+#include "simple_fst_reader.h"
+
+namespace fst
+{
+// Binary sidecar cache of a fully loaded trace. The file holds a header that
+// identifies the source (size, modification time and a hash of its first
+// and last MiB), a deduplicated string table, the flat scope table, one
+// fixed-size record per signal and the raw ValueStore columns of every
+// signal. Reading maps the file and points the value stores
+// straight at the mapped columns, so re-opening a trace involves no parsing
+// and no copies of the value data.
+class TraceCache
+{
+public:
+    // Cache file for `tracePath` inside `directory`, or inside the per-user
+    // cache location when `directory` is empty.
+    static QString cachePath(const QString &tracePath, const QString &directory = QString());
+
+    static bool write(const QString &tracePath, const QString &cachePath, const ScopeTable &scopeTable, const SignalTable &signalTable,
+                      qint64 timeEnd, QString *error = nullptr);
+
+    // Returns false without touching the outputs when the cache is missing,
+    // stale or malformed.
+    static bool read(const QString &tracePath, const QString &cachePath, ScopeTable &scopeTable, SignalTable &signalTable, qint64 &timeEnd);
+};
+} // namespace fst
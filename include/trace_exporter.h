@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <memory>
+
+#include "trace_writer.h"
+
+class QThread;
+
+// Runs TraceWriter::write() on a worker thread, the way TraceLoader runs a
+// load. The writer holds its own copies of the value stores, so the trace
+// can be viewed, followed or reloaded while the file is written. All
+// signals are emitted on the exporter's own thread.
+class TraceExporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TraceExporter(QObject *parent = nullptr);
+    ~TraceExporter() override;
+
+    // Starts writing `filePath` in the format its suffix names. An export
+    // that is still running is canceled and waited for first.
+    void start(std::unique_ptr<fst::TraceWriter> writer, const QString &filePath);
+    // Asks the running export to stop; the partial file is removed and
+    // finished() follows with `canceled` set.
+    void cancel();
+    bool isRunning() const;
+
+    QString filePath() const;
+
+signals:
+    void progress(qint64 written, qint64 total);
+    void finished(bool ok, bool canceled, const QString &error, qint64 transitions);
+
+private slots:
+    void deliverProgress(int generation);
+    void deliverResult(int generation);
+
+private:
+    class Job;
+
+    void stop();
+
+    std::shared_ptr<Job> m_job;
+    QThread *m_thread = nullptr;
+    int m_generation = 0;
+    QString m_filePath;
+};
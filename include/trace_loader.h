@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <memory>
+
+#include "simple_fst_reader.h"
+
+class QThread;
+
+// Runs SimpleFstReader::load() on a worker thread so that the event loop
+// stays responsive. The hierarchy is handed over as soon as the reader has
+// it, progress is reported while values are read, and a load can be
+// canceled at any time. All signals are emitted on the loader's own thread.
+class TraceLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TraceLoader(QObject *parent = nullptr);
+    ~TraceLoader() override;
+
+    // Starts loading `filePath`. A load that is still running is canceled
+    // and waited for first.
+    void start(const QString &filePath, const fst::LoadOptions &options);
+    // Asks the running load to stop; finished() follows with `canceled` set.
+    void cancel();
+    bool isRunning() const;
+
+    QString filePath() const;
+    // Hierarchy of the current load, without values. Valid from
+    // hierarchyReady() until the next start().
+    const fst::ScopeTable &scopeTable() const;
+    const fst::SignalTable &signalTable() const;
+    // Hands over the reader of a load that finished successfully.
+    std::unique_ptr<fst::SimpleFstReader> takeReader();
+
+signals:
+    void hierarchyReady();
+    void progress(const fst::LoadProgress &progress);
+    void finished(bool ok, bool canceled, const QString &error);
+
+private slots:
+    void deliverHierarchy(int generation);
+    void deliverProgress(int generation);
+    void deliverResult(int generation);
+
+private:
+    class Job;
+
+    void stop();
+
+    std::shared_ptr<Job> m_job;
+    QThread *m_thread = nullptr;
+    int m_generation = 0;
+    QString m_filePath;
+    fst::ScopeTable m_scopeTable;
+    fst::SignalTable m_signalTable;
+};
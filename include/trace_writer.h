@@ -0,0 +1,88 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+#include <functional>
+#include <limits>
+
+#include "scope_table.h"
+#include "signal_table.h"
+
+class QFile;
+
+namespace fst
+{
+// Writes some signals of a loaded trace over a time window to a new VCD or
+// FST file. The writer keeps copies of the hierarchy and of the value
+// stores it was given; the copies share their columns with the originals,
+// so write() may run on another thread while the reader is in use, and the
+// changes are streamed from those columns without decoding them to text.
+// Each signal starts with its value at the window start.
+class TraceWriter
+{
+public:
+    enum class Format
+    {
+        Vcd,
+        Fst,
+    };
+
+    // Called now and then with the transitions written so far and the total
+    // to write. Returning false cancels the export.
+    using Progress = std::function<bool(qint64 written, qint64 total)>;
+
+    // FST for a .fst file, VCD otherwise.
+    static Format formatFor(const QString &filePath);
+
+    // Signals of `handles` that are not in `signalTable` are ignored.
+    TraceWriter(const ScopeTable &scopeTable, const SignalTable &signalTable, const QVector<int> &handles);
+
+    // Times are in the units of the trace. By default every change is kept.
+    void setWindow(qint64 start, qint64 end);
+    void setProgress(Progress progress);
+
+    // Writes the file, replacing any file at `filePath`. Returns false if it
+    // could not be written or the export was canceled, see errorString().
+    bool write(const QString &filePath, Format format);
+    int signalCount() const { return m_entries.size(); }
+    // Transitions written by the last write().
+    qint64 transitionCount() const { return m_transitionCount; }
+    QString errorString() const { return m_errorString; }
+
+private:
+    // One signal to declare. Signals sharing a store, selected aliases, share
+    // a channel: a VCD identifier or an FST handle.
+    struct Entry
+    {
+        Signal signal;
+        QVector<int> scopeChain; // scopes from below the root down to the signal's
+        int channel = -1;
+    };
+
+    struct Channel
+    {
+        ValueStore values;
+        int first = 0; // index of the value at the window start, or -1
+        int last = -1; // index of the last change in the window
+    };
+
+    class Changes;
+
+    void assignChannels();
+    bool writeVcd(QFile &file);
+    bool writeFst(QFile &file);
+    bool reportProgress(qint64 written);
+    bool fail(const QString &message);
+
+    ScopeTable m_scopes;
+    QVector<Entry> m_entries; // in declaration order, grouped by scope
+    QVector<Channel> m_channels;
+    qint64 m_windowStart = 0;
+    qint64 m_windowEnd = std::numeric_limits<qint64>::max();
+    Progress m_progress;
+    qint64 m_total = 0;
+    qint64 m_transitionCount = 0;
+    QString m_errorString;
+};
+} // namespace fst
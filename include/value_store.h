@@ -0,0 +1,182 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include <memory>
+
+namespace fst
+{
+class LoadArena;
+
+// Columnar storage for the transitions of one signal. Times are kept as
+// zigzag varint deltas with a checkpoint every kCheckpointInterval entries,
+// and values are packed by kind:
+//   Scalar  2 bits per entry (0, 1, x, z)
+//   Vector  two bit planes per entry (value and unknown), LSB first
+//   Real    one double per entry
+//   Text    UTF-8 bytes with an end offset per entry (enums, strings and any
+//           value the packed kinds cannot represent)
+// A store converts itself to Text the first time a value does not fit its
+// kind, so no information is lost. Appends follow the canonical rules: a
+// change at the time of the last entry overwrites it, and an entry equal to
+// its predecessor is dropped.
+//
+// Complete stores can be moved into a LoadArena, and TraceCache and
+// SpillFile point stores at mapped files. Such a store borrows its columns
+// from memory kept alive by m_backing and copies them into containers of
+// its own before the first change.
+class ValueStore
+{
+public:
+    enum class Kind
+    {
+        Scalar,
+        Vector,
+        Real,
+        Text
+    };
+
+    static constexpr int kCheckpointInterval = 256;
+
+    class Iterator
+    {
+    public:
+        int index() const { return m_index; }
+        qint64 time() const { return m_time; }
+        // The value as displayed: scalars as 0/1/X/Z, vectors one character
+        // per bit with the MSB first, reals in %.16g form.
+        QString text() const;
+        // One of '0', '1', 'x' or 'z' for scalars. For other kinds the first
+        // character of text(), lower-cased.
+        char scalar() const;
+        double real() const;
+        // Scalar and Vector entries only: writes width() characters of '0',
+        // '1', 'x' or 'z' to `buffer`, MSB first, without building a string.
+        void bits(char *buffer) const;
+
+        Iterator &operator++();
+        bool operator==(const Iterator &other) const { return m_index == other.m_index; }
+        bool operator!=(const Iterator &other) const { return m_index != other.m_index; }
+
+    private:
+        friend class ValueStore;
+        Iterator(const ValueStore *store, int index, qint64 time, int offset);
+
+        const ValueStore *m_store = nullptr;
+        int m_index = 0;
+        qint64 m_time = 0;
+        int m_offset = 0; // byte offset of the next time delta
+    };
+
+    ValueStore() = default;
+    ValueStore(Kind kind, int width);
+
+    // Picks the packed kind for a declaration, falling back to Text for enums
+    // and strings.
+    static Kind kindFor(const QString &type, int width, bool isEnum);
+
+    Kind kind() const { return m_kind; }
+    int width() const { return m_width; }
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    bool isSorted() const { return m_sorted; }
+    // Counts the changes made to the entries, so that data derived from a
+    // store (see ValueSummary) can tell whether it is stale.
+    quint64 revision() const { return m_revision; }
+
+    Iterator begin() const;
+    Iterator end() const;
+    Iterator at(int index) const;
+    // Index of the entry in effect at `time`, the last one at or before it,
+    // or -1 if the first entry is later. The store must be sorted.
+    int indexAt(qint64 time) const;
+
+    // `value` is ASCII/UTF-8 text as found in the trace.
+    void append(qint64 time, const char *value, int length);
+    void append(qint64 time, const QString &value);
+    void appendScalar(qint64 time, char value);
+    // Appends a run built independently; the result equals appending each of
+    // its entries in turn.
+    void appendRun(const ValueStore &run);
+
+    void sortByTime();
+    void squeeze();
+    // Moves the columns into `arena`, which the store keeps alive from then
+    // on. For a complete store this replaces squeeze(): the columns take
+    // exactly their size, and destroying the store frees nothing by itself.
+    // Stores that borrow their columns already are left as they are.
+    void moveTo(const std::shared_ptr<LoadArena> &arena);
+    // Memory owned by the store itself; borrowed columns are not included.
+    qint64 memoryUsage() const;
+    // Bytes of column data held in containers of the store's own, which
+    // excludes columns mapped from a file or moved into an arena.
+    qint64 residentColumnBytes() const { return m_times.capacity() + m_values.capacity() + m_offsets.capacity(); }
+    // Copies borrowed columns into containers of the store's own.
+    void makeResident();
+
+private:
+    friend class SpillFile;
+    friend class TraceCache;
+
+    struct Checkpoint
+    {
+        qint64 time = 0;
+        int offset = 0; // byte offset just past the entry's time delta
+    };
+
+    // Columns of a store that borrows them; see m_backing.
+    struct BorrowedColumns
+    {
+        const char *times = nullptr;
+        const char *values = nullptr;
+        const char *offsets = nullptr;
+        const Checkpoint *checkpoints = nullptr;
+        int timesSize = 0;
+        int valuesSize = 0;
+        int offsetsSize = 0;
+        int checkpointCount = 0;
+    };
+
+    const char *timesData() const { return m_backing ? m_borrowed.times : m_times.constData(); }
+    int timesSize() const { return m_backing ? m_borrowed.timesSize : m_times.size(); }
+    const char *valuesData() const { return m_backing ? m_borrowed.values : m_values.constData(); }
+    int valuesSize() const { return m_backing ? m_borrowed.valuesSize : m_values.size(); }
+    const char *offsetsData() const { return m_backing ? m_borrowed.offsets : m_offsets.constData(); }
+    int offsetsSize() const { return m_backing ? m_borrowed.offsetsSize : m_offsets.size(); }
+    const Checkpoint *checkpointData() const { return m_backing ? m_borrowed.checkpoints : m_checkpoints.constData(); }
+    int checkpointCount() const { return m_backing ? m_borrowed.checkpointCount : m_checkpoints.size(); }
+    // Points the store at columns kept alive by `backing`, dropping its own.
+    void borrow(const BorrowedColumns &columns, std::shared_ptr<const void> backing);
+
+    bool encode(const char *value, int length, QByteArray &encoded) const;
+    void appendEncoded(qint64 time, const char *encoded, int length);
+    bool entryEquals(int index, const char *encoded, int length) const;
+    // Points `data` at the encoded bytes of entry `index` and returns their
+    // length. Scalars are unpacked into `scratch`.
+    int entryBytes(int index, const char *&data, char &scratch) const;
+    void pushEntry(qint64 time, const char *encoded, int length);
+    void overwriteLast(const char *encoded, int length);
+    void removeLast();
+    void convertToText();
+    int valueBytes() const;
+    QString textAt(int index) const;
+
+    Kind m_kind = Kind::Scalar;
+    int m_width = 1;
+    int m_size = 0;
+    bool m_sorted = true;
+    quint64 m_revision = 0;
+    qint64 m_lastTime = 0;
+    int m_lastTimeOffset = 0;
+    QByteArray m_times;
+    QByteArray m_values;
+    QByteArray m_offsets; // Text only: quint32 end offset of every entry
+    QVector<Checkpoint> m_checkpoints;
+    // Set while the columns are borrowed: keeps the arena or mapped file
+    // that m_borrowed points into alive. The containers above are empty then.
+    std::shared_ptr<const void> m_backing;
+    BorrowedColumns m_borrowed;
+};
+} // namespace fst
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QVector>
+
+#include "value_store.h"
+
+namespace fst
+{
+// Level-of-detail pyramid over the changes of one ValueStore, for drawing a
+// zoomed-out waveform without visiting every change. Level 0 splits the
+// time range of the store into buckets of 2^shift(0) time units, sized so
+// that a bucket averages kChangesPerBucket changes; each further level halves
+// the bucket count, up to one bucket for the whole store. A bucket records
+// how many changes fall in it, the indices of its first and last change
+// (the others lie between), from which the first and last value of any kind
+// of store can be read, the first and last scalar state and whether an X or
+// Z occurred. Built once a store is complete; matches() tells whether the
+// store has changed since, from its size and revision.
+class ValueSummary
+{
+public:
+    static constexpr int kChangesPerBucket = 16;
+
+    struct Bucket
+    {
+        qint32 first = -1; // index of the first change, or -1 when empty
+        qint32 last = -1;  // index of the last change, or -1 when empty
+        qint32 count = 0;
+        char firstState = 0; // '0', '1', 'x' or 'z' for scalars, else 0
+        char lastState = 0;
+        bool unknown = false; // some change in the bucket holds an X or Z bit
+    };
+
+    ValueSummary() = default;
+    explicit ValueSummary(const ValueStore &values);
+
+    bool isEmpty() const { return m_levels.isEmpty(); }
+    bool matches(const ValueStore &values) const;
+
+    int levelCount() const { return m_levels.size(); }
+    // Coarsest level whose buckets span at most `timeUnits`, or -1 if even
+    // level 0 is coarser.
+    int levelFor(qreal timeUnits) const;
+    int shift(int level) const { return m_shift + level; }
+    // Time at which bucket 0 of every level starts.
+    qint64 origin() const { return m_origin; }
+    const QVector<Bucket> &buckets(int level) const { return m_levels.at(level); }
+    // Index of the bucket of `level` holding `time`, which may be out of range.
+    qint64 bucketAt(int level, qint64 time) const { return (time - m_origin) >> shift(level); }
+    qint64 memoryUsage() const;
+
+private:
+    QVector<QVector<Bucket>> m_levels;
+    qint64 m_origin = 0;
+    int m_shift = 0;
+    int m_sourceSize = 0;
+    quint64 m_sourceRevision = 0;
+};
+} // namespace fst
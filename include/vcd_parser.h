@@ -0,0 +1,153 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fst
+{
+class VcdScanner;
+
+// Byte-level VCD tokenizer. It scans raw (typically memory-mapped) input with
+// string_view tokens and only materialises strings for declarations that are
+// kept. Input may be fed in pieces: parse() stops before any command that is
+// not complete yet and reports how many bytes it consumed.
+class VcdParser
+{
+public:
+    struct VarDeclaration
+    {
+        QByteArray type;
+        QByteArray reference;
+        int width = 1;
+        int symbol = -1; // dense index of the identifier code, shared by aliases
+    };
+
+    // Identifier codes seen in the definitions, shared read-only with the
+    // parsers that decode the value section. Identifiers are printable
+    // characters '!'..'~', which writers hand out as counters, so short ones
+    // are read as base-94 numbers and index `direct`; only identifiers too
+    // long for that go through the hash.
+    struct SymbolTable
+    {
+        // Codes below this are indexed through `direct`, which grows to the
+        // largest one seen. Writers that count identifiers up from "!" with
+        // the first character changing fastest give their n-th identifier
+        // code n, so designs of up to about two million signals stay below
+        // it. Other identifiers, including most of the four-character range,
+        // go through the hash.
+        static constexpr qint64 kDirectLimit = qint64(1) << 21;
+
+        // Base-94 value of `identifier` with the first character as the least
+        // significant digit and digits starting at 1, so "!" and "!!" differ.
+        // Returns -1 for identifiers that do not fit below kDirectLimit.
+        static qint64 directCode(std::string_view identifier)
+        {
+            if (identifier.empty() || identifier.size() > 4)
+            {
+                return -1;
+            }
+            qint64 code = 0;
+            for (auto it = identifier.rbegin(); it != identifier.rend(); ++it)
+            {
+                const unsigned char c = static_cast<unsigned char>(*it);
+                if (c < '!' || c > '~')
+                {
+                    return -1;
+                }
+                code = code * 94 + (c - '!' + 1);
+            }
+            return code < kDirectLimit ? code : -1;
+        }
+
+        int find(std::string_view identifier) const
+        {
+            const qint64 code = directCode(identifier);
+            if (code >= 0)
+            {
+                return code < qint64(direct.size()) ? direct[static_cast<size_t>(code)] : -1;
+            }
+            const auto it = symbols.find(identifier);
+            return it != symbols.end() ? it->second : -1;
+        }
+
+        int size() const { return static_cast<int>(identifiers.size()); }
+
+        std::deque<std::string> identifiers;
+        std::vector<int> direct; // symbol per direct code, -1 where unused
+        std::unordered_map<std::string_view, int> symbols; // identifiers without a direct code
+    };
+
+    class Handler
+    {
+    public:
+        virtual ~Handler() = default;
+        virtual void beginScope(const QByteArray &type, const QByteArray &name) = 0;
+        virtual bool endScope() = 0;
+        virtual void declareVar(const VarDeclaration &var) = 0;
+        virtual void scalarChange(int symbol, qint64 time, char value) = 0;
+        virtual void vectorChange(int symbol, qint64 time, const char *value, int length) = 0;
+    };
+
+    explicit VcdParser(Handler &handler);
+    // Parser for the value section only, resolving identifiers through the
+    // table of an earlier definitions pass. Used to parse independent slices
+    // of the value section, possibly in parallel.
+    VcdParser(Handler &handler, std::shared_ptr<const SymbolTable> symbols);
+    VcdParser(const VcdParser &) = delete;
+    VcdParser &operator=(const VcdParser &) = delete;
+
+    // Returns the number of bytes consumed, or -1 on a syntax error. With
+    // `atEnd` false a trailing partial command is left unconsumed.
+    qint64 parse(const char *begin, const char *end, bool atEnd);
+    // Like parse(), but stops right after $enddefinitions.
+    qint64 parseDefinitions(const char *begin, const char *end, bool atEnd);
+
+    // Restricts the changes handed to the handler to the symbols set in
+    // `mask`; the others are dropped once their identifier is looked up,
+    // before their value is looked at. An empty mask passes every symbol.
+    void setSymbolMask(QVector<bool> mask) { m_symbolMask = std::move(mask); }
+
+    bool definitionsComplete() const { return !m_inDefinitions; }
+    qint64 currentTime() const { return m_currentTime; }
+    qint64 maxTime() const { return m_maxTime; }
+    int symbolCount() const { return m_symbols->size(); }
+    std::shared_ptr<const SymbolTable> symbolTable() const { return m_symbols; }
+    QString lastError() const { return m_lastError; }
+
+private:
+    enum class TokenResult
+    {
+        Token,
+        Incomplete,
+        Exhausted
+    };
+
+    TokenResult nextToken(VcdScanner &scanner, const char *&cursor, bool atEnd, std::string_view &token) const;
+    TokenResult collectUntilEnd(VcdScanner &scanner, const char *&cursor, bool atEnd);
+    bool handleDefinition(std::string_view keyword);
+    bool emitChange(std::string_view identifier, const char *value, int length, bool scalar);
+    int internSymbol(std::string_view identifier);
+    bool fail(const QString &message);
+
+    Handler &m_handler;
+    std::shared_ptr<SymbolTable> m_definedSymbols; // definitions pass only
+    std::shared_ptr<const SymbolTable> m_symbols;
+    QVector<std::string_view> m_parts;
+    QVector<bool> m_symbolMask;
+    bool m_inDefinitions = true;
+    bool m_inDumpvars = false;
+    bool m_stopAfterDefinitions = false;
+    qint64 m_currentTime = 0;
+    qint64 m_maxTime = 0;
+    QString m_lastError;
+};
+} // namespace fst
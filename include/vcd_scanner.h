@@ -0,0 +1,124 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <array>
+
+namespace fst
+{
+// Finds token boundaries in VCD text. Whitespace is classified a block of
+// 64 bytes at a time into a bit mask, so skipping blanks and finding the end
+// of a token are a count of trailing zeros rather than a loop per byte.
+// The block kernel is picked at run time from what the CPU supports, with a
+// portable scalar fallback. The first byte of each command is classified
+// through a table, which the parser dispatches on.
+class VcdScanner
+{
+public:
+    enum class Kernel
+    {
+        Scalar,
+        Sse2,
+        Avx2,
+    };
+
+    // Class of the first byte of a value section command, which decides how
+    // the rest of it is read.
+    enum class Lead : quint8
+    {
+        Scalar, // anything else: a state followed by the identifier
+        Timestamp, // '#'
+        Command, // '$'
+        Vector, // 'b', 'r' or 's', either case, followed by the identifier
+    };
+
+    static Lead leadOf(char c);
+    // VCD whitespace: ' ' and '\t' through '\r', as the block kernels see it.
+    // Anything splitting VCD text outside the scanner uses the same test.
+    static bool isSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+    // Fastest kernel the running CPU supports.
+    static Kernel bestKernel();
+    static bool isSupported(Kernel kernel);
+    static const char *kernelName(Kernel kernel);
+
+    // Scans input that ends at `end`; cursors may start anywhere before it.
+    explicit VcdScanner(const char *end, Kernel kernel = bestKernel());
+
+    const char *end() const { return m_end; }
+    // First non-whitespace byte at or after `cursor`, or end(). Tokens are
+    // short, so the answer is usually in the current block; only crossing
+    // into the next one takes a call.
+    const char *skipSpace(const char *cursor)
+    {
+        if (cursor >= m_block && cursor < m_blockEnd)
+        {
+            const quint64 bits = (~m_spaces & m_valid) >> (cursor - m_block);
+            if (bits)
+            {
+                return cursor + countTrailingZeros(bits);
+            }
+        }
+        return scan(cursor, false);
+    }
+    // First whitespace byte at or after `cursor`, or end().
+    const char *findSpace(const char *cursor)
+    {
+        if (cursor >= m_block && cursor < m_blockEnd)
+        {
+            const quint64 bits = m_spaces >> (cursor - m_block);
+            if (bits)
+            {
+                return cursor + countTrailingZeros(bits);
+            }
+        }
+        return scan(cursor, true);
+    }
+
+private:
+    using BlockKernel = quint64 (*)(const char *block);
+
+    static int countTrailingZeros(quint64 bits)
+    {
+#ifdef __GNUC__
+        return __builtin_ctzll(bits);
+#else
+        int count = 0;
+        for (; !(bits & 1); bits >>= 1)
+        {
+            ++count;
+        }
+        return count;
+#endif
+    }
+
+    // Slow paths of skipSpace() and findSpace(), classifying blocks from
+    // `cursor` on until one holds the byte looked for.
+    const char *scan(const char *cursor, bool space);
+    // Classifies the bytes from `cursor` up to 64 bytes on.
+    void load(const char *cursor);
+
+    const char *m_end;
+    BlockKernel m_kernel;
+    const char *m_block = nullptr;
+    const char *m_blockEnd = nullptr;
+    quint64 m_spaces = 0; // bit i set if m_block[i] is whitespace
+    quint64 m_valid = 0;  // bit i set if m_block + i < m_blockEnd
+};
+
+inline VcdScanner::Lead VcdScanner::leadOf(char c)
+{
+    // One table lookup instead of a chain of compares per command.
+    static constexpr std::array<Lead, 256> leads = [] {
+        std::array<Lead, 256> table{};
+        table['#'] = Lead::Timestamp;
+        table['$'] = Lead::Command;
+        for (const char vector : {'b', 'B', 'r', 'R', 's', 'S'})
+        {
+            table[static_cast<uchar>(vector)] = Lead::Vector;
+        }
+        return table;
+    }();
+    return leads[static_cast<uchar>(c)];
+}
+} // namespace fst
@@ -1,28 +1,60 @@
 #pragma once
 
+#include <QCache>
 #include <QColor>
-#include <QMap>
+#include <QHash>
+#include <QImage>
+#include <QPair>
 #include <QVector>
 #include <QWidget>
 
 #include "simple_fst_reader.h"
 
+class QScrollBar;
+class QTimer;
+class SummaryBuilder;
+namespace fst
+{
+class ValueSummary;
+}
+
 class WaveformView : public QWidget
 {
     Q_OBJECT
 public:
     explicit WaveformView(QWidget *parent = nullptr);
 
-    void addSignal(const fst::Signal &signal);
+    // Rows refer to signals by handle and are drawn from `signalTable`, so
+    // values appended to the table show up on the next repaint.
+    void setSignalSource(const fst::SignalTable *signalTable, const fst::ScopeTable *scopeTable);
+    void addSignal(int handle);
     void removeSignal(int handle);
     void clearSignals();
+    QVector<int> signalHandles() const;
+    // Starts building the summary pyramid of every long row whose values are
+    // loaded, ahead of its first paint. addSignal() does this for the row it
+    // adds; call it after loading the values of rows that were already there.
+    void requestSummaries();
 
     void setTimeRange(qint64 start, qint64 end);
+    // The trace now ends at `end` instead of `previousEnd`. A view showing
+    // the previous end scrolls along to keep the newest data in sight.
+    void extendTimeRange(qint64 previousEnd, qint64 end);
     qint64 primaryCursor() const { return m_primaryCursor; }
     qint64 referenceCursor() const { return m_referenceCursor; }
+    // Drops every rasterized row tile, so the next frame redraws all rows.
+    // Needed after anything that changes how a row looks without changing
+    // its data, such as its colours.
+    void clearRenderCache();
+    // Time a frame may spend rasterizing tiles before it is shown with the
+    // rest missing; they follow in later frames. 0 waits for every tile.
+    void setFrameBudget(int milliseconds) { m_frameBudgetMs = milliseconds; }
 
 signals:
     void cursorMoved(qint64 primaryTime, qint64 deltaTime);
+    // The rows intersecting the viewport changed, after scrolling, resizing
+    // or editing the row list; `handles` lists them top to bottom.
+    void visibleSignalsChanged(const QVector<int> &handles);
 
 public slots:
     void zoomIn();
@@ -31,6 +63,7 @@ public slots:
 
 protected:
     void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
     void wheelEvent(QWheelEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
@@ -39,24 +72,101 @@ protected:
 private:
     struct RenderSignal
     {
-        fst::Signal signal;
+        int handle = -1;
         int height = 24;
     };
 
+    // Identifies one tile: the waveform of a row over kTileWidth pixels at
+    // a given zoom. Tiles are placed on a pixel grid anchored at time 0 and
+    // do not depend on the row's position or on the view's start, so a pan
+    // only rasterizes the columns it uncovers. The store revision is part of
+    // the key, so tiles of a row whose data changed are never looked up
+    // again and age out of the cache.
+    struct TileKey
+    {
+        int handle = -1;
+        quint64 revision = 0;
+        qreal pixelsPerTime = 0.0;
+        qint64 column = 0;
+        qreal devicePixelRatio = 1.0;
+
+        bool operator==(const TileKey &other) const
+        {
+            return handle == other.handle && revision == other.revision && pixelsPerTime == other.pixelsPerTime
+                && column == other.column && devicePixelRatio == other.devicePixelRatio;
+        }
+        friend uint qHash(const TileKey &key, uint seed = 0)
+        {
+            return qHash(key.handle, seed) ^ qHash(key.revision, seed) ^ qHash(key.pixelsPerTime, seed)
+                ^ qHash(key.column, seed) ^ qHash(key.devicePixelRatio, seed);
+        }
+    };
+
+    // Rows are laid out one after another from the top of the viewport,
+    // offset by the vertical scroll position; this is the row at `index`.
     QRectF signalRect(int index) const;
+    // Range [first, last) of the rows intersecting the viewport. Painting
+    // and prefetching only ever look at these, whatever the row count.
+    QPair<int, int> visibleRows() const;
+    // Widget width without the vertical scroll bar, when it is shown.
+    qreal viewportWidth() const;
+    void updateScrollBar();
+    void updateVisibleSignals();
     QRectF timeAxisRect() const;
     QRectF waveformRect() const;
     void updateCursorFromPosition(const QPoint &pos);
     void drawGrid(QPainter &painter, const QRectF &rect);
-    void drawSignal(QPainter &painter, const RenderSignal &sig, const QRectF &rect, bool alternateRow);
-    void drawSignalBackground(QPainter &painter, const QRectF &rect, const RenderSignal &sig, bool alternateRow) const;
-    void drawSignalWave(QPainter &painter, const RenderSignal &sig, const QRectF &rect);
+    void drawSignal(QPainter &painter, const fst::Signal &signal, const QRectF &rect, bool alternateRow);
+    void drawSignalBackground(QPainter &painter, const QRectF &rect, const fst::Signal &signal, bool alternateRow) const;
+    // Composes the waveform part of a row from its cached tiles; tiles not
+    // rendered yet leave the row background showing.
+    void drawSignalTiles(QPainter &painter, const fst::Signal &signal, const QRectF &rect);
+    // First and last tile column intersecting `width` pixels from the view's
+    // left edge.
+    QPair<qint64, qint64> tileColumns(qreal ppt, qreal width) const;
+    // Fill and top and bottom lines of a bus row across `rect`, without
+    // vertical edges.
+    void drawBusBody(QPainter &painter, const QRectF &rect) const;
+    // Value labels of a bus row, drawn over its tiles: each is placed from
+    // its segment's extent in the view, not from the tiles it spans.
+    void drawBusLabels(QPainter &painter, const fst::Signal &signal, const QRectF &rect, qreal ppt) const;
+    TileKey tileKey(const fst::Signal &signal, qint64 column, qreal ppt) const;
+    // Rasterizes the uncached tiles of `rows` in the given columns on the
+    // thread pool and caches them. Returns false if the frame budget ran
+    // out first.
+    bool renderTiles(const QVector<const fst::Signal *> &rows, qint64 firstColumn, qint64 lastColumn, qreal ppt);
+    // Safe to call from any thread: reads only the signal, the summary and
+    // the view's colours.
+    QImage renderTile(const fst::Signal &signal, const fst::ValueSummary *summary, qint64 column, qreal ppt,
+                      qreal devicePixelRatio, const QFont &font) const;
+    // Renders tiles just past the edge the view is panning towards, while
+    // the event loop is idle.
+    void prefetchTiles();
+    // Draws `signal` into `rect`, whose left edge is at `timeStart`, at `ppt`
+    // pixels per time unit, from `summary` when the zoom allows.
+    void drawSignalWave(QPainter &painter, const fst::Signal &signal, const fst::ValueSummary *summary, const QRectF &rect,
+                        qreal timeStart, qreal ppt) const;
+    // Draws from the summary pyramid at `level`, with a few primitives per
+    // pixel column however many changes fall into it.
+    void drawSummarizedWave(QPainter &painter, const fst::Signal &signal, const fst::ValueSummary &summary, int level,
+                            const QRectF &rect, qreal timeStart, qreal ppt) const;
+    // The current summary of a long signal, or nullptr while it is built.
+    const fst::ValueSummary *summaryFor(const fst::Signal &signal);
     void drawTimeAxis(QPainter &painter, const QRectF &rect);
     void drawCursors(QPainter &painter, const QRectF &rect);
     qreal pixelsPerTime(const QRectF &rect) const;
     QString formatTime(qint64 value) const;
 
+    const fst::SignalTable *m_signalTable = nullptr;
+    const fst::ScopeTable *m_scopeTable = nullptr;
     QVector<RenderSignal> m_signals;
+    QScrollBar *m_scrollBar = nullptr;
+    QVector<int> m_visibleHandles; // as last reported by visibleSignalsChanged
+    SummaryBuilder *m_summaryBuilder = nullptr;
+    QCache<TileKey, QImage> m_tiles;
+    QTimer *m_prefetchTimer = nullptr;
+    int m_panDirection = 0; // -1 towards earlier times, 1 towards later ones
+    int m_frameBudgetMs = 0;
     qint64 m_timeStart = 0;
     qint64 m_timeEnd = 100;
     qint64 m_primaryCursor = -1;
@@ -71,5 +181,6 @@ private:
     QColor m_digitalHigh = QColor(0, 200, 83);
     QColor m_digitalLow = QColor(244, 67, 54);
     QColor m_busFill = QColor(33, 150, 243, 90);
+    QColor m_unknownColor = QColor(255, 193, 7);
 };
 
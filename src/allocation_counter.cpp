@@ -0,0 +1,56 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstddef>
+
+#if defined(GTKWAVE_COUNT_ALLOCATIONS) && defined(__GLIBC__)
+#define ALLOCATION_COUNTER_ACTIVE 1
+#endif
+
+namespace allocation_counter
+{
+namespace
+{
+std::atomic<quint64> g_count{0};
+} // namespace
+
+bool isEnabled()
+{
+#ifdef ALLOCATION_COUNTER_ACTIVE
+    return true;
+#else
+    return false;
+#endif
+}
+
+quint64 count()
+{
+    return g_count.load(std::memory_order_relaxed);
+}
+} // namespace allocation_counter
+
+#ifdef ALLOCATION_COUNTER_ACTIVE
+// glibc exports its allocator under these names as well, so the replacements
+// below can count a call and forward it; free() needs no replacement.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    allocation_counter::g_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocation_counter::g_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    allocation_counter::g_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+#endif
@@ -0,0 +1,548 @@
+#include "benchmark.h"
+
+#include "allocation_counter.h"
+#include "compressed_stream.h"
+#include "parallel.h"
+#include "simple_fst_reader.h"
+#include "trace_writer.h"
+#include "vcd_scanner.h"
+#include "waveform_view.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QMap>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <memory>
+
+namespace benchmark
+{
+namespace
+{
+constexpr int kBenchmarkSignals = 20000;
+constexpr int kBenchmarkChanges = 4000000;
+constexpr int kPaintRows = 16;
+constexpr int kPaintChanges = 1000000; // per row
+constexpr qint64 kPaintSpan = 4000;
+constexpr int kSummarySettleMs = 2000;
+constexpr int kPanSteps = 100;
+constexpr qint64 kPanStep = 120; // time units, about 40 pixels at kPaintSpan
+constexpr int kRowScalingChanges = 1000; // per row
+
+// Handles in the order a dump of scattered activity would touch them.
+QVector<int> changeHandles()
+{
+    QVector<int> handles(kBenchmarkChanges);
+    quint32 state = 0x9e3779b9u;
+    for (int &handle : handles)
+    {
+        state = state * 1664525u + 1013904223u;
+        handle = static_cast<int>((state >> 8) % kBenchmarkSignals) + 1;
+    }
+    return handles;
+}
+
+fst::Signal benchmarkSignal(int handle)
+{
+    fst::Signal signal;
+    signal.handle = handle;
+    signal.values = fst::ValueStore(fst::ValueStore::Kind::Scalar, 1);
+    return signal;
+}
+
+// Best time per change over `iterations` runs of `appendAll`, which gets a
+// fresh container each time.
+template <typename Container, typename Append> double bestNsPerChange(int iterations, const QVector<int> &handles, Append appendAll)
+{
+    qint64 bestNs = -1;
+    for (int i = 0; i < iterations; ++i)
+    {
+        Container signalsByHandle;
+        for (int handle = 1; handle <= kBenchmarkSignals; ++handle)
+        {
+            signalsByHandle.insert(handle, benchmarkSignal(handle));
+        }
+        QElapsedTimer timer;
+        timer.start();
+        appendAll(signalsByHandle, handles);
+        const qint64 elapsedNs = timer.nsecsElapsed();
+        if (bestNs < 0 || elapsedNs < bestNs)
+        {
+            bestNs = elapsedNs;
+        }
+    }
+    return double(bestNs) / handles.size();
+}
+
+// Gives SignalTable the insert(handle, signal) shape of QMap for the
+// shared setup code above.
+class TableAdapter
+{
+public:
+    void insert(int handle, const fst::Signal &signal)
+    {
+        Q_UNUSED(handle);
+        table.insert(signal);
+    }
+
+    fst::SignalTable table;
+};
+
+// Token scanning speed of each VCD scanner kernel the CPU supports, over
+// the mapped file. Compressed and FST files are skipped.
+void reportScanThroughput(QTextStream &out, const QString &path, int iterations)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0 || fst::CompressedStream::detect(file.peek(4)) != fst::CompressedStream::Format::None ||
+        !file.peek(64).trimmed().startsWith('$'))
+    {
+        return;
+    }
+    const uchar *data = file.map(0, file.size());
+    if (!data)
+    {
+        return;
+    }
+    const char *begin = reinterpret_cast<const char *>(data);
+    const char *end = begin + file.size();
+
+    for (fst::VcdScanner::Kernel kernel : {fst::VcdScanner::Kernel::Scalar, fst::VcdScanner::Kernel::Sse2, fst::VcdScanner::Kernel::Avx2})
+    {
+        if (!fst::VcdScanner::isSupported(kernel))
+        {
+            continue;
+        }
+        qint64 bestNs = -1;
+        qint64 tokens = 0;
+        for (int i = 0; i < iterations; ++i)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            fst::VcdScanner scanner(end, kernel);
+            tokens = 0;
+            for (const char *cursor = scanner.skipSpace(begin); cursor != end; cursor = scanner.skipSpace(scanner.findSpace(cursor)))
+            {
+                ++tokens;
+            }
+            if (bestNs < 0 || timer.nsecsElapsed() < bestNs)
+            {
+                bestNs = timer.nsecsElapsed();
+            }
+        }
+        out << QStringLiteral("scan %1 (%2): %3 GB/s, %4 tokens")
+                   .arg(QFileInfo(path).fileName())
+                   .arg(QString::fromLatin1(fst::VcdScanner::kernelName(kernel)))
+                   .arg(double(file.size()) / qMax<qint64>(1, bestNs), 0, 'f', 2)
+                   .arg(tokens)
+            << '\n';
+    }
+}
+
+// Time to write every signal of a loaded trace back out in each format.
+void reportExportThroughput(QTextStream &out, const QString &path, const fst::SimpleFstReader &reader, int iterations)
+{
+    QVector<int> handles;
+    for (const fst::Signal &signal : reader.signalTable())
+    {
+        handles.append(signal.handle);
+    }
+    QTemporaryDir directory;
+    const QString fileName = QFileInfo(path).fileName();
+    const struct
+    {
+        fst::TraceWriter::Format format;
+        const char *suffix;
+    } formats[] = {{fst::TraceWriter::Format::Vcd, "vcd"}, {fst::TraceWriter::Format::Fst, "fst"}};
+    for (const auto &format : formats)
+    {
+        const QString target = directory.filePath(QStringLiteral("export.") + QLatin1String(format.suffix));
+        fst::TraceWriter writer(reader.scopeTable(), reader.signalTable(), handles);
+        qint64 bestNs = -1;
+        for (int i = 0; i < iterations; ++i)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            if (!writer.write(target, format.format))
+            {
+                bestNs = -1;
+                break;
+            }
+            bestNs = bestNs < 0 ? timer.nsecsElapsed() : qMin(bestNs, timer.nsecsElapsed());
+        }
+        if (bestNs < 0)
+        {
+            out << QStringLiteral("export %1 (%2): %3").arg(fileName, QLatin1String(format.suffix), writer.errorString()) << '\n';
+            continue;
+        }
+        out << QStringLiteral("export %1 (%2): %3 transitions in %4 ms (%5 M transitions/s), %6 MB")
+                   .arg(fileName, QLatin1String(format.suffix))
+                   .arg(writer.transitionCount())
+                   .arg(bestNs / 1e6, 0, 'f', 1)
+                   .arg(bestNs > 0 ? writer.transitionCount() * 1e3 / bestNs : 0.0, 0, 'f', 1)
+                   .arg(QFileInfo(target).size() / (1024.0 * 1024.0), 0, 'f', 2)
+            << '\n';
+    }
+}
+// Frames of a view holding few or many rows should cost the same, since
+// only the rows in the viewport are visited.
+void reportRowScaling(QTextStream &out, int iterations)
+{
+    for (const int rowCount : {10, 10000})
+    {
+        fst::SignalTable table;
+        for (int handle = 1; handle <= rowCount; ++handle)
+        {
+            fst::Signal signal;
+            signal.handle = handle;
+            signal.name = QStringLiteral("clk%1").arg(handle);
+            signal.bitWidth = 1;
+            signal.values = fst::ValueStore(fst::ValueStore::Kind::Scalar, 1);
+            for (int i = 0; i < kRowScalingChanges; ++i)
+            {
+                signal.values.appendScalar(i, i % 2 ? '1' : '0');
+            }
+            table.insert(signal);
+        }
+
+        WaveformView view;
+        view.resize(1600, 40 + kPaintRows * 32);
+        view.setFrameBudget(0);
+        view.setSignalSource(&table, nullptr);
+        for (int handle = 1; handle <= rowCount; ++handle)
+        {
+            view.addSignal(handle);
+        }
+        view.setTimeRange(0, kRowScalingChanges);
+        QImage image(view.size(), QImage::Format_ARGB32_Premultiplied);
+        qint64 bestNs = -1;
+        for (int i = 0; i < iterations; ++i)
+        {
+            view.clearRenderCache();
+            QElapsedTimer timer;
+            timer.start();
+            view.render(&image);
+            bestNs = bestNs < 0 ? timer.nsecsElapsed() : qMin(bestNs, timer.nsecsElapsed());
+        }
+        out << QStringLiteral("paint with %1 rows added: %2 ms per frame").arg(rowCount).arg(bestNs / 1e6, 0, 'f', 2) << '\n';
+    }
+}
+} // namespace
+
+int runLoadBenchmark(const QStringList &files, int iterations, const QStringList &signalFilter)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (files.isEmpty())
+    {
+        err << QObject::tr("No trace files given to benchmark") << '\n';
+        return 1;
+    }
+
+    int failures = 0;
+    for (const QString &path : files)
+    {
+        qint64 bestNs = -1;
+        fst::LoadStatistics best;
+        quint64 allocations = 0;
+        qint64 teardownNs = -1;
+        for (int i = 0; i < iterations; ++i)
+        {
+            auto reader = std::make_unique<fst::SimpleFstReader>();
+            const quint64 allocationsBefore = allocation_counter::count();
+            if (!reader->load(path))
+            {
+                err << QObject::tr("%1: %2").arg(path, reader->lastError()) << '\n';
+                ++failures;
+                bestNs = -1;
+                break;
+            }
+            allocations = allocation_counter::count() - allocationsBefore;
+            const fst::LoadStatistics stats = reader->loadStatistics();
+            if (bestNs < 0 || stats.elapsedNs < bestNs)
+            {
+                bestNs = stats.elapsedNs;
+                best = stats;
+            }
+
+            // Freeing a loaded trace is part of closing or reloading it.
+            QElapsedTimer timer;
+            timer.start();
+            reader.reset();
+            if (teardownNs < 0 || timer.nsecsElapsed() < teardownNs)
+            {
+                teardownNs = timer.nsecsElapsed();
+            }
+        }
+        if (bestNs < 0)
+        {
+            continue;
+        }
+
+        // Report the fastest run; the first one also pays for a cold page cache.
+        out << QStringLiteral("load %1: %2 MB in %3 ms (%4 MB/s), %5 signals, %6 transitions, %7 thread(s), %8 bytes/transition")
+                   .arg(QFileInfo(path).fileName())
+                   .arg(best.bytes / (1024.0 * 1024.0), 0, 'f', 2)
+                   .arg(best.elapsedNs / 1e6, 0, 'f', 1)
+                   .arg(best.megabytesPerSecond(), 0, 'f', 1)
+                   .arg(best.signalCount)
+                   .arg(best.transitionCount)
+                   .arg(best.threadCount)
+                   .arg(best.bytesPerTransition(), 0, 'f', 2)
+            << '\n';
+        out << QStringLiteral("free %1: %2 ms").arg(QFileInfo(path).fileName()).arg(teardownNs / 1e6, 0, 'f', 1);
+        if (allocation_counter::isEnabled())
+        {
+            out << QStringLiteral(", %1 allocations during load").arg(allocations);
+        }
+        out << '\n';
+
+        qint64 openNs = -1;
+        for (int i = 0; i < iterations; ++i)
+        {
+            fst::SimpleFstReader reader;
+            fst::LoadOptions options;
+            options.lazy = true;
+            if (reader.load(path, options) && (openNs < 0 || reader.loadStatistics().elapsedNs < openNs))
+            {
+                openNs = reader.loadStatistics().elapsedNs;
+            }
+        }
+        out << QStringLiteral("open %1 (hierarchy only): %2 ms").arg(QFileInfo(path).fileName()).arg(openNs / 1e6, 0, 'f', 1) << '\n';
+        reportScanThroughput(out, path, iterations);
+        {
+            fst::SimpleFstReader reader;
+            if (reader.load(path))
+            {
+                reportExportThroughput(out, path, reader, iterations);
+            }
+        }
+
+        if (!signalFilter.isEmpty())
+        {
+            qint64 filteredNs = -1;
+            int selected = 0;
+            for (int i = 0; i < iterations; ++i)
+            {
+                fst::SimpleFstReader reader;
+                fst::LoadOptions options;
+                options.signalFilter = signalFilter;
+                if (!reader.load(path, options))
+                {
+                    err << QObject::tr("%1: %2").arg(path, reader.lastError()) << '\n';
+                    ++failures;
+                    break;
+                }
+                selected = reader.selectedHandles().size();
+                if (filteredNs < 0 || reader.loadStatistics().elapsedNs < filteredNs)
+                {
+                    filteredNs = reader.loadStatistics().elapsedNs;
+                }
+            }
+            if (filteredNs >= 0)
+            {
+                out << QStringLiteral("load %1 (%2 selected signals): %3 ms")
+                           .arg(QFileInfo(path).fileName())
+                           .arg(selected)
+                           .arg(filteredNs / 1e6, 0, 'f', 1)
+                    << '\n';
+            }
+        }
+
+        // The first cached load writes the sidecar into a scratch directory;
+        // the remaining ones re-open from it.
+        QTemporaryDir cacheDirectory;
+        fst::LoadOptions cached;
+        cached.useCache = true;
+        cached.cacheDirectory = cacheDirectory.path();
+        qint64 cachedNs = -1;
+        for (int i = 0; i <= iterations; ++i)
+        {
+            fst::SimpleFstReader reader;
+            if (reader.load(path, cached) && reader.loadStatistics().fromCache &&
+                (cachedNs < 0 || reader.loadStatistics().elapsedNs < cachedNs))
+            {
+                cachedNs = reader.loadStatistics().elapsedNs;
+            }
+        }
+        if (cachedNs >= 0)
+        {
+            out << QStringLiteral("open %1 (from cache): %2 ms").arg(QFileInfo(path).fileName()).arg(cachedNs / 1e6, 0, 'f', 1) << '\n';
+        }
+        else
+        {
+            err << QObject::tr("%1: the trace cache could not be written").arg(path) << '\n';
+        }
+    }
+    out.flush();
+    return failures == 0 ? 0 : 1;
+}
+
+int runSignalTableBenchmark(int iterations)
+{
+    QTextStream out(stdout);
+    const QVector<int> handles = changeHandles();
+
+    const double tableNs = bestNsPerChange<TableAdapter>(iterations, handles, [](TableAdapter &signalsByHandle, const QVector<int> &order) {
+        qint64 time = 0;
+        for (int handle : order)
+        {
+            fst::Signal *signal = signalsByHandle.table.find(handle);
+            if (signal)
+            {
+                signal->values.appendScalar(++time, '1');
+            }
+        }
+    });
+    const double mapNs = bestNsPerChange<QMap<int, fst::Signal>>(iterations, handles, [](QMap<int, fst::Signal> &signalsByHandle, const QVector<int> &order) {
+        qint64 time = 0;
+        for (int handle : order)
+        {
+            const auto it = signalsByHandle.find(handle);
+            if (it != signalsByHandle.end())
+            {
+                it->values.appendScalar(++time, '1');
+            }
+        }
+    });
+
+    out << QStringLiteral("append via SignalTable: %1 ns/change (%2 signals, %3 changes)")
+               .arg(tableNs, 0, 'f', 2)
+               .arg(kBenchmarkSignals)
+               .arg(handles.size())
+        << '\n';
+    out << QStringLiteral("append via QMap: %1 ns/change").arg(mapNs, 0, 'f', 2) << '\n';
+    out.flush();
+    return 0;
+}
+
+int runPaintBenchmark(int iterations)
+{
+    QTextStream out(stdout);
+
+    // Even rows are clocks toggling every time unit, odd rows 8-bit counters
+    // changing every other one, so every row spans the same time range.
+    fst::SignalTable table;
+    char bits[8];
+    for (int handle = 1; handle <= kPaintRows; ++handle)
+    {
+        const bool bus = handle % 2 == 0;
+        fst::Signal signal;
+        signal.handle = handle;
+        signal.name = QStringLiteral("row%1").arg(handle);
+        signal.bitWidth = bus ? 8 : 1;
+        signal.values = fst::ValueStore(bus ? fst::ValueStore::Kind::Vector : fst::ValueStore::Kind::Scalar, signal.bitWidth);
+        for (int i = 0; i < kPaintChanges; ++i)
+        {
+            if (bus)
+            {
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    bits[bit] = (i >> (7 - bit)) & 1 ? '1' : '0';
+                }
+                signal.values.append(qint64(i) * 2, bits, 8);
+            }
+            else
+            {
+                signal.values.appendScalar(i, i % 2 ? '1' : '0');
+            }
+        }
+        table.insert(signal);
+    }
+
+    WaveformView view;
+    view.resize(1600, 40 + kPaintRows * 32);
+    // Frames are measured whole rather than cut short by the budget.
+    view.setFrameBudget(0);
+    view.setSignalSource(&table, nullptr);
+    for (int handle = 1; handle <= kPaintRows; ++handle)
+    {
+        view.addSignal(handle);
+    }
+    QImage image(view.size(), QImage::Format_ARGB32_Premultiplied);
+
+    // The same span is shown at the start, middle and end of the trace; with
+    // the visible range found by search, the frames should cost the same.
+    // The tile cache is emptied before each frame so every row is drawn.
+    const qint64 traceEnd = qint64(kPaintChanges) - kPaintSpan;
+    for (const qint64 start : {qint64(0), traceEnd / 2, traceEnd})
+    {
+        view.setTimeRange(start, start + kPaintSpan);
+        qint64 bestNs = -1;
+        for (int i = 0; i < iterations; ++i)
+        {
+            view.clearRenderCache();
+            QElapsedTimer timer;
+            timer.start();
+            view.render(&image);
+            bestNs = bestNs < 0 ? timer.nsecsElapsed() : qMin(bestNs, timer.nsecsElapsed());
+        }
+        out << QStringLiteral("paint at %1: %2 ms per frame, %3 us per row (%4 rows of %5 changes, %6 threads)")
+                   .arg(start)
+                   .arg(bestNs / 1e6, 0, 'f', 2)
+                   .arg(bestNs / 1e3 / kPaintRows, 0, 'f', 1)
+                   .arg(kPaintRows)
+                   .arg(kPaintChanges)
+                   .arg(parallel::threadCount())
+            << '\n';
+    }
+
+    // Panning at a fixed zoom only rasterizes the tiles a step uncovers;
+    // the rest of each frame is blitted from the cache.
+    view.clearRenderCache();
+    view.setTimeRange(traceEnd / 2, traceEnd / 2 + kPaintSpan);
+    view.render(&image);
+    QElapsedTimer pan;
+    pan.start();
+    for (int step = 1; step <= kPanSteps; ++step)
+    {
+        const qint64 start = traceEnd / 2 + step * kPanStep;
+        view.setTimeRange(start, start + kPaintSpan);
+        view.render(&image);
+    }
+    out << QStringLiteral("pan: %1 ms per frame over %2 steps of %3 time units")
+               .arg(pan.nsecsElapsed() / 1e6 / kPanSteps, 0, 'f', 2)
+               .arg(kPanSteps)
+               .arg(kPanStep)
+        << '\n';
+
+    // Fully zoomed out, the first frame draws every change and asks for the
+    // summaries; later frames draw from them once the background builds
+    // have been delivered.
+    view.setTimeRange(0, 2 * qint64(kPaintChanges));
+    QElapsedTimer firstFrame;
+    firstFrame.start();
+    view.render(&image);
+    const qint64 firstNs = firstFrame.nsecsElapsed();
+    QElapsedTimer settle;
+    settle.start();
+    while (settle.elapsed() < kSummarySettleMs)
+    {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 50);
+    }
+    qint64 summaryNs = -1;
+    for (int i = 0; i < iterations; ++i)
+    {
+        view.clearRenderCache();
+        QElapsedTimer timer;
+        timer.start();
+        view.render(&image);
+        summaryNs = summaryNs < 0 ? timer.nsecsElapsed() : qMin(summaryNs, timer.nsecsElapsed());
+    }
+    out << QStringLiteral("paint whole trace: %1 ms per frame change by change, %2 ms from summaries")
+               .arg(firstNs / 1e6, 0, 'f', 2)
+               .arg(summaryNs / 1e6, 0, 'f', 2)
+        << '\n';
+
+    reportRowScaling(out, iterations);
+    out.flush();
+    return 0;
+}
+} // namespace benchmark
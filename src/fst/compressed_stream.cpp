@@ -0,0 +1,302 @@
+#include "compressed_stream.h"
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QObject>
+#include <QThread>
+
+#include <cstring>
+#include <functional>
+
+#include <zlib.h>
+#ifdef GTKWAVE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace fst
+{
+namespace
+{
+constexpr int kInputSize = 1024 * 1024;
+constexpr int kChunkSize = 4 * 1024 * 1024;
+// Chunks that may wait for the consumer: enough to ride out an uneven
+// parse without letting the decompressor run far ahead.
+constexpr int kQueueDepth = 4;
+} // namespace
+
+class CompressedStream::Worker : public QThread
+{
+public:
+    explicit Worker(std::function<void()> body)
+        : m_body(std::move(body))
+    {
+    }
+
+protected:
+    void run() override
+    {
+        m_body();
+    }
+
+private:
+    std::function<void()> m_body;
+};
+
+CompressedStream::Format CompressedStream::detect(const QByteArray &header)
+{
+    if (header.size() >= 2 && static_cast<uchar>(header.at(0)) == 0x1f && static_cast<uchar>(header.at(1)) == 0x8b)
+    {
+        return Format::Gzip;
+    }
+    if (header.size() >= 4 && static_cast<uchar>(header.at(0)) == 0x28 && static_cast<uchar>(header.at(1)) == 0xb5 &&
+        static_cast<uchar>(header.at(2)) == 0x2f && static_cast<uchar>(header.at(3)) == 0xfd)
+    {
+        return Format::Zstd;
+    }
+    return Format::None;
+}
+
+CompressedStream::CompressedStream(const QString &filePath, Format format)
+    : m_filePath(filePath)
+    , m_format(format)
+{
+}
+
+CompressedStream::~CompressedStream()
+{
+    if (!m_worker)
+    {
+        return;
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopped = true;
+        m_changed.wakeAll();
+    }
+    m_worker->wait();
+}
+
+void CompressedStream::start()
+{
+    if (m_worker)
+    {
+        return;
+    }
+    m_worker = std::make_unique<Worker>([this]() { run(); });
+    m_worker->start();
+}
+
+bool CompressedStream::read(QByteArray &chunk)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_queue.isEmpty() && !m_finished)
+    {
+        m_changed.wait(&m_mutex);
+    }
+    if (!m_queue.isEmpty())
+    {
+        chunk = m_queue.takeFirst();
+        m_changed.wakeAll();
+        return true;
+    }
+    chunk.clear();
+    return m_error.isEmpty();
+}
+
+qint64 CompressedStream::bytesRead() const
+{
+    return m_bytesRead.loadRelaxed();
+}
+
+QString CompressedStream::errorString() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_error;
+}
+
+void CompressedStream::run()
+{
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        fail(QObject::tr("Unable to open %1").arg(m_filePath));
+        return;
+    }
+
+    if (m_format == Format::Gzip ? inflateGzip(file) : decompressZstd(file))
+    {
+        QMutexLocker locker(&m_mutex);
+        m_finished = true;
+        m_changed.wakeAll();
+    }
+}
+
+bool CompressedStream::inflateGzip(QFile &file)
+{
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    // 15 window bits plus 16 selects gzip framing instead of a zlib header.
+    if (inflateInit2(&stream, 15 + 16) != Z_OK)
+    {
+        fail(QObject::tr("Unable to decompress %1").arg(m_filePath));
+        return false;
+    }
+
+    QByteArray input;
+    QByteArray output(kChunkSize, Qt::Uninitialized);
+    int used = 0;
+    bool inMember = false;
+    // zlib may hold back output when it fills the buffer, so new input is
+    // only read once a call has left room to spare.
+    bool drained = true;
+    bool ok = true;
+    while (ok)
+    {
+        if (stream.avail_in == 0 && drained)
+        {
+            input = file.read(kInputSize);
+            if (input.isEmpty())
+            {
+                break;
+            }
+            m_bytesRead.fetchAndAddRelaxed(input.size());
+            stream.next_in = reinterpret_cast<Bytef *>(input.data());
+            stream.avail_in = static_cast<uInt>(input.size());
+        }
+
+        stream.next_out = reinterpret_cast<Bytef *>(output.data() + used);
+        stream.avail_out = static_cast<uInt>(output.size() - used);
+        const int rc = inflate(&stream, Z_NO_FLUSH);
+        used = output.size() - static_cast<int>(stream.avail_out);
+        drained = stream.avail_out != 0;
+        if (rc == Z_STREAM_END)
+        {
+            // A gzip file may hold several members back to back.
+            inflateReset(&stream);
+            inMember = false;
+        }
+        else if (rc != Z_OK && rc != Z_BUF_ERROR)
+        {
+            fail(QObject::tr("%1 is not a valid gzip file").arg(m_filePath));
+            ok = false;
+        }
+        else if (stream.total_in > 0)
+        {
+            inMember = true;
+        }
+
+        if (ok && used == output.size())
+        {
+            ok = push(output);
+            output = QByteArray(kChunkSize, Qt::Uninitialized);
+            used = 0;
+        }
+    }
+    inflateEnd(&stream);
+
+    if (ok && inMember)
+    {
+        fail(QObject::tr("%1 ends in the middle of a gzip member").arg(m_filePath));
+        ok = false;
+    }
+    if (ok && used > 0)
+    {
+        output.resize(used);
+        ok = push(output);
+    }
+    return ok;
+}
+
+bool CompressedStream::decompressZstd(QFile &file)
+{
+#ifdef GTKWAVE_HAVE_ZSTD
+    ZSTD_DStream *stream = ZSTD_createDStream();
+    if (!stream || ZSTD_isError(ZSTD_initDStream(stream)))
+    {
+        ZSTD_freeDStream(stream);
+        fail(QObject::tr("Unable to decompress %1").arg(m_filePath));
+        return false;
+    }
+
+    QByteArray input;
+    QByteArray output(kChunkSize, Qt::Uninitialized);
+    ZSTD_inBuffer in = {nullptr, 0, 0};
+    ZSTD_outBuffer out = {output.data(), static_cast<size_t>(output.size()), 0};
+    size_t rc = 0;
+    // As with zlib, a call that fills the output may leave some of it in
+    // the decoder, which the next call has to collect before more input.
+    bool drained = true;
+    bool ok = true;
+    while (ok)
+    {
+        if (in.pos == in.size && drained)
+        {
+            input = file.read(kInputSize);
+            if (input.isEmpty())
+            {
+                break;
+            }
+            m_bytesRead.fetchAndAddRelaxed(input.size());
+            in = {input.constData(), static_cast<size_t>(input.size()), 0};
+        }
+
+        rc = ZSTD_decompressStream(stream, &out, &in);
+        if (ZSTD_isError(rc))
+        {
+            fail(QObject::tr("%1 is not a valid zstd file: %2").arg(m_filePath, QString::fromLatin1(ZSTD_getErrorName(rc))));
+            ok = false;
+            break;
+        }
+        drained = out.pos < out.size;
+        if (!drained)
+        {
+            ok = push(output);
+            output = QByteArray(kChunkSize, Qt::Uninitialized);
+            out = {output.data(), static_cast<size_t>(output.size()), 0};
+        }
+    }
+    ZSTD_freeDStream(stream);
+
+    // A return value of zero means the last frame was complete.
+    if (ok && rc != 0)
+    {
+        fail(QObject::tr("%1 ends in the middle of a zstd frame").arg(m_filePath));
+        ok = false;
+    }
+    if (ok && out.pos > 0)
+    {
+        output.resize(static_cast<int>(out.pos));
+        ok = push(output);
+    }
+    return ok;
+#else
+    Q_UNUSED(file);
+    fail(QObject::tr("%1 is zstd-compressed, but this build has no zstd support").arg(m_filePath));
+    return false;
+#endif
+}
+
+bool CompressedStream::push(const QByteArray &chunk)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_queue.size() >= kQueueDepth && !m_stopped)
+    {
+        m_changed.wait(&m_mutex);
+    }
+    if (m_stopped)
+    {
+        return false;
+    }
+    m_queue.append(chunk);
+    m_changed.wakeAll();
+    return true;
+}
+
+void CompressedStream::fail(const QString &error)
+{
+    QMutexLocker locker(&m_mutex);
+    m_error = error;
+    m_finished = true;
+    m_changed.wakeAll();
+}
+} // namespace fst
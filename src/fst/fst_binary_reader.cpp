@@ -0,0 +1,980 @@
+#include "fst_binary_reader.h"
+
+#include "fst_compression.h"
+
+#include <QObject>
+
+#include <cstdio>
+#include <cstring>
+
+namespace fst
+{
+namespace
+{
+enum BlockType
+{
+    BlockHeader = 0,
+    BlockValueChanges = 1,
+    BlockBlackout = 2,
+    BlockGeometry = 3,
+    BlockHierarchy = 4,
+    BlockValueChangesDynamicAlias = 5,
+    BlockHierarchyLz4 = 6,
+    BlockHierarchyLz4Duo = 7,
+    BlockValueChangesDynamicAlias2 = 8,
+    BlockZWrapper = 254,
+    BlockSkip = 255
+};
+
+enum HierarchyTag
+{
+    TagAttributeBegin = 252,
+    TagAttributeEnd = 253,
+    TagScope = 254,
+    TagUpscope = 255
+};
+
+constexpr qint64 kHeaderSectionLength = 329;
+constexpr int kVersionLength = 128;
+constexpr int kDateLength = 119;
+constexpr int kVarTypeReal = 3;
+constexpr int kVarTypeRealParameter = 4;
+constexpr int kVarTypeRealTime = 20;
+constexpr int kVarTypeShortReal = 29;
+constexpr double kEndianTestValue = 2.7182818284590452354;
+constexpr char kScalarEncodings[] = "xzhuwl-?";
+
+quint64 readBigEndian64(const uchar *data)
+{
+    quint64 value = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+bool readVarint(const uchar *&cursor, const uchar *end, quint64 &value)
+{
+    value = 0;
+    int shift = 0;
+    while (cursor < end && shift < 64)
+    {
+        const uchar byte = *cursor++;
+        value |= static_cast<quint64>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+bool readSignedVarint(const uchar *&cursor, const uchar *end, qint64 &value)
+{
+    quint64 result = 0;
+    int shift = 0;
+    while (cursor < end && shift < 64)
+    {
+        const uchar byte = *cursor++;
+        result |= static_cast<quint64>(byte & 0x7f) << shift;
+        shift += 7;
+        if (!(byte & 0x80))
+        {
+            if (shift < 64 && (byte & 0x40))
+            {
+                result |= ~quint64(0) << shift;
+            }
+            value = static_cast<qint64>(result);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readCString(const uchar *&cursor, const uchar *end, QByteArray &value)
+{
+    const uchar *start = cursor;
+    while (cursor < end && *cursor)
+    {
+        ++cursor;
+    }
+    if (cursor >= end)
+    {
+        return false;
+    }
+    value = QByteArray(reinterpret_cast<const char *>(start), static_cast<int>(cursor - start));
+    ++cursor;
+    return true;
+}
+
+QString fixedString(const uchar *data, int length)
+{
+    const char *text = reinterpret_cast<const char *>(data);
+    return QString::fromLatin1(text, static_cast<int>(qstrnlen(text, static_cast<uint>(length))));
+}
+
+bool isValueChangeBlock(int type)
+{
+    return type == BlockValueChanges || type == BlockValueChangesDynamicAlias || type == BlockValueChangesDynamicAlias2;
+}
+} // namespace
+
+FstBinaryReader::FstBinaryReader() = default;
+
+FstBinaryReader::~FstBinaryReader()
+{
+    close();
+}
+
+bool FstBinaryReader::isFstFile(const QByteArray &leadingBytes)
+{
+    if (leadingBytes.size() < 9)
+    {
+        return false;
+    }
+
+    const uchar *data = reinterpret_cast<const uchar *>(leadingBytes.constData());
+    if (data[0] == BlockZWrapper)
+    {
+        return true;
+    }
+    return data[0] == BlockHeader && readBigEndian64(data + 1) == static_cast<quint64>(kHeaderSectionLength);
+}
+
+bool FstBinaryReader::open(const QString &filePath)
+{
+    close();
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        return fail(QObject::tr("Unable to open %1").arg(filePath));
+    }
+
+    m_size = m_file.size();
+    m_data = m_size > 0 ? m_file.map(0, m_size) : nullptr;
+    if (!m_data)
+    {
+        return fail(QObject::tr("Unable to map FST file %1").arg(filePath));
+    }
+
+    if (m_size > 0 && m_data[0] == BlockZWrapper)
+    {
+        if (m_size < 17)
+        {
+            return fail(QObject::tr("Truncated FST wrapper block"));
+        }
+        const qint64 sectionLength = static_cast<qint64>(readBigEndian64(m_data + 1));
+        const qint64 uncompressedLength = static_cast<qint64>(readBigEndian64(m_data + 9));
+        if (sectionLength < 16 || sectionLength + 1 > m_size)
+        {
+            return fail(QObject::tr("Corrupt FST wrapper block"));
+        }
+        if (!inflateGzip(m_data + 17, sectionLength - 16, m_unwrapped, uncompressedLength))
+        {
+            return fail(QObject::tr("Unable to decompress wrapped FST file"));
+        }
+        m_data = reinterpret_cast<const uchar *>(m_unwrapped.constData());
+        m_size = m_unwrapped.size();
+    }
+
+    if (!indexBlocks(m_data, m_size))
+    {
+        return false;
+    }
+
+    if (m_blocks.isEmpty() || m_blocks.first().type != BlockHeader)
+    {
+        return fail(QObject::tr("Missing FST header block"));
+    }
+    if (!readHeader(m_blocks.first()))
+    {
+        return false;
+    }
+
+    for (const Block &block : m_blocks)
+    {
+        if (block.type == BlockGeometry && !readGeometry(block))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void FstBinaryReader::close()
+{
+    if (m_file.isOpen())
+    {
+        m_file.close();
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_unwrapped.clear();
+    m_blocks.clear();
+    m_header = Header();
+    m_doubleEndianMatch = true;
+    m_signalLengths.clear();
+    m_signalIsReal.clear();
+    m_valueBuffer.clear();
+}
+
+const FstBinaryReader::Header &FstBinaryReader::header() const
+{
+    return m_header;
+}
+
+QString FstBinaryReader::lastError() const
+{
+    return m_lastError;
+}
+
+bool FstBinaryReader::indexBlocks(const uchar *data, qint64 size)
+{
+    m_blocks.clear();
+    qint64 pos = 0;
+    while (pos + 9 <= size)
+    {
+        Block block;
+        block.type = data[pos];
+        block.offset = pos + 1;
+        block.length = static_cast<qint64>(readBigEndian64(data + pos + 1));
+
+        // A zero length marks a section the writer never finished; everything
+        // before it is still usable.
+        if (block.length < 8 || block.offset + block.length > size)
+        {
+            break;
+        }
+
+        m_blocks.append(block);
+        pos = block.offset + block.length;
+    }
+
+    if (m_blocks.isEmpty())
+    {
+        return fail(QObject::tr("No FST blocks found"));
+    }
+    return true;
+}
+
+bool FstBinaryReader::readHeader(const Block &block)
+{
+    if (block.length < kHeaderSectionLength)
+    {
+        return fail(QObject::tr("Truncated FST header block"));
+    }
+
+    const uchar *p = m_data + block.offset;
+    m_header.startTime = readBigEndian64(p + 8);
+    m_header.endTime = readBigEndian64(p + 16);
+
+    double endianTest = 0.0;
+    std::memcpy(&endianTest, p + 24, sizeof(endianTest));
+    m_doubleEndianMatch = endianTest == kEndianTestValue;
+
+    m_header.scopeCount = readBigEndian64(p + 40);
+    m_header.varCount = readBigEndian64(p + 48);
+    m_header.maxHandle = readBigEndian64(p + 56);
+    m_header.valueBlockCount = readBigEndian64(p + 64);
+    m_header.timescale = static_cast<qint8>(p[72]);
+    m_header.version = fixedString(p + 73, kVersionLength);
+    m_header.date = fixedString(p + 73 + kVersionLength, kDateLength);
+    m_header.timeZero = static_cast<qint64>(readBigEndian64(p + 73 + kVersionLength + kDateLength + 1));
+    return true;
+}
+
+bool FstBinaryReader::readGeometry(const Block &block)
+{
+    if (block.length < 24)
+    {
+        return fail(QObject::tr("Truncated FST geometry block"));
+    }
+
+    const uchar *p = m_data + block.offset;
+    const qint64 uncompressedLength = static_cast<qint64>(readBigEndian64(p + 8));
+    const quint64 maxHandle = readBigEndian64(p + 16);
+    const qint64 compressedLength = block.length - 24;
+    const uchar *payload = p + 24;
+
+    QByteArray expanded;
+    if (compressedLength != uncompressedLength)
+    {
+        expanded.resize(static_cast<int>(uncompressedLength));
+        if (!inflateZlib(payload, compressedLength, reinterpret_cast<uchar *>(expanded.data()), uncompressedLength))
+        {
+            return fail(QObject::tr("Unable to decompress FST geometry block"));
+        }
+        payload = reinterpret_cast<const uchar *>(expanded.constData());
+    }
+
+    if (maxHandle > static_cast<quint64>(m_header.maxHandle) && m_header.maxHandle != 0)
+    {
+        return fail(QObject::tr("FST geometry exceeds declared handle count"));
+    }
+
+    m_signalLengths.resize(static_cast<int>(maxHandle));
+    m_signalIsReal.resize(static_cast<int>(maxHandle));
+
+    const uchar *cursor = payload;
+    const uchar *end = payload + uncompressedLength;
+    for (int i = 0; i < static_cast<int>(maxHandle); ++i)
+    {
+        quint64 value = 0;
+        if (!readVarint(cursor, end, value))
+        {
+            return fail(QObject::tr("Corrupt FST geometry block"));
+        }
+
+        if (value == 0)
+        {
+            m_signalLengths[i] = 8;
+            m_signalIsReal[i] = true;
+        }
+        else
+        {
+            m_signalLengths[i] = value == 0xFFFFFFFFu ? 0 : static_cast<quint32>(value);
+            m_signalIsReal[i] = false;
+        }
+    }
+
+    return true;
+}
+
+bool FstBinaryReader::decodeHierarchy(const Block &block, QByteArray &output)
+{
+    if (block.length < 16)
+    {
+        return fail(QObject::tr("Truncated FST hierarchy block"));
+    }
+
+    const uchar *p = m_data + block.offset;
+    const qint64 uncompressedLength = static_cast<qint64>(readBigEndian64(p + 8));
+    const uchar *payload = p + 16;
+    const uchar *end = p + block.length;
+
+    if (block.type == BlockHierarchy)
+    {
+        if (!inflateGzip(payload, end - payload, output, uncompressedLength))
+        {
+            return fail(QObject::tr("Unable to decompress FST hierarchy"));
+        }
+        return true;
+    }
+
+    output.resize(static_cast<int>(uncompressedLength));
+    uchar *dest = reinterpret_cast<uchar *>(output.data());
+
+    if (block.type == BlockHierarchyLz4)
+    {
+        if (!decompressLz4(payload, end - payload, dest, uncompressedLength))
+        {
+            return fail(QObject::tr("Unable to decompress FST hierarchy"));
+        }
+        return true;
+    }
+
+    // LZ4DUO compresses the hierarchy twice; the intermediate size precedes the data.
+    quint64 intermediateLength = 0;
+    if (!readVarint(payload, end, intermediateLength))
+    {
+        return fail(QObject::tr("Corrupt FST hierarchy block"));
+    }
+    QByteArray intermediate(static_cast<int>(intermediateLength), Qt::Uninitialized);
+    if (!decompressLz4(payload, end - payload, reinterpret_cast<uchar *>(intermediate.data()), intermediate.size()) ||
+        !decompressLz4(reinterpret_cast<const uchar *>(intermediate.constData()), intermediate.size(), dest, uncompressedLength))
+    {
+        return fail(QObject::tr("Unable to decompress FST hierarchy"));
+    }
+    return true;
+}
+
+bool FstBinaryReader::readHierarchy(Visitor &visitor)
+{
+    const Block *hierarchyBlock = nullptr;
+    for (const Block &block : m_blocks)
+    {
+        if (block.type == BlockHierarchy || block.type == BlockHierarchyLz4 || block.type == BlockHierarchyLz4Duo)
+        {
+            hierarchyBlock = &block;
+        }
+    }
+    if (!hierarchyBlock)
+    {
+        return fail(QObject::tr("FST file has no hierarchy block"));
+    }
+
+    QByteArray hierarchy;
+    if (!decodeHierarchy(*hierarchyBlock, hierarchy))
+    {
+        return false;
+    }
+
+    const uchar *cursor = reinterpret_cast<const uchar *>(hierarchy.constData());
+    const uchar *end = cursor + hierarchy.size();
+    quint32 nextHandle = 0;
+    QByteArray name;
+    QByteArray ignored;
+
+    while (cursor < end)
+    {
+        const int tag = *cursor++;
+        switch (tag)
+        {
+        case TagScope:
+        {
+            if (cursor >= end)
+            {
+                return fail(QObject::tr("Corrupt FST scope entry"));
+            }
+            const int scopeType = *cursor++;
+            if (!readCString(cursor, end, name) || !readCString(cursor, end, ignored))
+            {
+                return fail(QObject::tr("Corrupt FST scope entry"));
+            }
+            visitor.beginScope(scopeType, name);
+            break;
+        }
+        case TagUpscope:
+            visitor.endScope();
+            break;
+        case TagAttributeBegin:
+        {
+            quint64 argument = 0;
+            if (end - cursor < 2)
+            {
+                return fail(QObject::tr("Corrupt FST attribute entry"));
+            }
+            cursor += 2;
+            if (!readCString(cursor, end, ignored) || !readVarint(cursor, end, argument))
+            {
+                return fail(QObject::tr("Corrupt FST attribute entry"));
+            }
+            break;
+        }
+        case TagAttributeEnd:
+            break;
+        default:
+        {
+            VarDeclaration var;
+            var.type = tag;
+            quint64 length = 0;
+            quint64 alias = 0;
+            if (cursor >= end)
+            {
+                return fail(QObject::tr("Corrupt FST variable entry"));
+            }
+            var.direction = *cursor++;
+            if (!readCString(cursor, end, var.name) || !readVarint(cursor, end, length) || !readVarint(cursor, end, alias))
+            {
+                return fail(QObject::tr("Corrupt FST variable entry"));
+            }
+            var.length = static_cast<quint32>(length);
+            var.alias = alias != 0;
+            var.handle = var.alias ? static_cast<quint32>(alias) : ++nextHandle;
+            visitor.declareVar(var);
+            break;
+        }
+        }
+    }
+
+    return true;
+}
+
+bool FstBinaryReader::readValueChanges(Visitor &visitor, const QVector<bool> &selected, quint64 windowStart, quint64 windowEnd)
+{
+    bool first = true;
+    bool skipped = false;
+    for (const Block &block : m_blocks)
+    {
+        if (!isValueChangeBlock(block.type))
+        {
+            continue;
+        }
+        if (block.length < 32 + 24)
+        {
+            return fail(QObject::tr("Truncated FST value change block"));
+        }
+
+        const uchar *p = m_data + block.offset;
+        const quint64 beginTime = readBigEndian64(p + 8);
+        const quint64 endTime = readBigEndian64(p + 16);
+        if (beginTime > windowEnd)
+        {
+            break;
+        }
+        if (endTime < windowStart)
+        {
+            skipped = true;
+            continue;
+        }
+
+        // After skipped blocks nothing changes between the window start and
+        // this block, so its frame holds the values at the window start.
+        const quint64 frameTime = skipped && beginTime > windowStart ? windowStart : beginTime;
+        if (!readValueBlock(block, first, frameTime, selected, visitor))
+        {
+            return false;
+        }
+        if (!visitor.valueBlockDone(block.offset + block.length))
+        {
+            return fail(QObject::tr("Reading value changes was stopped"));
+        }
+        first = false;
+    }
+    return true;
+}
+
+bool FstBinaryReader::readValueBlock(const Block &block, bool emitFrame, quint64 frameTime, const QVector<bool> &selected, Visitor &visitor)
+{
+    const uchar *p = m_data + block.offset;
+    const uchar *blockEnd = p + block.length;
+
+    // Time table: three trailing 64-bit words describe the (optionally
+    // compressed) varint-delta encoded list of timestamps in this block.
+    const uchar *timeTrailer = blockEnd - 24;
+    const qint64 timeUncompressed = static_cast<qint64>(readBigEndian64(timeTrailer));
+    const qint64 timeCompressed = static_cast<qint64>(readBigEndian64(timeTrailer + 8));
+    const quint64 timeCount = readBigEndian64(timeTrailer + 16);
+    const uchar *timeData = timeTrailer - timeCompressed;
+    if (timeCompressed < 0 || timeData < p + 32 + 8)
+    {
+        return fail(QObject::tr("Corrupt FST time table"));
+    }
+
+    QByteArray timeScratch;
+    const uchar *timeCursor = timeData;
+    const uchar *timeEnd = timeTrailer;
+    if (timeCompressed != timeUncompressed)
+    {
+        timeScratch.resize(static_cast<int>(timeUncompressed));
+        if (!inflateZlib(timeData, timeCompressed, reinterpret_cast<uchar *>(timeScratch.data()), timeUncompressed))
+        {
+            return fail(QObject::tr("Unable to decompress FST time table"));
+        }
+        timeCursor = reinterpret_cast<const uchar *>(timeScratch.constData());
+        timeEnd = timeCursor + timeScratch.size();
+    }
+
+    QVector<quint64> timeTable;
+    timeTable.reserve(static_cast<int>(timeCount));
+    quint64 time = 0;
+    for (quint64 i = 0; i < timeCount; ++i)
+    {
+        quint64 delta = 0;
+        if (!readVarint(timeCursor, timeEnd, delta))
+        {
+            return fail(QObject::tr("Corrupt FST time table"));
+        }
+        time += delta;
+        timeTable.append(time);
+    }
+
+    // Frame: a snapshot of every signal at the block start time.
+    const uchar *cursor = p + 32;
+    quint64 frameUncompressed = 0;
+    quint64 frameCompressed = 0;
+    quint64 frameMaxHandle = 0;
+    if (!readVarint(cursor, timeData, frameUncompressed) || !readVarint(cursor, timeData, frameCompressed) || !readVarint(cursor, timeData, frameMaxHandle) ||
+        static_cast<quint64>(timeData - cursor) < frameCompressed)
+    {
+        return fail(QObject::tr("Corrupt FST frame section"));
+    }
+
+    if (emitFrame)
+    {
+        const uchar *frame = cursor;
+        QByteArray frameScratch;
+        if (frameCompressed != frameUncompressed)
+        {
+            frameScratch.resize(static_cast<int>(frameUncompressed));
+            if (!inflateZlib(cursor, static_cast<qint64>(frameCompressed), reinterpret_cast<uchar *>(frameScratch.data()), static_cast<qint64>(frameUncompressed)))
+            {
+                return fail(QObject::tr("Unable to decompress FST frame"));
+            }
+            frame = reinterpret_cast<const uchar *>(frameScratch.constData());
+        }
+
+        const uchar *frameEnd = frame + frameUncompressed;
+        const int handles = qMin(static_cast<int>(frameMaxHandle), m_signalLengths.size());
+        char realText[32];
+        for (int i = 0; i < handles; ++i)
+        {
+            const quint32 length = m_signalLengths.at(i);
+            if (length == 0)
+            {
+                continue;
+            }
+            if (static_cast<quint64>(frameEnd - frame) < length)
+            {
+                return fail(QObject::tr("Corrupt FST frame"));
+            }
+            if (!selected.isEmpty() && (i >= selected.size() || !selected.at(i)))
+            {
+                frame += length;
+                continue;
+            }
+            if (m_signalIsReal.at(i))
+            {
+                const int textLength = formatReal(frame, realText);
+                visitor.valueChange(static_cast<quint32>(i + 1), frameTime, realText, textLength);
+            }
+            else
+            {
+                visitor.valueChange(static_cast<quint32>(i + 1), frameTime, reinterpret_cast<const char *>(frame), static_cast<int>(length));
+            }
+            frame += length;
+        }
+    }
+    cursor += frameCompressed;
+
+    quint64 valueMaxHandle = 0;
+    if (!readVarint(cursor, timeData, valueMaxHandle) || cursor >= timeData)
+    {
+        return fail(QObject::tr("Corrupt FST value change section"));
+    }
+    const uchar *valueStart = cursor;
+    const char packType = static_cast<char>(*valueStart);
+
+    // Chain table: per-handle offsets of the value data relative to valueStart.
+    const uchar *indexPointer = timeData - 8;
+    const qint64 chainLength = static_cast<qint64>(readBigEndian64(indexPointer));
+    const uchar *chainStart = indexPointer - chainLength;
+    if (chainLength < 0 || chainStart <= valueStart)
+    {
+        return fail(QObject::tr("Corrupt FST chain table"));
+    }
+
+    const int handleCount = static_cast<int>(valueMaxHandle);
+    QVector<qint64> offsets(handleCount, 0);
+    QVector<qint64> lengths(handleCount, 0);
+    QVector<int> aliasOf(handleCount, -1);
+    int index = 0;
+    int lastData = -1;
+    qint64 position = 0;
+    qint64 previousAlias = 0;
+
+    const auto recordData = [&](qint64 delta) {
+        position += delta;
+        offsets[index] = position;
+        if (lastData >= 0)
+        {
+            lengths[lastData] = position - offsets.at(lastData);
+        }
+        lastData = index++;
+    };
+
+    const uchar *chain = chainStart;
+    while (chain < indexPointer)
+    {
+        if (block.type == BlockValueChangesDynamicAlias2 && (*chain & 0x01))
+        {
+            qint64 value = 0;
+            if (!readSignedVarint(chain, indexPointer, value) || index >= handleCount)
+            {
+                return fail(QObject::tr("Corrupt FST chain table"));
+            }
+            value >>= 1;
+            if (value > 0)
+            {
+                recordData(value);
+            }
+            else
+            {
+                if (value < 0)
+                {
+                    previousAlias = value;
+                }
+                aliasOf[index++] = static_cast<int>(-previousAlias - 1);
+            }
+            continue;
+        }
+
+        quint64 value = 0;
+        if (!readVarint(chain, indexPointer, value))
+        {
+            return fail(QObject::tr("Corrupt FST chain table"));
+        }
+
+        if (block.type != BlockValueChangesDynamicAlias2 && value == 0)
+        {
+            quint64 target = 0;
+            if (!readVarint(chain, indexPointer, target) || index >= handleCount)
+            {
+                return fail(QObject::tr("Corrupt FST chain table"));
+            }
+            aliasOf[index++] = static_cast<int>(target) - 1;
+        }
+        else if (block.type != BlockValueChangesDynamicAlias2 && (value & 1))
+        {
+            if (index >= handleCount)
+            {
+                return fail(QObject::tr("Corrupt FST chain table"));
+            }
+            recordData(static_cast<qint64>(value >> 1));
+        }
+        else
+        {
+            index += static_cast<int>(value >> 1);
+        }
+    }
+
+    if (index > handleCount)
+    {
+        return fail(QObject::tr("Corrupt FST chain table"));
+    }
+    if (lastData >= 0)
+    {
+        lengths[lastData] = (chainStart - valueStart) - offsets.at(lastData);
+    }
+
+    for (int i = 0; i < index; ++i)
+    {
+        const int target = aliasOf.at(i);
+        if (target >= 0 && target < i)
+        {
+            offsets[i] = offsets.at(target);
+            lengths[i] = lengths.at(target);
+        }
+    }
+
+    QByteArray scratch;
+    for (int i = 0; i < index; ++i)
+    {
+        if (offsets.at(i) == 0 || i >= m_signalLengths.size())
+        {
+            continue;
+        }
+        if (!selected.isEmpty() && (i >= selected.size() || !selected.at(i)))
+        {
+            continue;
+        }
+
+        const uchar *data = valueStart + offsets.at(i);
+        const uchar *dataEnd = data + lengths.at(i);
+        if (lengths.at(i) <= 0 || dataEnd > chainStart)
+        {
+            return fail(QObject::tr("Corrupt FST value data"));
+        }
+
+        quint64 expandedLength = 0;
+        if (!readVarint(data, dataEnd, expandedLength))
+        {
+            return fail(QObject::tr("Corrupt FST value data"));
+        }
+
+        const uchar *stream = data;
+        qint64 streamLength = dataEnd - data;
+        if (expandedLength != 0)
+        {
+            scratch.resize(static_cast<int>(expandedLength));
+            uchar *dest = reinterpret_cast<uchar *>(scratch.data());
+            bool ok = false;
+            if (packType == '4')
+            {
+                ok = decompressLz4(data, dataEnd - data, dest, static_cast<qint64>(expandedLength));
+            }
+            else if (packType == 'F')
+            {
+                ok = decompressFastLz(data, dataEnd - data, dest, static_cast<qint64>(expandedLength));
+            }
+            else
+            {
+                ok = inflateZlib(data, dataEnd - data, dest, static_cast<qint64>(expandedLength));
+            }
+            if (!ok)
+            {
+                return fail(QObject::tr("Unable to decompress FST value data"));
+            }
+            stream = dest;
+            streamLength = static_cast<qint64>(expandedLength);
+        }
+
+        if (!emitSignalChanges(static_cast<quint32>(i + 1), stream, streamLength, timeTable, visitor))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FstBinaryReader::emitSignalChanges(quint32 handle, const uchar *stream, qint64 length, const QVector<quint64> &timeTable, Visitor &visitor)
+{
+    const int index = static_cast<int>(handle) - 1;
+    const quint32 width = m_signalLengths.at(index);
+    const bool isReal = m_signalIsReal.at(index);
+    const uchar *cursor = stream;
+    const uchar *end = stream + length;
+    quint64 timeIndex = 0;
+    char realText[32];
+
+    while (cursor < end)
+    {
+        quint64 vli = 0;
+        if (!readVarint(cursor, end, vli))
+        {
+            return fail(QObject::tr("Corrupt FST value stream"));
+        }
+
+        const char *value = nullptr;
+        int valueLength = 0;
+        char scalar = '0';
+
+        if (width == 1)
+        {
+            if (!(vli & 1))
+            {
+                timeIndex += vli >> 2;
+                scalar = static_cast<char>('0' + ((vli >> 1) & 1));
+            }
+            else
+            {
+                timeIndex += vli >> 4;
+                scalar = kScalarEncodings[(vli >> 1) & 7];
+            }
+            value = &scalar;
+            valueLength = 1;
+        }
+        else if (isReal)
+        {
+            // As in fstapi, a real is its 8 raw bytes whatever the flag bit
+            // of the time delta says.
+            timeIndex += vli >> 1;
+            if (end - cursor < static_cast<qint64>(sizeof(double)))
+            {
+                return fail(QObject::tr("Corrupt FST value stream"));
+            }
+            valueLength = formatReal(cursor, realText);
+            value = realText;
+            cursor += sizeof(double);
+        }
+        else if (width == 0)
+        {
+            // Variable-length signals (strings) store a byte count and the
+            // bytes as they are, without bit packing.
+            timeIndex += vli >> 1;
+            quint64 bytes = 0;
+            if (!readVarint(cursor, end, bytes) || bytes > static_cast<quint64>(end - cursor))
+            {
+                return fail(QObject::tr("Corrupt FST value stream"));
+            }
+            value = reinterpret_cast<const char *>(cursor);
+            valueLength = static_cast<int>(bytes);
+            cursor += bytes;
+        }
+        else
+        {
+            timeIndex += vli >> 1;
+            const quint64 bits = width;
+            if (bits > static_cast<quint64>(end - cursor) * 8)
+            {
+                return fail(QObject::tr("Corrupt FST value stream"));
+            }
+
+            if (m_valueBuffer.size() < static_cast<int>(bits))
+            {
+                m_valueBuffer.resize(static_cast<int>(bits));
+            }
+            char *buffer = m_valueBuffer.data();
+
+            if (!(vli & 1))
+            {
+                const quint64 packedBytes = (bits + 7) / 8;
+                if (static_cast<quint64>(end - cursor) < packedBytes)
+                {
+                    return fail(QObject::tr("Corrupt FST value stream"));
+                }
+                for (quint64 bit = 0; bit < bits; ++bit)
+                {
+                    buffer[bit] = static_cast<char>('0' + ((cursor[bit / 8] >> (7 - (bit & 7))) & 1));
+                }
+                cursor += packedBytes;
+            }
+            else
+            {
+                if (static_cast<quint64>(end - cursor) < bits)
+                {
+                    return fail(QObject::tr("Corrupt FST value stream"));
+                }
+                std::memcpy(buffer, cursor, static_cast<size_t>(bits));
+                cursor += bits;
+            }
+
+            value = buffer;
+            valueLength = static_cast<int>(bits);
+        }
+
+        if (timeIndex >= static_cast<quint64>(timeTable.size()))
+        {
+            return fail(QObject::tr("FST value change references missing timestamp"));
+        }
+        visitor.valueChange(handle, timeTable.at(static_cast<int>(timeIndex)), value, valueLength);
+    }
+
+    return true;
+}
+
+int FstBinaryReader::formatReal(const uchar *bytes, char *buffer) const
+{
+    uchar ordered[sizeof(double)];
+    for (int i = 0; i < static_cast<int>(sizeof(double)); ++i)
+    {
+        ordered[i] = m_doubleEndianMatch ? bytes[i] : bytes[sizeof(double) - 1 - i];
+    }
+    double value = 0.0;
+    std::memcpy(&value, ordered, sizeof(value));
+    const int written = std::snprintf(buffer, 32, "%.16g", value);
+    return qBound(0, written, 31);
+}
+
+bool FstBinaryReader::fail(const QString &message)
+{
+    m_lastError = message;
+    return false;
+}
+
+QString FstBinaryReader::scopeTypeName(int scopeType)
+{
+    static const char *const names[] = {"module", "task", "function", "begin", "fork", "generate", "struct", "union",
+                                        "class", "interface", "package", "program", "vhdl_architecture", "vhdl_procedure",
+                                        "vhdl_function", "vhdl_record", "vhdl_process", "vhdl_block", "vhdl_for_generate",
+                                        "vhdl_if_generate", "vhdl_generate", "vhdl_package"};
+    if (scopeType >= 0 && scopeType < static_cast<int>(sizeof(names) / sizeof(names[0])))
+    {
+        return QString::fromLatin1(names[scopeType]);
+    }
+    return QStringLiteral("scope");
+}
+
+QString FstBinaryReader::varTypeName(int varType)
+{
+    static const char *const names[] = {"event", "integer", "parameter", "real", "real_parameter", "reg", "supply0",
+                                        "supply1", "time", "tri", "triand", "trior", "trireg", "tri0", "tri1", "wand",
+                                        "wire", "wor", "port", "sparray", "realtime", "string", "bit", "logic", "int",
+                                        "shortint", "longint", "byte", "enum", "shortreal"};
+    if (varType >= 0 && varType < static_cast<int>(sizeof(names) / sizeof(names[0])))
+    {
+        return QString::fromLatin1(names[varType]);
+    }
+    return QStringLiteral("wire");
+}
+
+QString FstBinaryReader::directionName(int direction)
+{
+    static const char *const names[] = {"-", "input", "output", "inout", "buffer", "linkage"};
+    if (direction >= 0 && direction < static_cast<int>(sizeof(names) / sizeof(names[0])))
+    {
+        return QString::fromLatin1(names[direction]);
+    }
+    return QStringLiteral("-");
+}
+
+bool FstBinaryReader::isRealType(int varType)
+{
+    return varType == kVarTypeReal || varType == kVarTypeRealParameter || varType == kVarTypeRealTime || varType == kVarTypeShortReal;
+}
+} // namespace fst
@@ -0,0 +1,343 @@
+#include "fst_compression.h"
+
+#include <zlib.h>
+
+#include <cstring>
+#include <limits>
+
+namespace fst
+{
+namespace
+{
+constexpr int kFastLzMaxL2Distance = 8191;
+
+bool copyMatch(uchar *&out, const uchar *outBegin, const uchar *outEnd, qint64 distance, qint64 length)
+{
+    if (distance <= 0 || distance > out - outBegin || length > outEnd - out)
+    {
+        return false;
+    }
+
+    const uchar *ref = out - distance;
+    // Matches may overlap the bytes being produced, so copy byte by byte.
+    for (qint64 i = 0; i < length; ++i)
+    {
+        *out++ = *ref++;
+    }
+    return true;
+}
+
+bool fastLzLevel1(const uchar *in, const uchar *inEnd, uchar *out, uchar *outEnd)
+{
+    const uchar *outBegin = out;
+    quint32 ctrl = *in++ & 31u;
+
+    while (true)
+    {
+        if (ctrl >= 32)
+        {
+            qint64 length = static_cast<qint64>(ctrl >> 5) - 1;
+            const qint64 offset = static_cast<qint64>(ctrl & 31u) << 8;
+            if (length == 7 - 1)
+            {
+                if (in >= inEnd)
+                {
+                    return false;
+                }
+                length += *in++;
+            }
+            if (in >= inEnd)
+            {
+                return false;
+            }
+            const qint64 distance = offset + *in++ + 1;
+            length += 3;
+            if (!copyMatch(out, outBegin, outEnd, distance, length))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            const qint64 literals = static_cast<qint64>(ctrl) + 1;
+            if (literals > inEnd - in || literals > outEnd - out)
+            {
+                return false;
+            }
+            std::memcpy(out, in, static_cast<size_t>(literals));
+            in += literals;
+            out += literals;
+        }
+
+        if (in >= inEnd)
+        {
+            break;
+        }
+        ctrl = *in++;
+    }
+
+    return out == outEnd;
+}
+
+bool fastLzLevel2(const uchar *in, const uchar *inEnd, uchar *out, uchar *outEnd)
+{
+    const uchar *outBegin = out;
+    quint32 ctrl = *in++ & 31u;
+
+    while (true)
+    {
+        if (ctrl >= 32)
+        {
+            qint64 length = static_cast<qint64>(ctrl >> 5) - 1;
+            qint64 offset = static_cast<qint64>(ctrl & 31u) << 8;
+            if (length == 7 - 1)
+            {
+                uchar code = 0;
+                do
+                {
+                    if (in >= inEnd)
+                    {
+                        return false;
+                    }
+                    code = *in++;
+                    length += code;
+                } while (code == 255);
+            }
+            if (in >= inEnd)
+            {
+                return false;
+            }
+            const uchar code = *in++;
+            qint64 distance = offset + code + 1;
+            length += 3;
+
+            if (code == 255 && offset == (31 << 8))
+            {
+                if (inEnd - in < 2)
+                {
+                    return false;
+                }
+                offset = static_cast<qint64>(in[0]) << 8;
+                offset += in[1];
+                in += 2;
+                distance = offset + kFastLzMaxL2Distance + 1;
+            }
+
+            if (!copyMatch(out, outBegin, outEnd, distance, length))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            const qint64 literals = static_cast<qint64>(ctrl) + 1;
+            if (literals > inEnd - in || literals > outEnd - out)
+            {
+                return false;
+            }
+            std::memcpy(out, in, static_cast<size_t>(literals));
+            in += literals;
+            out += literals;
+        }
+
+        if (in >= inEnd)
+        {
+            break;
+        }
+        ctrl = *in++;
+    }
+
+    return out == outEnd;
+}
+
+bool readLz4Length(const uchar *&in, const uchar *inEnd, qint64 &length)
+{
+    uchar byte = 0;
+    do
+    {
+        if (in >= inEnd)
+        {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+} // namespace
+
+bool inflateZlib(const uchar *source, qint64 sourceLength, uchar *dest, qint64 destLength)
+{
+    if (sourceLength < 0 || destLength < 0 || static_cast<quint64>(sourceLength) > std::numeric_limits<uLong>::max() ||
+        static_cast<quint64>(destLength) > std::numeric_limits<uLong>::max())
+    {
+        return false;
+    }
+
+    uLongf produced = static_cast<uLongf>(destLength);
+    const int rc = uncompress(dest, &produced, source, static_cast<uLong>(sourceLength));
+    return rc == Z_OK && static_cast<qint64>(produced) == destLength;
+}
+
+bool inflateGzip(const uchar *source, qint64 sourceLength, QByteArray &output, qint64 expectedLength)
+{
+    output.clear();
+    if (sourceLength <= 0)
+    {
+        return false;
+    }
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    // 15 window bits plus 16 selects gzip framing instead of a zlib header.
+    if (inflateInit2(&stream, 15 + 16) != Z_OK)
+    {
+        return false;
+    }
+
+    output.reserve(static_cast<int>(qBound<qint64>(0, expectedLength, std::numeric_limits<int>::max())));
+    stream.next_in = const_cast<Bytef *>(source);
+    const qint64 chunkSize = 1 << 20;
+    qint64 remaining = sourceLength;
+
+    int rc = Z_OK;
+    while (rc != Z_STREAM_END)
+    {
+        if (stream.avail_in == 0)
+        {
+            if (remaining == 0)
+            {
+                break;
+            }
+            const qint64 take = qMin<qint64>(remaining, std::numeric_limits<uInt>::max());
+            stream.avail_in = static_cast<uInt>(take);
+            remaining -= take;
+        }
+
+        const int oldSize = output.size();
+        const qint64 grow = qMax<qint64>(chunkSize, expectedLength - oldSize);
+        if (oldSize + grow > std::numeric_limits<int>::max())
+        {
+            rc = Z_MEM_ERROR;
+            break;
+        }
+        output.resize(oldSize + static_cast<int>(grow));
+        stream.next_out = reinterpret_cast<Bytef *>(output.data() + oldSize);
+        stream.avail_out = static_cast<uInt>(grow);
+
+        rc = inflate(&stream, Z_NO_FLUSH);
+        output.resize(oldSize + static_cast<int>(grow) - static_cast<int>(stream.avail_out));
+        if (rc != Z_OK && rc != Z_STREAM_END)
+        {
+            break;
+        }
+    }
+
+    inflateEnd(&stream);
+    return rc == Z_STREAM_END;
+}
+
+bool deflateZlib(const char *source, int sourceLength, QByteArray &output, int level)
+{
+    uLongf produced = compressBound(static_cast<uLong>(sourceLength));
+    output.resize(static_cast<int>(produced));
+    const int rc = compress2(reinterpret_cast<Bytef *>(output.data()), &produced, reinterpret_cast<const Bytef *>(source),
+                             static_cast<uLong>(sourceLength), level);
+    output.resize(rc == Z_OK ? static_cast<int>(produced) : 0);
+    return rc == Z_OK;
+}
+
+bool deflateGzip(const char *source, int sourceLength, QByteArray &output, int level)
+{
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    // As in inflateGzip(), 16 extra window bits select gzip framing.
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return false;
+    }
+
+    output.resize(static_cast<int>(deflateBound(&stream, static_cast<uLong>(sourceLength))));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(source));
+    stream.avail_in = static_cast<uInt>(sourceLength);
+    stream.next_out = reinterpret_cast<Bytef *>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+    const int rc = deflate(&stream, Z_FINISH);
+    output.resize(rc == Z_STREAM_END ? static_cast<int>(stream.total_out) : 0);
+    deflateEnd(&stream);
+    return rc == Z_STREAM_END;
+}
+
+bool decompressLz4(const uchar *source, qint64 sourceLength, uchar *dest, qint64 destLength)
+{
+    const uchar *in = source;
+    const uchar *inEnd = source + sourceLength;
+    uchar *out = dest;
+    uchar *outEnd = dest + destLength;
+
+    while (in < inEnd)
+    {
+        const uchar token = *in++;
+
+        qint64 literals = token >> 4;
+        if (literals == 15 && !readLz4Length(in, inEnd, literals))
+        {
+            return false;
+        }
+        if (literals > inEnd - in || literals > outEnd - out)
+        {
+            return false;
+        }
+        std::memcpy(out, in, static_cast<size_t>(literals));
+        in += literals;
+        out += literals;
+
+        // The final sequence of a block carries literals only.
+        if (in >= inEnd)
+        {
+            break;
+        }
+
+        if (inEnd - in < 2)
+        {
+            return false;
+        }
+        const qint64 distance = static_cast<qint64>(in[0]) | (static_cast<qint64>(in[1]) << 8);
+        in += 2;
+
+        qint64 matchLength = token & 15;
+        if (matchLength == 15 && !readLz4Length(in, inEnd, matchLength))
+        {
+            return false;
+        }
+        matchLength += 4;
+
+        if (!copyMatch(out, dest, outEnd, distance, matchLength))
+        {
+            return false;
+        }
+    }
+
+    return out == outEnd;
+}
+
+bool decompressFastLz(const uchar *source, qint64 sourceLength, uchar *dest, qint64 destLength)
+{
+    if (sourceLength <= 0)
+    {
+        return destLength == 0;
+    }
+
+    // The compression level is stored in the top three bits of the first byte.
+    const int level = (source[0] >> 5) + 1;
+    if (level == 1)
+    {
+        return fastLzLevel1(source, source + sourceLength, dest, dest + destLength);
+    }
+    if (level == 2)
+    {
+        return fastLzLevel2(source, source + sourceLength, dest, dest + destLength);
+    }
+    return false;
+}
+} // namespace fst
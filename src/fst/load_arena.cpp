@@ -0,0 +1,27 @@
+#include "load_arena.h"
+
+#include <cstdint>
+
+namespace fst
+{
+void *LoadArena::allocate(qint64 bytes, int alignment)
+{
+    const qint64 padding = static_cast<qint64>((alignment - reinterpret_cast<std::uintptr_t>(m_cursor) % alignment) % alignment);
+    if (bytes + padding > m_remaining)
+    {
+        // Blocks double up to a limit; larger requests get a block of their
+        // own, so a single huge column does not leave a huge tail.
+        const qint64 blockSize = qMax(bytes, m_nextBlockSize);
+        m_nextBlockSize = qMin(m_nextBlockSize * 2, kMaxBlockSize);
+        m_blocks.emplace_back(new char[static_cast<size_t>(blockSize)]);
+        m_cursor = m_blocks.back().get();
+        m_remaining = blockSize;
+        m_capacity += blockSize;
+        return allocate(bytes, alignment);
+    }
+    char *result = m_cursor + padding;
+    m_cursor = result + bytes;
+    m_remaining -= bytes + padding;
+    return result;
+}
+} // namespace fst
@@ -0,0 +1,117 @@
+#include "scope_table.h"
+
+#include <QStringList>
+
+namespace fst
+{
+ScopeTable::ScopeTable()
+{
+    clear();
+}
+
+void ScopeTable::clear()
+{
+    m_scopes.clear();
+    m_nextSignal.clear();
+    m_names.clear();
+    m_nameIds.clear();
+    m_utf8Ids.clear();
+
+    Entry root;
+    root.name = internId(QStringLiteral("root"));
+    root.type = root.name;
+    m_scopes.append(root);
+}
+
+int ScopeTable::addScope(int parent, const QString &name, const QString &type)
+{
+    Entry entry;
+    entry.name = internId(name);
+    entry.type = internId(type);
+    entry.parent = parent;
+    const int index = m_scopes.size();
+    m_scopes.append(entry);
+
+    Entry &parentEntry = m_scopes[parent];
+    if (parentEntry.lastChild < 0)
+    {
+        parentEntry.firstChild = index;
+    }
+    else
+    {
+        m_scopes[parentEntry.lastChild].nextSibling = index;
+    }
+    parentEntry.lastChild = index;
+    return index;
+}
+
+void ScopeTable::addSignal(int scope, int handle)
+{
+    if (m_nextSignal.size() <= handle)
+    {
+        m_nextSignal.resize(handle + 1);
+    }
+    m_nextSignal[handle] = -1;
+
+    Entry &entry = m_scopes[scope];
+    if (entry.lastSignal < 0)
+    {
+        entry.firstSignal = handle;
+    }
+    else
+    {
+        m_nextSignal[entry.lastSignal] = handle;
+    }
+    entry.lastSignal = handle;
+}
+
+QString ScopeTable::intern(const QString &text)
+{
+    return m_names.at(internId(text));
+}
+
+QString ScopeTable::intern(const QByteArray &utf8)
+{
+    const auto it = m_utf8Ids.constFind(utf8);
+    if (it != m_utf8Ids.constEnd())
+    {
+        return m_names.at(it.value());
+    }
+    const int id = internId(QString::fromUtf8(utf8));
+    // A deep copy, since parsers may hand out raw views of their buffers.
+    m_utf8Ids.insert(QByteArray(utf8.constData(), utf8.size()), id);
+    return m_names.at(id);
+}
+
+QString ScopeTable::path(int scope) const
+{
+    QStringList parts;
+    for (int current = scope; current > kRoot; current = m_scopes.at(current).parent)
+    {
+        parts.prepend(name(current));
+    }
+    return parts.join(QLatin1Char('.'));
+}
+
+QString ScopeTable::signalPath(const Signal &signal) const
+{
+    if (signal.scope <= kRoot || signal.scope >= m_scopes.size())
+    {
+        return signal.name;
+    }
+    return path(signal.scope) + QLatin1Char('.') + signal.name;
+}
+
+int ScopeTable::internId(const QString &text)
+{
+    const auto it = m_nameIds.constFind(text);
+    if (it != m_nameIds.constEnd())
+    {
+        return it.value();
+    }
+    const int id = m_names.size();
+    m_names.append(text);
+    m_nameIds.insert(text, id);
+    return id;
+}
+} // namespace fst
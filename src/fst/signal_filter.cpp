@@ -0,0 +1,63 @@
+#include "signal_filter.h"
+
+#include <QObject>
+
+namespace fst
+{
+namespace
+{
+bool isRegularExpression(const QString &pattern)
+{
+    return pattern.size() >= 2 && pattern.startsWith(QLatin1Char('/')) && pattern.endsWith(QLatin1Char('/'));
+}
+} // namespace
+
+SignalFilter::SignalFilter(const QStringList &patterns)
+{
+    for (const QString &pattern : patterns)
+    {
+        if (pattern.isEmpty())
+        {
+            continue;
+        }
+        const QRegularExpression expression(isRegularExpression(pattern)
+                                                ? pattern.mid(1, pattern.size() - 2)
+                                                : QRegularExpression::wildcardToRegularExpression(pattern));
+        if (!expression.isValid())
+        {
+            m_errorString = QObject::tr("Invalid signal pattern %1: %2").arg(pattern, expression.errorString());
+            m_expressions.clear();
+            return;
+        }
+        expression.optimize();
+        m_expressions.append(expression);
+    }
+}
+
+bool SignalFilter::matches(const QString &path) const
+{
+    for (const QRegularExpression &expression : m_expressions)
+    {
+        if (expression.match(path).hasMatch())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+QStringList SignalFilter::splitPatterns(const QString &text)
+{
+    const QString trimmed = text.trimmed();
+    if (isRegularExpression(trimmed))
+    {
+        return {trimmed};
+    }
+    QStringList patterns;
+    for (const QString &part : text.split(QLatin1Char(','), Qt::SkipEmptyParts))
+    {
+        patterns.append(part.trimmed());
+    }
+    return patterns;
+}
+} // namespace fst
@@ -1,17 +1,29 @@
 #include "simple_fst_reader.h"
 
+#include "compressed_stream.h"
+#include "fst_binary_reader.h"
+#include "load_arena.h"
+#include "parallel.h"
+#include "signal_filter.h"
+#include "spill_file.h"
+#include "trace_cache.h"
+#include "vcd_parser.h"
+#include "vcd_scanner.h"
+
+#include <QAtomicInteger>
 #include <QByteArray>
-#include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
-#include <QHash>
 #include <QIODevice>
-#include <QProcess>
-#include <QRegularExpression>
-#include <QTemporaryFile>
 #include <QTextStream>
 
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
 
 namespace fst
 {
@@ -26,39 +38,417 @@ QString joinPath(const QString &parent, const QString &name)
     return parent + QLatin1Char('.') + name;
 }
 
-QString normalizeScalarValue(const QString &value)
+// Returns the first whitespace-delimited `keyword` token that starts in
+// [from, limit) and ends by `end`, or nullptr. `from` must start a token.
+const char *findKeyword(const char *from, const char *limit, const char *end, std::string_view keyword)
 {
-    if (value.isEmpty())
+    const char *cursor = from;
+    while (cursor < limit)
     {
-        return QStringLiteral("0");
+        const char *dollar = static_cast<const char *>(std::memchr(cursor, '$', static_cast<size_t>(limit - cursor)));
+        if (!dollar)
+        {
+            break;
+        }
+        const char *tokenEnd = dollar + keyword.size();
+        if ((dollar == from || VcdScanner::isSpace(dollar[-1])) && tokenEnd <= end &&
+            std::string_view(dollar, keyword.size()) == keyword && (tokenEnd == end || VcdScanner::isSpace(*tokenEnd)))
+        {
+            return dollar;
+        }
+        cursor = dollar + 1;
+    }
+    return nullptr;
+}
+
+// Returns the end of the $comment block that `position` lies in, or
+// `position` when it lies outside of one. `safe` must lie outside of any
+// block, at or before `position`.
+const char *skipComment(const char *safe, const char *position, const char *end)
+{
+    const char *cursor = safe;
+    while (const char *open = findKeyword(cursor, position, end, "$comment"))
+    {
+        const char *close = findKeyword(open + 8, end, end, "$end");
+        if (!close)
+        {
+            return end;
+        }
+        cursor = close + 4;
+        if (cursor > position)
+        {
+            return cursor;
+        }
+    }
+    return position;
+}
+
+// Returns the start of the first line after `from` that begins with '#' and
+// is a timestamp rather than the text of a $comment block, or `end` if there
+// is none. Blocks are tracked from `safe`, which must lie outside of any
+// block, at or before `from`; passing `from` for both trusts `from`.
+const char *findTimestampLine(const char *safe, const char *from, const char *end)
+{
+    const char *cursor = skipComment(safe, from, end);
+    while (cursor < end)
+    {
+        const char *line = cursor;
+        while (line < end)
+        {
+            const void *newline = std::memchr(line, '\n', static_cast<size_t>(end - line));
+            if (!newline)
+            {
+                return end;
+            }
+            line = static_cast<const char *>(newline) + 1;
+            if (line < end && *line == '#')
+            {
+                break;
+            }
+        }
+        if (line >= end)
+        {
+            return end;
+        }
+        const char *outside = skipComment(cursor, line, end);
+        if (outside == line)
+        {
+            return line;
+        }
+        cursor = outside;
+    }
+    return end;
+}
+
+// Returns the start of the last line in [begin, end) that begins with '#', or
+// `begin` if there is none.
+const char *lastTimestampLine(const char *begin, const char *end)
+{
+    for (const char *cursor = end; cursor > begin;)
+    {
+        --cursor;
+        if (*cursor == '#' && (cursor == begin || cursor[-1] == '\n' || cursor[-1] == '\r'))
+        {
+            return cursor;
+        }
+    }
+    return begin;
+}
+
+// Parses the time of the timestamp line at `line`.
+bool timestampAt(const char *line, const char *end, qint64 &time)
+{
+    const char *digitsEnd = line + 1;
+    while (digitsEnd < end && *digitsEnd >= '0' && *digitsEnd <= '9')
+    {
+        ++digitsEnd;
     }
+    return digitsEnd > line + 1 && std::from_chars(line + 1, digitsEnd, time).ec == std::errc();
+}
 
-    const QChar c = value.at(0);
-    if (c == QLatin1Char('0') || c == QLatin1Char('1'))
+// Returns the last timestamp of a VCD value section by scanning backwards
+// from its end, or 0 if there is none.
+qint64 lastTimestamp(const char *begin, const char *end)
+{
+    for (const char *cursor = end; cursor > begin;)
     {
-        return QString(c);
+        --cursor;
+        if (*cursor != '#' || (cursor > begin && cursor[-1] != '\n' && cursor[-1] != '\r'))
+        {
+            continue;
+        }
+        qint64 time = 0;
+        if (timestampAt(cursor, end, time))
+        {
+            return time;
+        }
     }
+    return 0;
+}
 
-    if (c == QLatin1Char('x') || c == QLatin1Char('X'))
+// Returns the first timestamp line in [begin, end) whose time is past
+// `time`, or `end`. VCD timestamps only increase, so the section is
+// bisected by byte position instead of being scanned; comment blocks are
+// therefore only tracked from each probe on.
+const char *firstTimestampLineAfter(const char *begin, const char *end, qint64 time)
+{
+    const auto isPast = [end, time](const char *line) {
+        qint64 lineTime = 0;
+        return line == end || (timestampAt(line, end, lineTime) && lineTime > time);
+    };
+    const char *low = begin;
+    const char *high = end;
+    while (low < high)
     {
-        return QStringLiteral("X");
+        const char *middle = low + (high - low) / 2;
+        if (isPast(findTimestampLine(middle, middle, end)))
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
     }
-    if (c == QLatin1Char('z') || c == QLatin1Char('Z'))
+    return findTimestampLine(low, low, end);
+}
+
+// Applies the load window to the time of a change. Returns false for changes
+// past the window; earlier ones are moved to the window start, where each
+// overwrites the one before it under ValueStore's append rules.
+bool clampToWindow(const LoadOptions &options, qint64 &time)
+{
+    if (time > options.windowEnd)
     {
-        return QStringLiteral("Z");
+        return false;
     }
+    time = qMax(time, options.windowStart);
+    return true;
+}
 
-    return value;
+quint64 fstTime(qint64 time)
+{
+    return time < 0 ? 0 : static_cast<quint64>(time);
 }
+
+// Sets one bit per changing symbol in a column of a symbol-major bitset,
+// without decoding or storing any value.
+class PresenceScanner : public VcdParser::Handler
+{
+public:
+    PresenceScanner(quint64 *words, int wordsPerSymbol)
+        : m_words(words)
+        , m_wordsPerSymbol(wordsPerSymbol)
+    {
+    }
+
+    void setBit(int bit)
+    {
+        m_bit = quint64(1) << bit;
+    }
+
+    void beginScope(const QByteArray &, const QByteArray &) override
+    {
+    }
+
+    bool endScope() override
+    {
+        return true;
+    }
+
+    void declareVar(const VcdParser::VarDeclaration &) override
+    {
+    }
+
+    void scalarChange(int symbol, qint64, char) override
+    {
+        m_words[static_cast<size_t>(symbol) * static_cast<size_t>(m_wordsPerSymbol)] |= m_bit;
+    }
+
+    void vectorChange(int symbol, qint64, const char *, int) override
+    {
+        m_words[static_cast<size_t>(symbol) * static_cast<size_t>(m_wordsPerSymbol)] |= m_bit;
+    }
+
+private:
+    quint64 *m_words;
+    const int m_wordsPerSymbol;
+    quint64 m_bit = 0;
+};
 } // namespace
 
+struct SimpleFstReader::VcdValueSection
+{
+    const char *begin = nullptr;
+    const char *end = nullptr;
+    qint64 fileOffset = 0; // of `begin`, for progress reports
+    std::shared_ptr<const VcdParser::SymbolTable> symbols;
+    QVector<int> symbolHandles; // first signal handle per identifier code
+};
+
+struct SimpleFstReader::LazyVcdSource
+{
+    QFile file; // stays open and mapped; `section` points into it
+    uchar *mapping = nullptr;
+    VcdValueSection section;
+    QVector<int> symbolOfHandle;
+    // Coarse index from the pre-scan at open. Block i of the value section
+    // spans the offsets [blockOffsets[i], blockOffsets[i + 1]) from its start
+    // and begins at a timestamp line; bit i of a symbol's row in `presence`
+    // is set when the symbol changes in block i. Data a followed file gains
+    // past the last offset is not indexed.
+    QVector<qint64> blockOffsets;
+    int wordsPerSymbol = 0;
+    std::vector<quint64> presence;
+};
+
+// Parser state of a followed VCD. Everything past `readOffset` has not been
+// read yet and `pending` holds a trailing command that was only partly
+// written when it was read.
+struct SimpleFstReader::VcdFollowState : public VcdParser::Handler
+{
+    VcdFollowState(SimpleFstReader &reader, std::shared_ptr<const VcdParser::SymbolTable> symbols, const QVector<int> &symbolHandles)
+        : reader(reader)
+        , symbolHandles(symbolHandles)
+        , parser(*this, std::move(symbols))
+    {
+    }
+
+    void beginScope(const QByteArray &, const QByteArray &) override
+    {
+    }
+
+    bool endScope() override
+    {
+        return false;
+    }
+
+    void declareVar(const VcdParser::VarDeclaration &) override
+    {
+    }
+
+    // Signals that are not loaded yet pick these changes up from the file
+    // when ensureLoaded() decodes them.
+    void scalarChange(int symbol, qint64 time, char value) override
+    {
+        Signal *signal = reader.m_signals.find(symbolHandles.value(symbol, -1));
+        if (signal && signal->valuesLoaded && clampToWindow(reader.m_options, time))
+        {
+            const bool sorted = signal->values.isSorted();
+            signal->values.appendScalar(time, value);
+            noteUnsorted(signal->handle, sorted, signal->values);
+        }
+    }
+
+    void vectorChange(int symbol, qint64 time, const char *value, int length) override
+    {
+        Signal *signal = reader.m_signals.find(symbolHandles.value(symbol, -1));
+        if (signal && signal->valuesLoaded && clampToWindow(reader.m_options, time))
+        {
+            const bool sorted = signal->values.isSorted();
+            signal->values.append(time, value, length);
+            noteUnsorted(signal->handle, sorted, signal->values);
+        }
+    }
+
+    void noteUnsorted(int handle, bool wasSorted, const ValueStore &values)
+    {
+        if (wasSorted && !values.isSorted())
+        {
+            unsortedHandles.append(handle);
+        }
+    }
+
+    SimpleFstReader &reader;
+    QVector<int> symbolHandles;
+    QVector<int> unsortedHandles;
+    VcdParser parser;
+    QFile file;
+    qint64 readOffset = 0;
+    QByteArray pending;
+};
+
+struct SimpleFstReader::LazyFstSource
+{
+    FstBinaryReader reader;
+    QVector<quint32> fstHandleOf; // FST handle per signal handle
+};
+
+// A filtered VCD that could only be streamed: compressed, or not mappable.
+struct SimpleFstReader::LazyVcdStream
+{
+    QString filePath;
+    CompressedStream::Format format = CompressedStream::Format::None;
+    qint64 valueOffset = 0; // of the value section in the (decompressed) text
+    std::shared_ptr<const VcdParser::SymbolTable> symbols;
+    QVector<int> symbolHandles; // first signal handle per identifier code
+    QVector<int> symbolOfHandle;
+};
+
 SimpleFstReader::SimpleFstReader() = default;
 SimpleFstReader::~SimpleFstReader() = default;
 
-bool SimpleFstReader::load(const QString &filePath)
+bool SimpleFstReader::load(const QString &filePath, const LoadOptions &options)
 {
     clear();
+    m_options = options;
+    const SignalFilter filter(options.signalFilter);
+    if (!filter.isValid())
+    {
+        m_lastError = filter.errorString();
+        return false;
+    }
+    const bool filtered = !filter.isEmpty();
+    if (filtered)
+    {
+        m_options.lazy = true;
+    }
+    const bool cacheable = options.useCache && !options.follow && !options.hasWindow() && !filtered;
 
+    QElapsedTimer timer;
+    timer.start();
+    QString cachePath;
+    if (cacheable)
+    {
+        cachePath = TraceCache::cachePath(filePath, options.cacheDirectory);
+        m_statistics.fromCache = TraceCache::read(filePath, cachePath, m_scopes, m_signals, m_timeEnd);
+    }
+    m_statistics.bytes = QFileInfo(filePath).size();
+    bool ok = m_statistics.fromCache || loadFile(filePath);
+    m_timeEnd = qMin(m_timeEnd, options.windowEnd);
+    if (ok && filtered)
+    {
+        ok = loadSelectedSignals(filter);
+    }
+    if (isCanceled())
+    {
+        m_lastError = QObject::tr("Loading %1 was canceled").arg(filePath);
+        ok = false;
+    }
+    if (ok)
+    {
+        publishHierarchy();
+    }
+
+    m_statistics.elapsedNs = timer.nsecsElapsed();
+    m_statistics.signalCount = m_signals.size();
+    releaseAliasValues();
+    for (Signal &signal : m_signals)
+    {
+        if (signal.aliasOf > 0)
+        {
+            continue;
+        }
+        finishValues(signal.values);
+        m_statistics.transitionCount += signal.values.size();
+        m_statistics.valueBytes += signal.values.memoryUsage();
+    }
+    if (m_arena)
+    {
+        m_statistics.valueBytes += m_arena->capacity();
+    }
+    shareAliasValues();
+
+    // A cache can only be written from a trace whose values are all loaded.
+    if (ok && cacheable && !m_statistics.fromCache && !m_options.lazy)
+    {
+        // Failing to write the cache only costs the next open its speed-up.
+        TraceCache::write(filePath, cachePath, m_scopes, m_signals, m_timeEnd);
+    }
+    if (ok)
+    {
+        // Failing to spill leaves the values in memory; the trace is loaded.
+        enforceMemoryBudget();
+    }
+
+    // The observer only follows this call; later ensureLoaded() and
+    // readAppended() calls run without it.
+    m_options.observer = nullptr;
+    return ok;
+}
+
+bool SimpleFstReader::loadFile(const QString &filePath)
+{
     QFileInfo info(filePath);
     if (!info.exists() || !info.isFile())
     {
@@ -82,38 +472,36 @@ bool SimpleFstReader::load(const QString &filePath)
         return ok;
     }
 
-    const QString suffix = info.suffix().toLower();
-
-    if (suffix == QLatin1String("vcd"))
+    if (FstBinaryReader::isFstFile(header))
     {
-        const bool ok = loadFromVcd(file);
         file.close();
+        const bool ok = loadFromFstBinary(filePath);
+        if (!ok && m_lastError.isEmpty())
+        {
+            m_lastError = QObject::tr("Unsupported or corrupt FST file: %1").arg(filePath);
+        }
         return ok;
     }
 
-    if (suffix == QLatin1String("fst"))
+    // Compressed VCDs are recognized by their magic bytes, whatever their
+    // suffix, and decompressed on a thread of their own while being parsed.
+    const CompressedStream::Format compression = CompressedStream::detect(header);
+    if (compression != CompressedStream::Format::None)
     {
+        CompressedStream stream(filePath, compression);
+        stream.start();
+        const bool ok = loadFromVcd(file, &stream);
         file.close();
-        if (loadFromFstBinary(filePath))
-        {
-            return true;
-        }
+        return ok;
+    }
 
-        if (file.open(QIODevice::ReadOnly))
-        {
-            const bool fallbackOk = loadFromVcd(file);
-            file.close();
-            if (fallbackOk)
-            {
-                return true;
-            }
-        }
+    const QString suffix = info.suffix().toLower();
 
-        if (m_lastError.isEmpty())
-        {
-            m_lastError = QObject::tr("Unsupported or corrupt FST file: %1").arg(filePath);
-        }
-        return false;
+    if (suffix == QLatin1String("vcd"))
+    {
+        const bool ok = loadFromVcd(file);
+        file.close();
+        return ok;
     }
 
     const bool ok = loadFromVcd(file);
@@ -125,16 +513,21 @@ bool SimpleFstReader::load(const QString &filePath)
     return ok;
 }
 
-const Scope &SimpleFstReader::rootScope() const
+const ScopeTable &SimpleFstReader::scopeTable() const
 {
-    return m_rootScope;
+    return m_scopes;
 }
 
-const QMap<int, Signal> &SimpleFstReader::signalMap() const
+const SignalTable &SimpleFstReader::signalTable() const
 {
     return m_signals;
 }
 
+const QVector<int> &SimpleFstReader::selectedHandles() const
+{
+    return m_selected;
+}
+
 QString SimpleFstReader::lastError() const
 {
     return m_lastError;
@@ -145,17 +538,37 @@ qint64 SimpleFstReader::maxTime() const
     return m_timeEnd;
 }
 
+const LoadStatistics &SimpleFstReader::loadStatistics() const
+{
+    return m_statistics;
+}
+
+double LoadStatistics::megabytesPerSecond() const
+{
+    if (elapsedNs <= 0)
+    {
+        return 0.0;
+    }
+    return (bytes / (1024.0 * 1024.0)) / (elapsedNs / 1e9);
+}
+
+double LoadStatistics::bytesPerTransition() const
+{
+    if (transitionCount <= 0)
+    {
+        return 0.0;
+    }
+    return static_cast<double>(valueBytes) / static_cast<double>(transitionCount);
+}
+
 bool SimpleFstReader::loadFromPseudoText(QIODevice &device)
 {
     QTextStream stream(&device);
     stream.setCodec("UTF-8");
 
-    QVector<Scope> scopeStack;
-    Scope root;
-    root.name = QStringLiteral("root");
-    root.type = QStringLiteral("root");
-    root.path = QString();
-    scopeStack.append(root);
+    // Open scopes with their paths, innermost last.
+    QVector<int> scopeStack = {ScopeTable::kRoot};
+    QStringList pathStack = {QString()};
 
     QMap<QString, int> nameToHandle;
     int nextHandle = 1;
@@ -186,11 +599,8 @@ bool SimpleFstReader::loadFromPseudoText(QIODevice &device)
                 return false;
             }
 
-            Scope scope;
-            scope.type = parts.at(1);
-            scope.name = parts.at(2);
-            scope.path = joinPath(scopeStack.last().path, scope.name);
-            scopeStack.append(scope);
+            scopeStack.append(m_scopes.addScope(scopeStack.last(), parts.at(2), parts.at(1)));
+            pathStack.append(joinPath(pathStack.last(), parts.at(2)));
         }
         else if (keyword == QLatin1String("endscope"))
         {
@@ -200,8 +610,8 @@ bool SimpleFstReader::loadFromPseudoText(QIODevice &device)
                 return false;
             }
 
-            Scope completed = scopeStack.takeLast();
-            scopeStack.last().children.append(completed);
+            scopeStack.removeLast();
+            pathStack.removeLast();
         }
         else if (keyword == QLatin1String("signal"))
         {
@@ -217,16 +627,17 @@ bool SimpleFstReader::loadFromPseudoText(QIODevice &device)
             signal.type = parts.at(2);
             signal.direction = parts.at(3);
             signal.bitWidth = parts.at(4).toInt();
-            signal.path = joinPath(scopeStack.last().path, signal.name);
+            signal.scope = scopeStack.last();
+            signal.values = ValueStore(ValueStore::kindFor(signal.type, signal.bitWidth, signal.isEnum), signal.bitWidth);
 
-            nameToHandle.insert(signal.path, signal.handle);
+            nameToHandle.insert(joinPath(pathStack.last(), signal.name), signal.handle);
             if (!nameToHandle.contains(signal.name))
             {
                 nameToHandle.insert(signal.name, signal.handle);
             }
 
-            scopeStack.last().signalHandles.append(signal.handle);
-            m_signals.insert(signal.handle, signal);
+            m_scopes.addSignal(signal.scope, signal.handle);
+            m_signals.insert(signal);
         }
         else if (keyword == QLatin1String("value"))
         {
@@ -244,9 +655,9 @@ bool SimpleFstReader::loadFromPseudoText(QIODevice &device)
                 m_lastError = QObject::tr("Invalid time in value change on line %1").arg(lineNumber);
                 return false;
             }
-            const QString value = parts.at(3);
+            const QByteArray value = parts.at(3).toUtf8();
 
-            int handle = nameToHandle.value(joinPath(scopeStack.last().path, id), -1);
+            int handle = nameToHandle.value(joinPath(pathStack.last(), id), -1);
             if (handle < 0)
             {
                 handle = nameToHandle.value(id, -1);
@@ -257,347 +668,1475 @@ bool SimpleFstReader::loadFromPseudoText(QIODevice &device)
                 return false;
             }
 
-            appendSignalValue(handle, time, value);
+            appendSignalValue(handle, time, value.constData(), value.size());
         }
     }
 
-    if (!finalizeHierarchy(scopeStack))
-    {
-        m_lastError = QObject::tr("Malformed scope hierarchy");
-        return false;
-    }
-
-    for (auto it = m_signals.begin(); it != m_signals.end(); ++it)
-    {
-        auto &values = it.value().values;
-        std::sort(values.begin(), values.end(), [](const SignalValue &a, const SignalValue &b) {
-            return a.time < b.time;
-        });
-    }
+    sortUnsortedStores();
 
     return true;
 }
 
-bool SimpleFstReader::loadFromVcd(QIODevice &device)
+bool SimpleFstReader::loadFromVcd(QFile &file, CompressedStream *compressed)
 {
-    QTextStream stream(&device);
-    stream.setCodec("UTF-8");
-
-    QVector<Scope> scopeStack;
-    Scope root;
-    root.name = QStringLiteral("root");
-    root.type = QStringLiteral("root");
-    root.path = QString();
-    scopeStack.append(root);
-
-    QHash<QString, int> symbolToHandle;
-    int nextHandle = 1;
-    bool inDefinitions = true;
-    bool inDumpvars = false;
-    qint64 currentTime = 0;
-
-    auto ensureScopeFinalized = [this, &scopeStack]() {
-        if (!finalizeHierarchy(scopeStack))
-        {
-            m_lastError = QObject::tr("Malformed scope hierarchy in VCD");
-            return false;
-        }
-        return true;
-    };
-
-    while (!stream.atEnd())
+    class Builder : public VcdParser::Handler
     {
-        QString line = stream.readLine();
-        if (line.isNull())
+    public:
+        explicit Builder(SimpleFstReader &reader)
+            : m_reader(reader)
         {
-            break;
         }
-        line = line.trimmed();
-        if (line.isEmpty())
+
+        void beginScope(const QByteArray &type, const QByteArray &name) override
         {
-            continue;
+            m_scopeStack.append(m_reader.m_scopes.addScope(m_scopeStack.last(), QString::fromUtf8(name), QString::fromUtf8(type)));
         }
 
-        if (inDefinitions)
+        bool endScope() override
         {
-            if (line.startsWith(QLatin1String("$scope")))
+            if (m_scopeStack.size() <= 1)
             {
-                QString definition = line;
-                while (!definition.contains(QLatin1String("$end")) && !stream.atEnd())
-                {
-                    definition += QLatin1Char(' ') + stream.readLine().trimmed();
-                }
-                const QStringList parts = definition.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
-                if (parts.size() < 4)
-                {
-                    m_lastError = QObject::tr("Invalid scope definition in VCD");
-                    return false;
-                }
-
-                Scope scope;
-                scope.type = parts.at(1);
-                scope.name = parts.at(2);
-                scope.path = joinPath(scopeStack.last().path, scope.name);
-                scopeStack.append(scope);
-                continue;
+                return false;
             }
+            m_scopeStack.removeLast();
+            return true;
+        }
 
-            if (line.startsWith(QLatin1String("$upscope")))
+        void declareVar(const VcdParser::VarDeclaration &var) override
+        {
+            Signal signal;
+            signal.handle = m_nextHandle++;
+            signal.name = m_reader.m_scopes.intern(var.reference);
+            signal.type = m_reader.m_scopes.intern(var.type);
+            signal.direction = QStringLiteral("-");
+            signal.bitWidth = var.width;
+            signal.scope = m_scopeStack.last();
+            signal.values = ValueStore(ValueStore::kindFor(signal.type, signal.bitWidth, signal.isEnum), signal.bitWidth);
+
+            if (m_symbolHandles.size() <= var.symbol)
             {
-                if (scopeStack.size() <= 1)
-                {
-                    m_lastError = QObject::tr("Unexpected $upscope in VCD");
-                    return false;
-                }
-                Scope completed = scopeStack.takeLast();
-                scopeStack.last().children.append(completed);
-                continue;
+                m_symbolHandles.resize(var.symbol + 1);
             }
-
-            if (line.startsWith(QLatin1String("$var")))
+            // Later declarations of an identifier share the store of the first.
+            if (m_symbolHandles.at(var.symbol) > 0)
             {
-                QString definition = line;
-                while (!definition.contains(QLatin1String("$end")) && !stream.atEnd())
-                {
-                    definition += QLatin1Char(' ') + stream.readLine().trimmed();
-                }
-
-                const QStringList parts = definition.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
-                if (parts.size() < 6)
-                {
-                    m_lastError = QObject::tr("Invalid $var definition in VCD");
-                    return false;
-                }
-
-                const QString type = parts.at(1);
-                bool widthOk = false;
-                const int width = parts.at(2).toInt(&widthOk);
-                if (!widthOk)
-                {
-                    m_lastError = QObject::tr("Invalid bit width in VCD");
-                    return false;
-                }
-                const QString identifier = parts.at(3);
-                QString reference;
-                for (int i = 4; i < parts.size() - 1; ++i)
-                {
-                    if (!reference.isEmpty())
-                    {
-                        reference += QLatin1Char(' ');
-                    }
-                    reference += parts.at(i);
-                }
-
-                Signal signal;
-                signal.handle = nextHandle++;
-                signal.name = reference;
-                signal.type = type;
-                signal.direction = QStringLiteral("-");
-                signal.bitWidth = width;
-                signal.path = joinPath(scopeStack.last().path, signal.name);
-
-                scopeStack.last().signalHandles.append(signal.handle);
-                m_signals.insert(signal.handle, signal);
-                symbolToHandle.insert(identifier, signal.handle);
-                continue;
+                signal.aliasOf = m_symbolHandles.at(var.symbol);
             }
-
-            if (line.startsWith(QLatin1String("$enddefinitions")))
+            else
             {
-                inDefinitions = false;
-                continue;
+                m_symbolHandles[var.symbol] = signal.handle;
             }
 
-            // ignore other definition commands like $timescale
-            continue;
+            m_reader.m_scopes.addSignal(signal.scope, signal.handle);
+            m_reader.m_signals.insert(signal);
         }
 
-        if (line.startsWith(QLatin1Char('#')))
+        void scalarChange(int symbol, qint64 time, char value) override
         {
-            bool ok = false;
-            const qint64 time = line.mid(1).toLongLong(&ok);
-            if (!ok)
-            {
-                m_lastError = QObject::tr("Invalid timestamp in VCD");
+            ++m_changeCount;
+            m_reader.appendScalarValue(m_symbolHandles.at(symbol), time, value);
+        }
+
+        void vectorChange(int symbol, qint64 time, const char *value, int length) override
+        {
+            ++m_changeCount;
+            m_reader.appendSignalValue(m_symbolHandles.at(symbol), time, value, length);
+        }
+
+        const QVector<int> &symbolHandles() const
+        {
+            return m_symbolHandles;
+        }
+
+        qint64 changeCount() const
+        {
+            return m_changeCount;
+        }
+
+    private:
+        SimpleFstReader &m_reader;
+        QVector<int> m_scopeStack = {ScopeTable::kRoot};
+        QVector<int> m_symbolHandles;
+        qint64 m_changeCount = 0;
+        int m_nextHandle = 1;
+    };
+
+    Builder builder(*this);
+    VcdParser parser(builder);
+
+    // A lazily opened file stays mapped for later ensureLoaded() calls, so it
+    // is mapped through a QFile owned by the reader.
+    std::unique_ptr<LazyVcdSource> lazy;
+    QFile *source = &file;
+    if (m_options.lazy && !compressed)
+    {
+        lazy = std::make_unique<LazyVcdSource>();
+        lazy->file.setFileName(file.fileName());
+        if (lazy->file.open(QIODevice::ReadOnly))
+        {
+            source = &lazy->file;
+        }
+    }
+
+    const qint64 size = source->size();
+    uchar *mapped = size > 0 && !compressed ? source->map(0, size) : nullptr;
+    qint64 resumeOffset = -1;
+    if (mapped)
+    {
+        const char *begin = reinterpret_cast<const char *>(mapped);
+        const char *end = begin + size;
+        const qint64 headerLength = parser.parseDefinitions(begin, end, true);
+        if (headerLength < 0)
+        {
+            m_lastError = parser.lastError();
+            return false;
+        }
+
+        // The browser can be filled while the value section is parsed.
+        publishHierarchy();
+        reportProgress(headerLength, 0);
+
+        VcdValueSection section;
+        section.begin = begin + headerLength;
+        section.end = end;
+        section.fileOffset = headerLength;
+        section.symbols = parser.symbolTable();
+        section.symbolHandles = builder.symbolHandles();
+
+        // A followed file leaves its last time step to the follow parser,
+        // which holds back a command the simulator has only partly written.
+        if (m_options.follow)
+        {
+            section.end = lastTimestampLine(section.begin, section.end);
+            resumeOffset = section.end - begin;
+        }
+        else if (m_options.windowEnd < std::numeric_limits<qint64>::max())
+        {
+            // Nothing past the window is parsed, now or by ensureLoaded().
+            section.end = firstTimestampLineAfter(section.begin, section.end, m_options.windowEnd);
+        }
+
+        if (lazy)
+        {
+            lazy->mapping = mapped;
+            lazy->symbolOfHandle.fill(-1, m_signals.maxHandle() + 1);
+            for (int symbol = 0; symbol < section.symbolHandles.size(); ++symbol)
+            {
+                lazy->symbolOfHandle[section.symbolHandles.at(symbol)] = symbol;
+            }
+            for (Signal &signal : m_signals)
+            {
+                signal.valuesLoaded = false;
+            }
+            m_timeEnd = qMax(m_timeEnd, lastTimestamp(section.begin, section.end));
+            lazy->section = section;
+            if (!indexVcdValues(*lazy))
+            {
+                return false;
+            }
+            m_lazyVcd = std::move(lazy);
+        }
+        else
+        {
+            const bool ok = loadVcdValues(section, QVector<bool>());
+            source->unmap(mapped);
+            if (!ok)
+            {
+                return false;
+            }
+        }
+    }
+    else
+    {
+        // Compressed traces and devices that cannot be mapped are streamed
+        // through the same parser; unconsumed bytes of a partial command are
+        // carried into the next read. With a signal filter, the parser skips
+        // the changes of unselected signals, which are streamed again when
+        // they are needed.
+        const SignalFilter filter(m_options.signalFilter);
+        QByteArray buffer;
+        qint64 bytesRead = 0;
+        qint64 textOffset = 0;
+        bool atEnd = false;
+        while (!atEnd)
+        {
+            if (isCanceled())
+            {
+                return false;
+            }
+            QByteArray chunk;
+            if (!readVcdChunk(file, compressed, chunk, atEnd, bytesRead))
+            {
                 return false;
             }
-            currentTime = time;
-            if (time > m_timeEnd)
+            // Decompressed chunks are taken over without a copy when nothing
+            // is left of the previous one.
+            if (buffer.isEmpty())
+            {
+                buffer = chunk;
+            }
+            else
             {
-                m_timeEnd = time;
+                buffer.append(chunk);
             }
+            const char *end = buffer.constData() + buffer.size();
+            qint64 consumed = 0;
+            if (!parser.definitionsComplete())
+            {
+                consumed = parser.parseDefinitions(buffer.constData(), end, atEnd);
+                if (consumed >= 0 && parser.definitionsComplete())
+                {
+                    publishHierarchy();
+                    if (!filter.isEmpty())
+                    {
+                        auto stream = std::make_unique<LazyVcdStream>();
+                        stream->filePath = file.fileName();
+                        stream->format = compressed ? compressed->format() : CompressedStream::Format::None;
+                        stream->valueOffset = textOffset + consumed;
+                        stream->symbols = parser.symbolTable();
+                        stream->symbolHandles = builder.symbolHandles();
+                        stream->symbolOfHandle.fill(-1, m_signals.maxHandle() + 1);
+                        for (int symbol = 0; symbol < stream->symbolHandles.size(); ++symbol)
+                        {
+                            stream->symbolOfHandle[stream->symbolHandles.at(symbol)] = symbol;
+                        }
+                        QVector<bool> mask(stream->symbolHandles.size(), false);
+                        for (int handle : matchSignals(filter))
+                        {
+                            const Signal *signal = m_signals.find(handle);
+                            const int symbol = stream->symbolOfHandle.value(signal->aliasOf > 0 ? signal->aliasOf : handle, -1);
+                            if (symbol >= 0)
+                            {
+                                mask[symbol] = true;
+                            }
+                        }
+                        for (Signal &signal : m_signals)
+                        {
+                            const int symbol = stream->symbolOfHandle.value(signal.aliasOf > 0 ? signal.aliasOf : signal.handle, -1);
+                            signal.valuesLoaded = symbol >= 0 && mask.at(symbol);
+                        }
+                        parser.setSymbolMask(mask);
+                        m_lazyStream = std::move(stream);
+                    }
+                }
+            }
+            if (consumed >= 0 && parser.definitionsComplete())
+            {
+                const qint64 values = parser.parse(buffer.constData() + consumed, end, atEnd);
+                consumed = values < 0 ? values : consumed + values;
+            }
+            if (consumed < 0)
+            {
+                m_lastError = parser.lastError();
+                return false;
+            }
+            textOffset += consumed;
+            buffer = buffer.mid(static_cast<int>(consumed));
+            reportProgress(bytesRead, builder.changeCount());
+        }
+    }
+
+    if (parser.maxTime() > m_timeEnd)
+    {
+        m_timeEnd = parser.maxTime();
+    }
+
+    sortUnsortedStores();
+
+    if (resumeOffset >= 0)
+    {
+        auto follow = std::make_unique<VcdFollowState>(*this, parser.symbolTable(), builder.symbolHandles());
+        follow->file.setFileName(file.fileName());
+        if (!follow->file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+        {
+            m_lastError = QObject::tr("Unable to open %1").arg(file.fileName());
+            return false;
+        }
+        follow->readOffset = resumeOffset;
+        m_follow = std::move(follow);
+        return readAppended();
+    }
+
+    return true;
+}
+
+bool SimpleFstReader::readVcdChunk(QFile &file, CompressedStream *compressed, QByteArray &chunk, bool &atEnd, qint64 &bytesRead)
+{
+    constexpr qint64 kChunkSize = 4 * 1024 * 1024;
+    if (compressed)
+    {
+        if (!compressed->read(chunk))
+        {
+            m_lastError = compressed->errorString();
+            return false;
+        }
+        bytesRead = compressed->bytesRead();
+        atEnd = chunk.isEmpty();
+        return true;
+    }
+    chunk = file.read(kChunkSize);
+    bytesRead += chunk.size();
+    atEnd = file.atEnd();
+    return true;
+}
+
+bool SimpleFstReader::loadStreamedValues(const LazyVcdStream &stream, const QVector<bool> &wanted)
+{
+    class Router : public VcdParser::Handler
+    {
+    public:
+        Router(SimpleFstReader &reader, const QVector<int> &symbolHandles)
+            : m_reader(reader)
+            , m_symbolHandles(symbolHandles)
+        {
+        }
+
+        void beginScope(const QByteArray &, const QByteArray &) override
+        {
+        }
+
+        bool endScope() override
+        {
+            return true;
+        }
+
+        void declareVar(const VcdParser::VarDeclaration &) override
+        {
+        }
+
+        void scalarChange(int symbol, qint64 time, char value) override
+        {
+            m_reader.appendScalarValue(m_symbolHandles.at(symbol), time, value);
+        }
+
+        void vectorChange(int symbol, qint64 time, const char *value, int length) override
+        {
+            m_reader.appendSignalValue(m_symbolHandles.at(symbol), time, value, length);
+        }
+
+    private:
+        SimpleFstReader &m_reader;
+        const QVector<int> &m_symbolHandles;
+    };
+
+    QFile file(stream.filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        m_lastError = QObject::tr("Unable to open %1").arg(stream.filePath);
+        return false;
+    }
+    // A plain file is read from the value section on; decompressed text has
+    // to be produced from the start and the definitions dropped.
+    std::unique_ptr<CompressedStream> compressed;
+    qint64 skip = stream.valueOffset;
+    if (stream.format != CompressedStream::Format::None)
+    {
+        compressed = std::make_unique<CompressedStream>(stream.filePath, stream.format);
+        compressed->start();
+    }
+    else if (file.seek(stream.valueOffset))
+    {
+        skip = 0;
+    }
+    else
+    {
+        m_lastError = QObject::tr("Unable to read %1").arg(stream.filePath);
+        return false;
+    }
+
+    Router router(*this, stream.symbolHandles);
+    VcdParser parser(router, stream.symbols);
+    parser.setSymbolMask(wanted);
+    QByteArray buffer;
+    qint64 bytesRead = 0;
+    bool atEnd = false;
+    while (!atEnd)
+    {
+        if (isCanceled())
+        {
+            m_lastError = QObject::tr("Loading %1 was canceled").arg(stream.filePath);
+            return false;
+        }
+        QByteArray chunk;
+        if (!readVcdChunk(file, compressed.get(), chunk, atEnd, bytesRead))
+        {
+            return false;
+        }
+        if (skip > 0)
+        {
+            const int dropped = static_cast<int>(qMin<qint64>(skip, chunk.size()));
+            chunk.remove(0, dropped);
+            skip -= dropped;
+        }
+        if (buffer.isEmpty())
+        {
+            buffer = chunk;
+        }
+        else
+        {
+            buffer.append(chunk);
+        }
+        const qint64 consumed = parser.parse(buffer.constData(), buffer.constData() + buffer.size(), atEnd);
+        if (consumed < 0)
+        {
+            m_lastError = parser.lastError();
+            return false;
+        }
+        buffer = buffer.mid(static_cast<int>(consumed));
+    }
+    sortUnsortedStores();
+    return true;
+}
+
+bool SimpleFstReader::indexVcdValues(LazyVcdSource &lazy)
+{
+    // Blocks are large enough for parsing them to dominate, and few enough
+    // that the index stays at a few hundred bytes per symbol.
+    constexpr qint64 kMinIndexBlockBytes = 1024 * 1024;
+    constexpr qint64 kMaxIndexBlocks = 2048;
+    const VcdValueSection &section = lazy.section;
+    const qint64 length = section.end - section.begin;
+    const qint64 blockBytes = qMax(kMinIndexBlockBytes, length / kMaxIndexBlocks + 1);
+    lazy.blockOffsets = {0};
+    while (lazy.blockOffsets.last() < length)
+    {
+        const char *previous = section.begin + lazy.blockOffsets.last();
+        const char *next = findTimestampLine(previous, section.begin + qMin(length, lazy.blockOffsets.last() + blockBytes), section.end);
+        lazy.blockOffsets.append(next - section.begin);
+    }
+    const int blockCount = lazy.blockOffsets.size() - 1;
+    lazy.wordsPerSymbol = (blockCount + 63) / 64;
+    lazy.presence.assign(static_cast<size_t>(section.symbolHandles.size()) * static_cast<size_t>(lazy.wordsPerSymbol), 0);
+
+    // Each task owns one word of every symbol's row, the bits of 64
+    // consecutive blocks, so tasks never write to the same word.
+    QAtomicInteger<qint64> bytesDone = section.fileOffset;
+    QAtomicInt canceled = 0;
+    std::vector<QString> errors(static_cast<size_t>(lazy.wordsPerSymbol));
+    parallel::forEach(lazy.wordsPerSymbol, [&](int group) {
+        PresenceScanner scanner(lazy.presence.data() + group, lazy.wordsPerSymbol);
+        for (int block = group * 64; block < qMin(blockCount, group * 64 + 64); ++block)
+        {
+            if (canceled.loadRelaxed() != 0 || isCanceled())
+            {
+                canceled.storeRelaxed(1);
+                return;
+            }
+            scanner.setBit(block % 64);
+            VcdParser parser(scanner, section.symbols);
+            const char *begin = section.begin + lazy.blockOffsets.at(block);
+            const char *end = section.begin + lazy.blockOffsets.at(block + 1);
+            if (parser.parse(begin, end, true) < 0)
+            {
+                errors[static_cast<size_t>(group)] = parser.lastError();
+                return;
+            }
+            reportProgress(bytesDone.fetchAndAddRelaxed(end - begin) + (end - begin), 0);
+        }
+    });
+    if (canceled.loadRelaxed() != 0)
+    {
+        return false;
+    }
+    for (const QString &error : errors)
+    {
+        if (!error.isEmpty())
+        {
+            m_lastError = error;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SimpleFstReader::loadVcdValues(const VcdValueSection &section, const QVector<bool> &wanted,
+                                    const QVector<QPair<qint64, qint64>> &ranges)
+{
+    // Wanted symbols get a dense slot; everything else is skipped while parsing.
+    const int symbolCount = section.symbolHandles.size();
+    QVector<int> slotOf(symbolCount, -1);
+    QVector<ValueStore *> targets;
+    QVector<ValueStore> prototypes;
+    for (int symbol = 0; symbol < symbolCount; ++symbol)
+    {
+        if (!wanted.isEmpty() && !wanted.at(symbol))
+        {
             continue;
         }
+        Signal *signal = m_signals.find(section.symbolHandles.at(symbol));
+        if (signal)
+        {
+            slotOf[symbol] = targets.size();
+            targets.append(&signal->values);
+            prototypes.append(ValueStore(signal->values.kind(), signal->values.width()));
+        }
+    }
+    if (targets.isEmpty())
+    {
+        return true;
+    }
+
+    using Range = QPair<const char *, const char *>;
+    QVector<Range> parts;
+    qint64 length = 0;
+    if (ranges.isEmpty())
+    {
+        parts.append(Range(section.begin, section.end));
+    }
+    for (const QPair<qint64, qint64> &range : ranges)
+    {
+        parts.append(Range(section.begin + range.first, section.begin + range.second));
+    }
+    for (const Range &part : parts)
+    {
+        length += part.second - part.first;
+    }
+
+    // Value changes only depend on the current time, so the section can be
+    // cut right before any timestamp line outside of a $comment block. Each
+    // slice after the first then opens with its own timestamp.
+    // Oversplitting keeps the pool busy when slices turn out uneven, within a
+    // budget for the per-slice stores.
+    constexpr qint64 kMinSliceBytes = 4 * 1024 * 1024;
+    constexpr qint64 kSliceStoreBudget = 256 * 1024 * 1024;
+    const int threads = parallel::threadCount();
+    int sliceTarget = 1;
+    if (threads > 1 && length >= 2 * kMinSliceBytes)
+    {
+        sliceTarget = static_cast<int>(qMin<qint64>(threads * 4, length / kMinSliceBytes));
+        const qint64 storesPerSlice = static_cast<qint64>(targets.size()) * static_cast<qint64>(sizeof(ValueStore));
+        const int affordable = static_cast<int>(qMin<qint64>(sliceTarget, kSliceStoreBudget / storesPerSlice));
+        sliceTarget = qMax(qMin(threads, sliceTarget), affordable);
+    }
+
+    // A slice is a run of ranges in file order, about length / sliceTarget
+    // bytes in all; ranges longer than what a slice still takes are cut.
+    const qint64 sliceBytes = qMax<qint64>(1, length / sliceTarget);
+    QVector<QVector<Range>> sliceRanges(1);
+    qint64 filled = 0;
+    for (const Range &part : parts)
+    {
+        const char *cursor = part.first;
+        while (cursor < part.second)
+        {
+            const char *cut = part.second;
+            if (sliceRanges.size() < sliceTarget && part.second - cursor > sliceBytes - filled)
+            {
+                cut = findTimestampLine(cursor, cursor + (sliceBytes - filled), part.second);
+            }
+            sliceRanges.last().append(Range(cursor, cut));
+            filled += cut - cursor;
+            cursor = cut;
+            if (filled >= sliceBytes && sliceRanges.size() < sliceTarget)
+            {
+                sliceRanges.append(QVector<Range>());
+                filled = 0;
+            }
+        }
+    }
+    if (sliceRanges.last().isEmpty() && sliceRanges.size() > 1)
+    {
+        sliceRanges.removeLast();
+    }
+    const int sliceCount = sliceRanges.size();
+
+    class SliceCollector : public VcdParser::Handler
+    {
+    public:
+        SliceCollector(const QVector<int> &slotOf, const QVector<ValueStore> &prototypes, const LoadOptions &options)
+            : values(prototypes)
+            , m_slotOf(slotOf)
+            , m_options(options)
+        {
+        }
+
+        void beginScope(const QByteArray &, const QByteArray &) override
+        {
+        }
+
+        bool endScope() override
+        {
+            return true;
+        }
+
+        void declareVar(const VcdParser::VarDeclaration &) override
+        {
+        }
+
+        void scalarChange(int symbol, qint64 time, char value) override
+        {
+            const int slot = m_slotOf.at(symbol);
+            if (slot >= 0 && clampToWindow(m_options, time))
+            {
+                ++changeCount;
+                values[slot].appendScalar(time, value);
+            }
+        }
+
+        void vectorChange(int symbol, qint64 time, const char *value, int length) override
+        {
+            const int slot = m_slotOf.at(symbol);
+            if (slot >= 0 && clampToWindow(m_options, time))
+            {
+                ++changeCount;
+                values[slot].append(time, value, length);
+            }
+        }
+
+        QVector<ValueStore> values;
+        qint64 changeCount = 0;
+        qint64 maxTime = 0;
+        QString error;
+
+    private:
+        const QVector<int> &m_slotOf;
+        const LoadOptions &m_options;
+    };
+
+    std::vector<std::unique_ptr<SliceCollector>> slices;
+    slices.reserve(static_cast<size_t>(sliceCount));
+    for (int i = 0; i < sliceCount; ++i)
+    {
+        slices.push_back(std::make_unique<SliceCollector>(slotOf, prototypes, m_options));
+    }
+
+    // Slices are fed to their parser in steps so that progress is reported
+    // and cancellation noticed while a large slice is being parsed.
+    constexpr qint64 kProgressStep = 4 * 1024 * 1024;
+    QAtomicInteger<qint64> bytesDone = section.fileOffset;
+    QAtomicInteger<qint64> changesDone = 0;
+    QAtomicInt canceled = 0;
+    parallel::forEach(sliceCount, [&](int index) {
+        SliceCollector &slice = *slices[static_cast<size_t>(index)];
+        qint64 reportedChanges = 0;
+        for (const Range &range : sliceRanges.at(index))
+        {
+            // Every range opens with a timestamp line, or is the start of the
+            // section, so a fresh parser reads it as the serial one would.
+            VcdParser worker(slice, section.symbols);
+            worker.setSymbolMask(wanted);
+            const char *cursor = range.first;
+            const char *stepEnd = cursor;
+            while (canceled.loadRelaxed() == 0)
+            {
+                stepEnd = range.second - stepEnd > kProgressStep ? stepEnd + kProgressStep : range.second;
+                const bool last = stepEnd == range.second;
+                const qint64 consumed = worker.parse(cursor, stepEnd, last);
+                if (consumed < 0)
+                {
+                    slice.error = worker.lastError();
+                    break;
+                }
+                cursor += consumed;
+                reportProgress(bytesDone.fetchAndAddRelaxed(consumed) + consumed,
+                               changesDone.fetchAndAddRelaxed(slice.changeCount - reportedChanges) + slice.changeCount - reportedChanges);
+                reportedChanges = slice.changeCount;
+                if (last)
+                {
+                    break;
+                }
+                if (isCanceled())
+                {
+                    canceled.storeRelaxed(1);
+                }
+            }
+            slice.maxTime = qMax(slice.maxTime, worker.maxTime());
+            if (!slice.error.isEmpty() || canceled.loadRelaxed() != 0)
+            {
+                break;
+            }
+        }
+    });
+    if (canceled.loadRelaxed() != 0)
+    {
+        return false;
+    }
+
+    // Each slice stops at its own first error, so the first failing slice
+    // holds the error that comes first in the file.
+    for (const auto &slice : slices)
+    {
+        if (!slice->error.isEmpty())
+        {
+            m_lastError = slice->error;
+            return false;
+        }
+    }
+
+    // Every slot maps to its own signal, so signals can be stitched together
+    // concurrently; within a signal the slices are appended in file order.
+    // Once a signal has turned to Text, a serial load stores its values as
+    // written, while a slice that started out packed has normalized them, so
+    // from such a slice on the signal is replayed from the trace instead.
+    const int slotCount = targets.size();
+    const int blocks = qMin(slotCount, threads * 4);
+    std::vector<int> replayFrom(static_cast<size_t>(slotCount), sliceCount);
+    parallel::forEach(blocks, [&](int block) {
+        const int first = static_cast<int>(static_cast<qint64>(slotCount) * block / blocks);
+        const int last = static_cast<int>(static_cast<qint64>(slotCount) * (block + 1) / blocks);
+        for (int slot = first; slot < last; ++slot)
+        {
+            ValueStore &target = *targets.at(slot);
+            for (int index = 0; index < sliceCount; ++index)
+            {
+                const ValueStore &run = slices[static_cast<size_t>(index)]->values.at(slot);
+                if (!run.isEmpty() && target.kind() == ValueStore::Kind::Text && prototypes.at(slot).kind() != ValueStore::Kind::Text)
+                {
+                    replayFrom[static_cast<size_t>(slot)] = index;
+                    break;
+                }
+                target.appendRun(run);
+            }
+            target.sortByTime();
+        }
+    });
+
+    class SliceReplayer : public VcdParser::Handler
+    {
+    public:
+        SliceReplayer(const QVector<int> &slotOf, const QVector<ValueStore *> &targets, const std::vector<int> &replayFrom,
+                      const LoadOptions &options)
+            : m_slotOf(slotOf)
+            , m_targets(targets)
+            , m_replayFrom(replayFrom)
+            , m_options(options)
+        {
+        }
+
+        void beginScope(const QByteArray &, const QByteArray &) override
+        {
+        }
+
+        bool endScope() override
+        {
+            return true;
+        }
+
+        void declareVar(const VcdParser::VarDeclaration &) override
+        {
+        }
+
+        void scalarChange(int symbol, qint64 time, char value) override
+        {
+            const int slot = m_slotOf.at(symbol);
+            if (slot >= 0 && m_replayFrom[static_cast<size_t>(slot)] <= slice && clampToWindow(m_options, time))
+            {
+                m_targets.at(slot)->appendScalar(time, value);
+            }
+        }
+
+        void vectorChange(int symbol, qint64 time, const char *value, int length) override
+        {
+            const int slot = m_slotOf.at(symbol);
+            if (slot >= 0 && m_replayFrom[static_cast<size_t>(slot)] <= slice && clampToWindow(m_options, time))
+            {
+                m_targets.at(slot)->append(time, value, length);
+            }
+        }
+
+        int slice = 0;
+
+    private:
+        const QVector<int> &m_slotOf;
+        const QVector<ValueStore *> &m_targets;
+        const std::vector<int> &m_replayFrom;
+        const LoadOptions &m_options;
+    };
+
+    // Only signals that receive values their kind cannot hold get here, so
+    // the replay runs on this thread.
+    const int firstReplay = slotCount > 0 ? *std::min_element(replayFrom.begin(), replayFrom.end()) : sliceCount;
+    if (firstReplay < sliceCount)
+    {
+        SliceReplayer replayer(slotOf, targets, replayFrom, m_options);
+        for (int index = firstReplay; index < sliceCount; ++index)
+        {
+            if (isCanceled())
+            {
+                return false;
+            }
+            replayer.slice = index;
+            for (const Range &range : sliceRanges.at(index))
+            {
+                VcdParser worker(replayer, section.symbols);
+                if (worker.parse(range.first, range.second, true) < 0)
+                {
+                    m_lastError = worker.lastError();
+                    return false;
+                }
+            }
+        }
+        for (int slot = 0; slot < slotCount; ++slot)
+        {
+            if (replayFrom[static_cast<size_t>(slot)] < sliceCount)
+            {
+                targets.at(slot)->sortByTime();
+            }
+        }
+    }
+
+    for (const auto &slice : slices)
+    {
+        m_timeEnd = qMax(m_timeEnd, slice->maxTime);
+    }
+    m_statistics.threadCount = qMax(m_statistics.threadCount, qMin(threads, sliceCount));
+    return true;
+}
+
+bool SimpleFstReader::readAppended()
+{
+    if (!m_follow)
+    {
+        m_lastError = QObject::tr("No trace is being followed");
+        return false;
+    }
+
+    VcdFollowState &follow = *m_follow;
+    const QString fileName = follow.file.fileName();
+    const qint64 size = follow.file.size();
+    if (size < follow.readOffset)
+    {
+        m_lastError = QObject::tr("%1 was truncated").arg(fileName);
+        m_follow.reset();
+        return false;
+    }
+    if (size == follow.readOffset)
+    {
+        return true;
+    }
+    if (!follow.file.seek(follow.readOffset))
+    {
+        m_lastError = QObject::tr("Unable to read %1").arg(fileName);
+        m_follow.reset();
+        return false;
+    }
+
+    constexpr qint64 kChunkSize = 4 * 1024 * 1024;
+    bool ok = true;
+    releaseAliasValues();
+    while (ok && follow.readOffset < size)
+    {
+        const QByteArray chunk = follow.file.read(qMin(kChunkSize, size - follow.readOffset));
+        if (chunk.isEmpty())
+        {
+            m_lastError = QObject::tr("Unable to read %1").arg(fileName);
+            ok = false;
+            break;
+        }
+        follow.readOffset += chunk.size();
+        follow.pending.append(chunk);
+        const qint64 consumed = follow.parser.parse(follow.pending.constData(), follow.pending.constData() + follow.pending.size(), false);
+        if (consumed < 0)
+        {
+            m_lastError = follow.parser.lastError();
+            ok = false;
+            break;
+        }
+        follow.pending.remove(0, static_cast<int>(consumed));
+    }
+    if (!ok)
+    {
+        shareAliasValues();
+        m_follow.reset();
+        return false;
+    }
+
+    m_timeEnd = qMax(m_timeEnd, qMin(follow.parser.maxTime(), m_options.windowEnd));
+    for (int handle : follow.unsortedHandles)
+    {
+        m_signals.find(handle)->values.sortByTime();
+    }
+    follow.unsortedHandles.clear();
+    shareAliasValues();
 
-        if (line.startsWith(QLatin1String("$dumpvars")))
+    // Signals that are still unloaded are decoded from the mapped section,
+    // which now has to reach as far as the follow parser got.
+    if (m_lazyVcd)
+    {
+        LazyVcdSource &lazy = *m_lazyVcd;
+        const qint64 sectionOffset = lazy.section.begin - reinterpret_cast<const char *>(lazy.mapping);
+        const qint64 parsedEnd = follow.readOffset - follow.pending.size();
+        uchar *mapping = lazy.file.map(0, parsedEnd);
+        if (!mapping)
         {
-            inDumpvars = true;
-            continue;
+            m_lastError = QObject::tr("Unable to map %1").arg(fileName);
+            return false;
         }
-        if (line.startsWith(QLatin1String("$end")))
+        lazy.file.unmap(lazy.mapping);
+        lazy.mapping = mapping;
+        lazy.section.begin = reinterpret_cast<const char *>(mapping) + sectionOffset;
+        lazy.section.end = reinterpret_cast<const char *>(mapping) + parsedEnd;
+    }
+    return true;
+}
+
+bool SimpleFstReader::isFollowing() const
+{
+    return m_follow != nullptr;
+}
+
+bool SimpleFstReader::ensureLoaded(const QVector<int> &handles)
+{
+    QVector<int> pending;
+    for (int handle : handles)
+    {
+        const Signal *signal = m_signals.find(handle);
+        if (signal && signal->aliasOf > 0)
         {
-            inDumpvars = false;
-            continue;
+            signal = m_signals.find(signal->aliasOf);
         }
-        if (line.startsWith(QLatin1Char('$')))
+        if (signal && !signal->valuesLoaded && !pending.contains(signal->handle))
         {
-            // Ignore other runtime commands
-            continue;
+            pending.append(signal->handle);
         }
+    }
+    if (pending.isEmpty())
+    {
+        return touch(handles);
+    }
 
-        QString value;
-        QString symbol;
-        if (line.startsWith(QLatin1Char('b')) || line.startsWith(QLatin1Char('B')) || line.startsWith(QLatin1Char('r')) || line.startsWith(QLatin1Char('R')))
+    // As in a full load, aliases drop their copies while values are
+    // appended, so the stores being decoded are never shared and detached.
+    releaseAliasValues();
+    bool ok = true;
+    if (m_lazyVcd)
+    {
+        const LazyVcdSource &lazy = *m_lazyVcd;
+        QVector<bool> wanted(lazy.section.symbolHandles.size(), false);
+        QVector<int> wantedSymbols;
+        for (int handle : pending)
         {
-            const int spaceIdx = line.indexOf(QLatin1Char(' '));
-            if (spaceIdx <= 1)
+            const int symbol = lazy.symbolOfHandle.value(handle, -1);
+            if (symbol >= 0 && !wanted.at(symbol))
             {
-                m_lastError = QObject::tr("Malformed vector change in VCD");
-                return false;
+                wanted[symbol] = true;
+                wantedSymbols.append(symbol);
             }
-            value = line.mid(1, spaceIdx - 1);
-            symbol = line.mid(spaceIdx + 1);
         }
-        else
+
+        // Only the blocks in which a wanted symbol changes are parsed, plus
+        // whatever a followed file gained after the pre-scan.
+        QVector<QPair<qint64, qint64>> ranges;
+        const auto addRange = [&ranges](qint64 begin, qint64 end) {
+            if (!ranges.isEmpty() && ranges.last().second == begin)
+            {
+                ranges.last().second = end;
+            }
+            else
+            {
+                ranges.append(qMakePair(begin, end));
+            }
+        };
+        const int blockCount = lazy.blockOffsets.size() - 1;
+        for (int block = 0; block < blockCount; ++block)
         {
-            if (line.size() < 2)
+            const quint64 bit = quint64(1) << (block % 64);
+            for (int symbol : wantedSymbols)
             {
-                continue;
+                if (lazy.presence[static_cast<size_t>(symbol) * static_cast<size_t>(lazy.wordsPerSymbol) + static_cast<size_t>(block / 64)] & bit)
+                {
+                    addRange(lazy.blockOffsets.at(block), lazy.blockOffsets.at(block + 1));
+                    break;
+                }
             }
-            value = normalizeScalarValue(line.left(1));
-            symbol = line.mid(1);
         }
-
-        if (symbol.isEmpty())
+        const qint64 indexedEnd = lazy.blockOffsets.isEmpty() ? 0 : lazy.blockOffsets.last();
+        const qint64 sectionLength = lazy.section.end - lazy.section.begin;
+        if (sectionLength > indexedEnd)
         {
-            continue;
+            addRange(indexedEnd, sectionLength);
+        }
+        // A symbol that never changes leaves nothing to parse.
+        ok = ranges.isEmpty() || loadVcdValues(lazy.section, wanted, ranges);
+    }
+    else if (m_lazyStream)
+    {
+        QVector<bool> wanted(m_lazyStream->symbolHandles.size(), false);
+        for (int handle : pending)
+        {
+            const int symbol = m_lazyStream->symbolOfHandle.value(handle, -1);
+            if (symbol >= 0)
+            {
+                wanted[symbol] = true;
+            }
         }
+        ok = loadStreamedValues(*m_lazyStream, wanted);
+    }
+    else if (m_lazyFst)
+    {
+        class Sink : public FstBinaryReader::Visitor
+        {
+        public:
+            Sink(SimpleFstReader &reader, const QVector<QVector<int>> &targets)
+                : m_reader(reader)
+                , m_targets(targets)
+            {
+            }
+
+            void beginScope(int, const QByteArray &) override
+            {
+            }
+
+            void endScope() override
+            {
+            }
+
+            void declareVar(const FstBinaryReader::VarDeclaration &) override
+            {
+            }
+
+            void valueChange(quint32 handle, quint64 time, const char *value, int length) override
+            {
+                for (int target : m_targets.at(static_cast<int>(handle)))
+                {
+                    m_reader.appendSignalValue(target, static_cast<qint64>(time), value, length);
+                }
+            }
 
-        const int handle = symbolToHandle.value(symbol, -1);
-        if (handle < 0)
+        private:
+            SimpleFstReader &m_reader;
+            const QVector<QVector<int>> &m_targets;
+        };
+
+        const int fstHandleCount = static_cast<int>(m_lazyFst->reader.header().maxHandle);
+        QVector<bool> selected(fstHandleCount, false);
+        QVector<QVector<int>> targets(fstHandleCount + 1);
+        for (int handle : pending)
         {
-            if (!inDumpvars)
+            const int fstHandle = static_cast<int>(m_lazyFst->fstHandleOf.value(handle, 0));
+            if (fstHandle > 0 && fstHandle <= fstHandleCount)
             {
-                m_lastError = QObject::tr("Unknown symbol '%1' in VCD").arg(symbol);
-                return false;
+                selected[fstHandle - 1] = true;
+                targets[fstHandle].append(handle);
             }
+        }
+
+        Sink sink(*this, targets);
+        ok = m_lazyFst->reader.readValueChanges(sink, selected, fstTime(m_options.windowStart), fstTime(m_options.windowEnd));
+        if (!ok)
+        {
+            m_lastError = m_lazyFst->reader.lastError();
+        }
+    }
+
+    for (int handle : pending)
+    {
+        Signal &signal = *m_signals.find(handle);
+        if (ok)
+        {
+            finishValues(signal.values);
+            signal.valuesLoaded = true;
+        }
+        else
+        {
+            // Leave the signal unloaded and empty so a later call can retry.
+            signal.values = ValueStore(signal.values.kind(), signal.values.width());
+        }
+    }
+    shareAliasValues();
+    return touch(handles) && ok;
+}
+
+void SimpleFstReader::finishValues(ValueStore &values)
+{
+    // A followed trace keeps appending to its stores, and stores under a
+    // memory budget have to be freed one at a time when they are spilled;
+    // both keep their columns in containers of their own.
+    if (m_options.follow || m_options.memoryBudget > 0)
+    {
+        values.squeeze();
+        return;
+    }
+    if (!m_arena)
+    {
+        m_arena = std::make_shared<LoadArena>();
+    }
+    values.moveTo(m_arena);
+}
+
+bool SimpleFstReader::touch(const QVector<int> &handles)
+{
+    const quint64 now = ++m_useClock;
+    if (m_lastUse.size() <= m_signals.maxHandle())
+    {
+        m_lastUse.resize(m_signals.maxHandle() + 1);
+    }
+    for (int handle : handles)
+    {
+        Signal *signal = m_signals.find(handle);
+        if (signal && signal->aliasOf > 0)
+        {
+            signal = m_signals.find(signal->aliasOf);
+        }
+        if (!signal)
+        {
             continue;
         }
+        m_lastUse[signal->handle] = now;
+        if (m_options.memoryBudget > 0)
+        {
+            signal->values.makeResident();
+        }
+    }
+    return enforceMemoryBudget();
+}
 
-        appendSignalValue(handle, currentTime, value);
+qint64 SimpleFstReader::residentValueBytes() const
+{
+    qint64 bytes = 0;
+    for (const Signal &signal : m_signals)
+    {
+        if (signal.aliasOf <= 0)
+        {
+            bytes += signal.values.residentColumnBytes();
+        }
     }
+    return bytes;
+}
 
-    if (!ensureScopeFinalized())
+bool SimpleFstReader::enforceMemoryBudget()
+{
+    if (m_options.memoryBudget <= 0)
     {
-        return false;
+        return true;
+    }
+    qint64 resident = residentValueBytes();
+    if (resident <= m_options.memoryBudget)
+    {
+        return true;
     }
 
-    for (auto it = m_signals.begin(); it != m_signals.end(); ++it)
+    // Signals touched by the latest call stay, even if they alone exceed
+    // the budget; spilling what is on screen would only thrash.
+    QVector<Signal *> candidates;
+    for (Signal &signal : m_signals)
+    {
+        if (signal.aliasOf <= 0 && signal.values.residentColumnBytes() > 0 && m_lastUse.value(signal.handle) < m_useClock)
+        {
+            candidates.append(&signal);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [this](const Signal *a, const Signal *b) { return m_lastUse.value(a->handle) < m_lastUse.value(b->handle); });
+    QVector<ValueStore *> victims;
+    for (Signal *signal : candidates)
+    {
+        if (resident <= m_options.memoryBudget)
+        {
+            break;
+        }
+        resident -= signal->values.residentColumnBytes();
+        victims.append(&signal->values);
+    }
+    if (victims.isEmpty())
     {
-        auto &values = it.value().values;
-        std::sort(values.begin(), values.end(), [](const SignalValue &a, const SignalValue &b) {
-            return a.time < b.time;
-        });
+        return true;
     }
 
-    return true;
+    if (!m_spill)
+    {
+        m_spill = std::make_unique<SpillFile>(m_options.cacheDirectory);
+    }
+    // Aliases let go of their shared copies, or the columns would stay
+    // allocated through them.
+    releaseAliasValues();
+    const bool ok = m_spill->spill(victims);
+    shareAliasValues();
+    if (!ok)
+    {
+        m_lastError = m_spill->errorString();
+    }
+    return ok;
 }
 
 bool SimpleFstReader::loadFromFstBinary(const QString &filePath)
 {
-    QTemporaryFile tempFile(QDir::tempPath() + QLatin1String("/gtkwave_viewer_XXXXXX.vcd"));
-    tempFile.setAutoRemove(false);
-    if (!tempFile.open())
+    auto source = std::make_unique<LazyFstSource>();
+    FstBinaryReader &fstReader = source->reader;
+    if (!fstReader.open(filePath))
     {
-        m_lastError = QObject::tr("Failed to create temporary file for FST conversion");
+        m_lastError = fstReader.lastError();
         return false;
     }
-    const QString vcdPath = tempFile.fileName();
-    tempFile.close();
 
-    QProcess process;
-    QString program = QStringLiteral("fst2vcd");
-    process.start(program, {filePath, vcdPath});
-    if (!process.waitForStarted())
+    // Maps FST handles (which may be shared by aliased variables) to the
+    // sequential handles this reader hands out per declaration.
+    class Builder : public FstBinaryReader::Visitor
+    {
+    public:
+        explicit Builder(SimpleFstReader &reader)
+            : m_reader(reader)
+        {
+        }
+
+        void beginScope(int scopeType, const QByteArray &name) override
+        {
+            m_scopeStack.append(
+                m_reader.m_scopes.addScope(m_scopeStack.last(), QString::fromUtf8(name), FstBinaryReader::scopeTypeName(scopeType)));
+        }
+
+        void endScope() override
+        {
+            if (m_scopeStack.size() > 1)
+            {
+                m_scopeStack.removeLast();
+            }
+        }
+
+        void declareVar(const FstBinaryReader::VarDeclaration &var) override
+        {
+            Signal signal;
+            signal.handle = m_nextHandle++;
+            signal.name = m_reader.m_scopes.intern(var.name);
+            signal.type = typeName(var.type);
+            signal.direction = FstBinaryReader::directionName(var.direction);
+            signal.bitWidth = FstBinaryReader::isRealType(var.type) ? 64 : qMax<int>(1, static_cast<int>(var.length));
+            signal.isEnum = signal.type == QLatin1String("enum");
+            signal.scope = m_scopeStack.last();
+            signal.values = ValueStore(ValueStore::kindFor(signal.type, signal.bitWidth, signal.isEnum), signal.bitWidth);
+
+            if (m_handles.size() <= static_cast<int>(var.handle))
+            {
+                m_handles.resize(static_cast<int>(var.handle) + 1);
+            }
+            QVector<int> &targets = m_handles[static_cast<int>(var.handle)];
+            if (targets.isEmpty())
+            {
+                targets.append(signal.handle);
+            }
+            else
+            {
+                signal.aliasOf = targets.first();
+            }
+
+            m_reader.m_scopes.addSignal(signal.scope, signal.handle);
+            m_reader.m_signals.insert(signal);
+
+            if (m_fstHandleOf.size() <= signal.handle)
+            {
+                m_fstHandleOf.resize(signal.handle + 1);
+            }
+            m_fstHandleOf[signal.handle] = var.handle;
+        }
+
+        void valueChange(quint32 handle, quint64 time, const char *value, int length) override
+        {
+            if (static_cast<int>(handle) >= m_handles.size())
+            {
+                return;
+            }
+            const QVector<int> &targets = m_handles.at(static_cast<int>(handle));
+            if (targets.isEmpty())
+            {
+                return;
+            }
+
+            ++m_changeCount;
+            for (int target : targets)
+            {
+                m_reader.appendSignalValue(target, static_cast<qint64>(time), value, length);
+            }
+        }
+
+        bool valueBlockDone(qint64 fileOffset) override
+        {
+            m_reader.reportProgress(fileOffset, m_changeCount);
+            return !m_reader.isCanceled();
+        }
+
+        const QVector<quint32> &fstHandleOf() const
+        {
+            return m_fstHandleOf;
+        }
+
+    private:
+        QString typeName(int varType)
+        {
+            if (varType < 0)
+            {
+                return m_reader.m_scopes.intern(FstBinaryReader::varTypeName(varType));
+            }
+            if (m_typeNames.size() <= varType)
+            {
+                m_typeNames.resize(varType + 1);
+            }
+            QString &name = m_typeNames[varType];
+            if (name.isNull())
+            {
+                name = m_reader.m_scopes.intern(FstBinaryReader::varTypeName(varType));
+            }
+            return name;
+        }
+
+        SimpleFstReader &m_reader;
+        QVector<int> m_scopeStack = {ScopeTable::kRoot};
+        QVector<QVector<int>> m_handles;
+        QVector<QString> m_typeNames; // interned, by FST variable type
+        QVector<quint32> m_fstHandleOf;
+        qint64 m_changeCount = 0;
+        int m_nextHandle = 1;
+    };
+
+    Builder builder(*this);
+    if (!fstReader.readHierarchy(builder))
     {
-        QFile::remove(vcdPath);
-        m_lastError = QObject::tr("Unable to start fst2vcd. Ensure GTKWave tools are installed and available in PATH.");
+        m_lastError = fstReader.lastError();
         return false;
     }
-    process.waitForFinished(-1);
+    publishHierarchy();
+
+    const qint64 endTime = static_cast<qint64>(fstReader.header().endTime);
+    if (endTime > m_timeEnd)
+    {
+        m_timeEnd = endTime;
+    }
 
-    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+    if (m_options.lazy)
     {
-        QFile::remove(vcdPath);
-        m_lastError = QObject::tr("fst2vcd failed: %1").arg(QString::fromLocal8Bit(process.readAllStandardError()).trimmed());
-        if (m_lastError.trimmed().isEmpty())
+        // The reader keeps the file mapped; streams are decompressed for the
+        // selected handles only when ensureLoaded() asks for them.
+        source->fstHandleOf = builder.fstHandleOf();
+        for (Signal &signal : m_signals)
         {
-            m_lastError = QObject::tr("fst2vcd failed to convert the file");
+            signal.valuesLoaded = false;
         }
-        return false;
+        m_lazyFst = std::move(source);
+        return true;
     }
 
-    QFile vcdFile(vcdPath);
-    if (!vcdFile.open(QIODevice::ReadOnly))
+    if (!fstReader.readValueChanges(builder, QVector<bool>(), fstTime(m_options.windowStart), fstTime(m_options.windowEnd)))
     {
-        QFile::remove(vcdPath);
-        m_lastError = QObject::tr("Unable to read converted VCD data");
+        m_lastError = fstReader.lastError();
         return false;
     }
 
-    const bool ok = loadFromVcd(vcdFile);
-    vcdFile.close();
-    QFile::remove(vcdPath);
-    return ok;
+    // FST value blocks are emitted per signal in time order, so unlike the
+    // text loaders no final sort is needed.
+    return true;
 }
 
-bool SimpleFstReader::finalizeHierarchy(QVector<Scope> &scopeStack)
+void SimpleFstReader::sortUnsortedStores()
 {
-    while (scopeStack.size() > 1)
+    QVector<ValueStore *> unsorted;
+    for (Signal &signal : m_signals)
     {
-        Scope completed = scopeStack.takeLast();
-        scopeStack.last().children.append(completed);
+        if (!signal.values.isSorted())
+        {
+            unsorted.append(&signal.values);
+        }
     }
+    parallel::forEach(unsorted.size(), [&unsorted](int index) { unsorted.at(index)->sortByTime(); });
+}
 
-    if (scopeStack.isEmpty())
+QVector<int> SimpleFstReader::matchSignals(const SignalFilter &filter) const
+{
+    // Signals of a scope share its path, so each scope path is built once.
+    QVector<int> handles;
+    QVector<QString> scopePaths(m_scopes.size());
+    QVector<bool> scopePathBuilt(m_scopes.size(), false);
+    for (const Signal &signal : m_signals)
     {
-        return false;
+        QString path = signal.name;
+        if (signal.scope > ScopeTable::kRoot && signal.scope < m_scopes.size())
+        {
+            if (!scopePathBuilt.at(signal.scope))
+            {
+                scopePaths[signal.scope] = m_scopes.path(signal.scope);
+                scopePathBuilt[signal.scope] = true;
+            }
+            path = scopePaths.at(signal.scope) + QLatin1Char('.') + signal.name;
+        }
+        if (filter.matches(path))
+        {
+            handles.append(signal.handle);
+        }
     }
+    return handles;
+}
 
-    m_rootScope = scopeStack.takeLast();
-    return true;
+bool SimpleFstReader::loadSelectedSignals(const SignalFilter &filter)
+{
+    m_selected = matchSignals(filter);
+    return ensureLoaded(m_selected);
 }
 
-void SimpleFstReader::appendSignalValue(int handle, qint64 time, const QString &value)
+void SimpleFstReader::publishHierarchy()
 {
-    auto it = m_signals.find(handle);
-    if (it == m_signals.end())
+    if (m_options.observer && !m_hierarchyPublished)
     {
-        return;
+        m_hierarchyPublished = true;
+        m_options.observer->hierarchyReady(m_scopes, m_signals);
     }
+}
 
-    QVector<SignalValue> &values = it->values;
-    if (!values.isEmpty())
+void SimpleFstReader::reportProgress(qint64 bytesRead, qint64 transitionCount) const
+{
+    if (m_options.observer)
     {
-        SignalValue &last = values.last();
-        if (last.time == time)
-        {
-            last.value = value;
-        }
-        else if (last.value == value)
+        LoadProgress progress;
+        progress.bytesRead = bytesRead;
+        progress.totalBytes = m_statistics.bytes;
+        progress.signalCount = m_signals.size();
+        progress.transitionCount = transitionCount;
+        m_options.observer->progress(progress);
+    }
+}
+
+bool SimpleFstReader::isCanceled() const
+{
+    return m_options.observer && m_options.observer->isCanceled();
+}
+
+void SimpleFstReader::releaseAliasValues()
+{
+    for (Signal &signal : m_signals)
+    {
+        if (signal.aliasOf > 0)
         {
-            return;
+            signal.values = ValueStore(signal.values.kind(), signal.values.width());
         }
-        else
+    }
+}
+
+void SimpleFstReader::shareAliasValues()
+{
+    for (Signal &signal : m_signals)
+    {
+        const Signal *original = signal.aliasOf > 0 ? m_signals.find(signal.aliasOf) : nullptr;
+        if (original)
         {
-            values.append({time, value});
+            signal.values = original->values;
+            signal.valuesLoaded = original->valuesLoaded;
         }
     }
-    else
+}
+
+void SimpleFstReader::appendSignalValue(int handle, qint64 time, const char *value, int length)
+{
+    Signal *signal = m_signals.find(handle);
+    if (!signal || !clampToWindow(m_options, time))
+    {
+        return;
+    }
+
+    signal->values.append(time, value, length);
+
+    if (time > m_timeEnd)
     {
-        values.append({time, value});
+        m_timeEnd = time;
+    }
+}
+
+void SimpleFstReader::appendScalarValue(int handle, qint64 time, char value)
+{
+    Signal *signal = m_signals.find(handle);
+    if (!signal || !clampToWindow(m_options, time))
+    {
+        return;
     }
 
+    signal->values.appendScalar(time, value);
+
     if (time > m_timeEnd)
     {
         m_timeEnd = time;
@@ -606,10 +2145,21 @@ void SimpleFstReader::appendSignalValue(int handle, qint64 time, const QString &
 
 void SimpleFstReader::clear()
 {
-    m_rootScope = Scope();
+    m_scopes.clear();
     m_signals.clear();
     m_lastError.clear();
     m_timeEnd = 0;
+    m_statistics = LoadStatistics();
+    m_lazyVcd.reset();
+    m_lazyFst.reset();
+    m_lazyStream.reset();
+    m_follow.reset();
+    m_selected.clear();
+    m_lastUse.clear();
+    m_useClock = 0;
+    m_spill.reset();
+    m_arena.reset();
+    m_hierarchyPublished = false;
 }
 
 } // namespace fst
@@ -0,0 +1,236 @@
+#include "spill_file.h"
+
+#include "value_store.h"
+
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QObject>
+#include <QTemporaryFile>
+
+#include <map>
+
+namespace fst
+{
+// The file and its free regions. Batches are unmapped by whichever thread
+// drops the last store pointing into them, so all file access is locked.
+struct SpillFile::Space
+{
+    // Frees [offset, offset + length), merging it with free neighbours.
+    // Free space reaching the end of the file is cut off instead.
+    void release(qint64 offset, qint64 length)
+    {
+        auto next = free.find(offset + length);
+        if (next != free.end())
+        {
+            length += next->second;
+            free.erase(next);
+        }
+        auto previous = free.lower_bound(offset);
+        if (previous != free.begin() && (--previous)->first + previous->second == offset)
+        {
+            offset = previous->first;
+            length += previous->second;
+            free.erase(previous);
+        }
+        if (offset + length == size)
+        {
+            size = offset;
+            file->resize(size);
+            return;
+        }
+        free.emplace(offset, length);
+    }
+
+    // Takes `length` bytes from the first free region large enough, or from
+    // the end of the file.
+    qint64 allocate(qint64 length)
+    {
+        for (auto it = free.begin(); it != free.end(); ++it)
+        {
+            if (it->second >= length)
+            {
+                const qint64 offset = it->first;
+                if (it->second > length)
+                {
+                    free.emplace(offset + length, it->second - length);
+                }
+                free.erase(it);
+                return offset;
+            }
+        }
+        const qint64 offset = size;
+        size += length;
+        return offset;
+    }
+
+    std::shared_ptr<QTemporaryFile> file;
+    QMutex mutex;
+    std::map<qint64, qint64> free; // length by offset
+    qint64 size = 0;
+};
+
+// Unmaps one spilled batch once no store points into it any more, and gives
+// its bytes back to the file.
+class SpillFile::Mapping
+{
+public:
+    Mapping(std::shared_ptr<Space> space, uchar *data, qint64 offset, qint64 length)
+        : m_space(std::move(space))
+        , m_data(data)
+        , m_offset(offset)
+        , m_length(length)
+    {
+    }
+
+    ~Mapping()
+    {
+        QMutexLocker locker(&m_space->mutex);
+        m_space->file->unmap(m_data);
+        m_space->release(m_offset, m_length);
+    }
+
+    Mapping(const Mapping &) = delete;
+    Mapping &operator=(const Mapping &) = delete;
+
+private:
+    std::shared_ptr<Space> m_space;
+    uchar *m_data;
+    const qint64 m_offset;
+    const qint64 m_length;
+};
+
+namespace
+{
+// Columns start on 8-byte boundaries, like those of the trace cache.
+qint64 aligned(qint64 offset)
+{
+    return (offset + 7) & ~qint64(7);
+}
+} // namespace
+
+SpillFile::SpillFile(const QString &directory)
+    : m_directory(directory.isEmpty() ? QDir::tempPath() : directory)
+{
+}
+
+SpillFile::~SpillFile() = default;
+
+bool SpillFile::spill(const QVector<ValueStore *> &stores)
+{
+    if (!m_space)
+    {
+        QDir().mkpath(m_directory);
+        auto file = std::make_shared<QTemporaryFile>(QDir(m_directory).filePath(QStringLiteral("gtkwave-spill-XXXXXX")));
+        if (!file->open())
+        {
+            m_errorString = QObject::tr("Unable to create a spill file in %1").arg(m_directory);
+            return false;
+        }
+        m_space = std::make_shared<Space>();
+        m_space->file = std::move(file);
+    }
+
+    // Offsets relative to the start of this batch, four per store: the
+    // checkpoints and the three byte columns.
+    QVector<qint64> offsets;
+    offsets.reserve(stores.size() * 4);
+    qint64 length = 0;
+    const auto place = [&](qint64 size) {
+        length = aligned(length);
+        offsets.append(length);
+        length += size;
+    };
+    for (const ValueStore *store : stores)
+    {
+        place(qint64(store->checkpointCount()) * qint64(sizeof(ValueStore::Checkpoint)));
+        place(store->timesSize());
+        place(store->valuesSize());
+        place(store->offsetsSize());
+    }
+    if (length == 0)
+    {
+        return true;
+    }
+    length = aligned(length);
+
+    QMutexLocker locker(&m_space->mutex);
+    QTemporaryFile &file = *m_space->file;
+    const qint64 start = m_space->allocate(length);
+    bool ok = file.seek(start);
+    qint64 position = 0;
+    const auto put = [&](int index, const char *data, qint64 size) {
+        const qint64 padding = offsets.at(index) - position;
+        if (ok && padding > 0)
+        {
+            ok = file.write(QByteArray(static_cast<int>(padding), '\0')) == padding;
+        }
+        if (ok && size > 0)
+        {
+            ok = file.write(data, size) == size;
+        }
+        position = offsets.at(index) + size;
+    };
+    for (int i = 0; i < stores.size(); ++i)
+    {
+        const ValueStore *store = stores.at(i);
+        put(i * 4, reinterpret_cast<const char *>(store->checkpointData()),
+            qint64(store->checkpointCount()) * qint64(sizeof(ValueStore::Checkpoint)));
+        put(i * 4 + 1, store->timesData(), store->timesSize());
+        put(i * 4 + 2, store->valuesData(), store->valuesSize());
+        put(i * 4 + 3, store->offsetsData(), store->offsetsSize());
+    }
+    if (ok && position < length)
+    {
+        ok = file.write(QByteArray(static_cast<int>(length - position), '\0')) == length - position;
+    }
+    if (!ok || !file.flush())
+    {
+        m_space->release(start, length);
+        m_errorString = QObject::tr("Unable to write the spill file %1").arg(file.fileName());
+        return false;
+    }
+
+    uchar *data = file.map(start, length);
+    if (!data)
+    {
+        m_space->release(start, length);
+        m_errorString = QObject::tr("Unable to map the spill file %1").arg(file.fileName());
+        return false;
+    }
+    locker.unlock();
+    const auto mapping = std::make_shared<Mapping>(m_space, data, start, length);
+
+    for (int i = 0; i < stores.size(); ++i)
+    {
+        ValueStore &store = *stores.at(i);
+        const char *base = reinterpret_cast<const char *>(data);
+        ValueStore::BorrowedColumns columns;
+        columns.checkpoints = reinterpret_cast<const ValueStore::Checkpoint *>(base + offsets.at(i * 4));
+        columns.checkpointCount = store.checkpointCount();
+        columns.times = base + offsets.at(i * 4 + 1);
+        columns.timesSize = store.timesSize();
+        columns.values = base + offsets.at(i * 4 + 2);
+        columns.valuesSize = store.valuesSize();
+        columns.offsets = base + offsets.at(i * 4 + 3);
+        columns.offsetsSize = store.offsetsSize();
+        store.borrow(columns, mapping);
+    }
+    return true;
+}
+
+qint64 SpillFile::size() const
+{
+    if (!m_space)
+    {
+        return 0;
+    }
+    QMutexLocker locker(&m_space->mutex);
+    return m_space->size;
+}
+
+QString SpillFile::errorString() const
+{
+    return m_errorString;
+}
+} // namespace fst
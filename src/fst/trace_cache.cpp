@@ -0,0 +1,590 @@
+#include "trace_cache.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+namespace fst
+{
+namespace
+{
+constexpr char kMagic[8] = {'N', 'W', 'T', 'R', 'A', 'C', 'E', '\0'};
+constexpr quint32 kVersion = 3;
+constexpr quint32 kByteOrderMark = 0x01020304;
+constexpr qint64 kDigestSpan = 1024 * 1024;
+constexpr int kDigestLength = 20; // SHA-1
+
+// All records are fixed-size, naturally aligned and written in native byte
+// order; the byte-order mark rejects caches written on another architecture.
+struct Section
+{
+    qint64 offset = 0;
+    qint64 count = 0;
+};
+
+struct Header
+{
+    char magic[8];
+    quint32 version = 0;
+    quint32 byteOrderMark = 0;
+    qint64 sourceSize = 0;
+    qint64 sourceModified = 0; // ms since the epoch
+    char sourceDigest[kDigestLength];
+    quint32 reserved = 0;
+    qint64 timeEnd = 0;
+    Section strings;      // StringRecord
+    Section text;         // UTF-8 bytes of all strings
+    Section scopes;       // ScopeRecord, in ScopeTable order, root first
+    Section signalTable;  // SignalRecord
+};
+
+struct StringRecord
+{
+    quint32 offset = 0;
+    quint32 length = 0;
+};
+
+// Parents precede their children, and children of a scope are in file
+// order, so appending the scopes one by one rebuilds the table.
+struct ScopeRecord
+{
+    quint32 name = 0;
+    quint32 type = 0;
+    qint32 parent = -1;
+    quint32 reserved = 0;
+};
+
+// A byte range of the file holding one ValueStore column.
+struct Column
+{
+    qint64 offset = 0;
+    qint64 size = 0;
+};
+
+struct SignalRecord
+{
+    qint64 lastTime = 0;
+    Column times;
+    Column values;
+    Column offsets;
+    Column checkpoints; // CheckpointRecord
+    qint32 handle = 0;
+    qint32 aliasOf = 0; // signal whose columns these are, or 0
+    quint32 name = 0;
+    qint32 scope = 0;
+    quint32 type = 0;
+    quint32 direction = 0;
+    qint32 bitWidth = 0;
+    qint32 width = 0;
+    qint32 size = 0;
+    qint32 lastTimeOffset = 0;
+    quint8 isEnum = 0;
+    quint8 kind = 0;
+    quint8 sorted = 0;
+    quint8 reserved = 0;
+    qint32 reserved2 = 0;
+};
+
+struct CheckpointRecord
+{
+    qint64 time = 0;
+    qint32 offset = 0;
+    qint32 reserved = 0;
+};
+
+static_assert(std::is_trivially_copyable<Header>::value, "cache records are written as raw bytes");
+static_assert(sizeof(SignalRecord) % 8 == 0 && sizeof(CheckpointRecord) == 16, "cache records must keep 8-byte alignment");
+
+qint64 align8(qint64 value)
+{
+    return (value + 7) & ~qint64(7);
+}
+
+// Identifies a trace without reading all of it: size and modification time
+// catch ordinary rewrites, the hash of both ends catches in-place edits that
+// preserve them. An edit of the middle alone that keeps both is missed; a
+// hash of the whole value section would catch it at the price of reading
+// the whole trace on every open, which is what the cache avoids.
+bool sourceDigest(const QString &tracePath, QByteArray &digest)
+{
+    QFile file(tracePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(file.read(kDigestSpan));
+    if (file.size() > kDigestSpan)
+    {
+        if (!file.seek(std::max(kDigestSpan, file.size() - kDigestSpan)))
+        {
+            return false;
+        }
+        hash.addData(file.read(kDigestSpan));
+    }
+    digest = hash.result();
+    return digest.size() == kDigestLength;
+}
+
+bool writeBytes(QIODevice &device, const void *data, qint64 size)
+{
+    return size == 0 || device.write(static_cast<const char *>(data), size) == size;
+}
+
+bool writePadding(QIODevice &device, qint64 &position)
+{
+    static const char zeros[8] = {};
+    const qint64 padding = align8(position) - position;
+    position += padding;
+    return writeBytes(device, zeros, padding);
+}
+
+class StringTable
+{
+public:
+    quint32 add(const QString &value)
+    {
+        const auto it = m_ids.constFind(value);
+        if (it != m_ids.constEnd())
+        {
+            return it.value();
+        }
+        const QByteArray utf8 = value.toUtf8();
+        const quint32 id = static_cast<quint32>(m_records.size());
+        m_records.append(StringRecord{static_cast<quint32>(m_text.size()), static_cast<quint32>(utf8.size())});
+        m_text.append(utf8);
+        m_ids.insert(value, id);
+        return id;
+    }
+
+    const QVector<StringRecord> &records() const { return m_records; }
+    const QByteArray &text() const { return m_text; }
+
+private:
+    QHash<QString, quint32> m_ids;
+    QVector<StringRecord> m_records;
+    QByteArray m_text;
+};
+
+QVector<ScopeRecord> scopeRecords(const ScopeTable &scopeTable, StringTable &strings)
+{
+    QVector<ScopeRecord> records(scopeTable.size());
+    for (int scope = 0; scope < scopeTable.size(); ++scope)
+    {
+        ScopeRecord &record = records[scope];
+        record.name = strings.add(scopeTable.name(scope));
+        record.type = strings.add(scopeTable.type(scope));
+        record.parent = scopeTable.parent(scope);
+    }
+    return records;
+}
+
+// Bounds-checked view of the mapped cache file.
+class MappedCache
+{
+public:
+    MappedCache(const uchar *data, qint64 size) : m_data(data), m_size(size) {}
+
+    bool contains(qint64 offset, qint64 size) const { return offset >= 0 && size >= 0 && offset <= m_size && size <= m_size - offset; }
+
+    template <typename T> const T *records(const Section &section) const
+    {
+        if (section.count < 0 || section.count > m_size / qint64(sizeof(T)) || section.offset % 8 != 0 ||
+            !contains(section.offset, section.count * qint64(sizeof(T))))
+        {
+            return nullptr;
+        }
+        return reinterpret_cast<const T *>(m_data + section.offset);
+    }
+
+    const char *column(const Column &column, int &size, bool &ok) const
+    {
+        if (!contains(column.offset, column.size) || column.size > std::numeric_limits<int>::max())
+        {
+            ok = false;
+            size = 0;
+            return nullptr;
+        }
+        size = static_cast<int>(column.size);
+        return reinterpret_cast<const char *>(m_data + column.offset);
+    }
+
+private:
+    const uchar *m_data;
+    qint64 m_size;
+};
+
+// Rebuilds the scope table, rejecting records whose parent does not come
+// before them.
+bool readScopes(const QVector<QString> &strings, const ScopeRecord *records, qint64 count, ScopeTable &scopeTable)
+{
+    if (count < 1 || records[0].parent != -1)
+    {
+        return false;
+    }
+    for (qint64 i = 1; i < count; ++i)
+    {
+        const ScopeRecord &record = records[i];
+        if (record.parent < 0 || record.parent >= i || record.name >= static_cast<quint32>(strings.size()) ||
+            record.type >= static_cast<quint32>(strings.size()))
+        {
+            return false;
+        }
+        scopeTable.addScope(record.parent, strings.at(static_cast<int>(record.name)), strings.at(static_cast<int>(record.type)));
+    }
+    return true;
+}
+
+bool stringAt(const QVector<QString> &strings, quint32 id, QString &value)
+{
+    if (id >= static_cast<quint32>(strings.size()))
+    {
+        return false;
+    }
+    value = strings.at(static_cast<int>(id));
+    return true;
+}
+
+// Checks the shape of a store read back from the cache so that a damaged
+// file is rejected instead of being dereferenced out of bounds later.
+bool plausibleStore(ValueStore::Kind kind, int width, int size, qint64 valueBytes, qint64 offsetBytes, qint64 checkpointCount)
+{
+    if (size < 0 || width < 1 || checkpointCount != (size + ValueStore::kCheckpointInterval - 1) / ValueStore::kCheckpointInterval)
+    {
+        return false;
+    }
+    switch (kind)
+    {
+    case ValueStore::Kind::Scalar:
+        return valueBytes == (qint64(size) + 3) / 4 && offsetBytes == 0;
+    case ValueStore::Kind::Vector:
+        return valueBytes == qint64(size) * ((width + 7) / 8) * 2 && offsetBytes == 0;
+    case ValueStore::Kind::Real:
+        return valueBytes == qint64(size) * qint64(sizeof(double)) && offsetBytes == 0;
+    case ValueStore::Kind::Text:
+        return offsetBytes == qint64(size) * qint64(sizeof(quint32));
+    }
+    return false;
+}
+} // namespace
+
+QString TraceCache::cachePath(const QString &tracePath, const QString &directory)
+{
+    QString root = directory;
+    if (root.isEmpty())
+    {
+        root = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/traces");
+    }
+    const QByteArray key = QCryptographicHash::hash(QFileInfo(tracePath).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(root).filePath(QString::fromLatin1(key) + QStringLiteral(".nwcache"));
+}
+
+bool TraceCache::write(const QString &tracePath, const QString &cachePath, const ScopeTable &scopeTable, const SignalTable &signalTable,
+                       qint64 timeEnd, QString *error)
+{
+    const auto fail = [error](const QString &message) {
+        if (error)
+        {
+            *error = message;
+        }
+        return false;
+    };
+
+    const QFileInfo source(tracePath);
+    QByteArray digest;
+    if (!sourceDigest(tracePath, digest))
+    {
+        return fail(QObject::tr("Unable to read %1").arg(tracePath));
+    }
+
+    StringTable strings;
+    const QVector<ScopeRecord> scopes = scopeRecords(scopeTable, strings);
+
+    QVector<SignalRecord> signalRecords;
+    signalRecords.reserve(signalTable.size());
+    for (const Signal &signal : signalTable)
+    {
+        if (!signal.valuesLoaded)
+        {
+            return fail(QObject::tr("Signal %1 is not loaded").arg(scopeTable.signalPath(signal)));
+        }
+        SignalRecord record;
+        record.handle = signal.handle;
+        record.aliasOf = qMax(0, signal.aliasOf);
+        record.name = strings.add(signal.name);
+        record.scope = signal.scope;
+        record.type = strings.add(signal.type);
+        record.direction = strings.add(signal.direction);
+        record.bitWidth = signal.bitWidth;
+        record.isEnum = signal.isEnum ? 1 : 0;
+        const ValueStore &values = signal.values;
+        record.kind = static_cast<quint8>(values.m_kind);
+        record.sorted = values.m_sorted ? 1 : 0;
+        record.width = values.m_width;
+        record.size = values.m_size;
+        record.lastTime = values.m_lastTime;
+        record.lastTimeOffset = values.m_lastTimeOffset;
+        signalRecords.append(record);
+    }
+
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byteOrderMark = kByteOrderMark;
+    header.sourceSize = source.size();
+    header.sourceModified = source.lastModified().toMSecsSinceEpoch();
+    std::memcpy(header.sourceDigest, digest.constData(), kDigestLength);
+    header.timeEnd = timeEnd;
+
+    // Lay out every section and column before writing anything.
+    qint64 position = align8(sizeof(Header));
+    const auto place = [&position](Section &section, qint64 count, qint64 recordSize) {
+        section.offset = position;
+        section.count = count;
+        position = align8(position + count * recordSize);
+    };
+    place(header.strings, strings.records().size(), sizeof(StringRecord));
+    place(header.text, strings.text().size(), 1);
+    place(header.scopes, scopes.size(), sizeof(ScopeRecord));
+    place(header.signalTable, signalRecords.size(), sizeof(SignalRecord));
+
+    const auto placeColumn = [&position](Column &column, qint64 size) {
+        column.offset = position;
+        column.size = size;
+        position = align8(position + size);
+    };
+    // Aliases point at the columns of the signal they alias, which always
+    // has the lower handle and so comes first.
+    QVector<int> recordOfHandle(signalTable.maxHandle() + 1, -1);
+    int index = 0;
+    for (const Signal &signal : signalTable)
+    {
+        recordOfHandle[signal.handle] = index;
+        SignalRecord &record = signalRecords[index++];
+        const int original = record.aliasOf > 0 ? recordOfHandle.value(record.aliasOf, -1) : -1;
+        if (original >= 0)
+        {
+            const SignalRecord &originalRecord = signalRecords.at(original);
+            record.times = originalRecord.times;
+            record.values = originalRecord.values;
+            record.offsets = originalRecord.offsets;
+            record.checkpoints = originalRecord.checkpoints;
+            continue;
+        }
+        record.aliasOf = 0;
+        placeColumn(record.times, signal.values.timesSize());
+        placeColumn(record.values, signal.values.valuesSize());
+        placeColumn(record.offsets, signal.values.offsetsSize());
+        placeColumn(record.checkpoints, qint64(signal.values.checkpointCount()) * qint64(sizeof(CheckpointRecord)));
+    }
+
+    if (!QDir().mkpath(QFileInfo(cachePath).absolutePath()))
+    {
+        return fail(QObject::tr("Unable to create the cache directory for %1").arg(cachePath));
+    }
+    QSaveFile file(cachePath);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return fail(QObject::tr("Unable to write %1").arg(cachePath));
+    }
+
+    position = 0;
+    const auto put = [&file, &position](const void *data, qint64 size) {
+        position += size;
+        return writeBytes(file, data, size) && writePadding(file, position);
+    };
+    bool ok = put(&header, sizeof(Header)) &&
+              put(strings.records().constData(), qint64(strings.records().size()) * qint64(sizeof(StringRecord))) &&
+              put(strings.text().constData(), strings.text().size()) &&
+              put(scopes.constData(), qint64(scopes.size()) * qint64(sizeof(ScopeRecord))) &&
+              put(signalRecords.constData(), qint64(signalRecords.size()) * qint64(sizeof(SignalRecord)));
+    index = 0;
+    for (auto it = signalTable.begin(); ok && it != signalTable.end(); ++it)
+    {
+        if (signalRecords.at(index++).aliasOf > 0)
+        {
+            continue;
+        }
+        const ValueStore &values = it->values;
+        ok = put(values.timesData(), values.timesSize()) && put(values.valuesData(), values.valuesSize()) &&
+             put(values.offsetsData(), values.offsetsSize());
+        const ValueStore::Checkpoint *checkpoints = values.checkpointData();
+        for (int c = 0; ok && c < values.checkpointCount(); ++c)
+        {
+            CheckpointRecord record;
+            record.time = checkpoints[c].time;
+            record.offset = checkpoints[c].offset;
+            ok = writeBytes(file, &record, sizeof(record));
+        }
+        position += qint64(values.checkpointCount()) * qint64(sizeof(CheckpointRecord));
+    }
+
+    if (!ok || !file.commit())
+    {
+        file.cancelWriting();
+        return fail(QObject::tr("Unable to write %1").arg(cachePath));
+    }
+    return true;
+}
+
+bool TraceCache::read(const QString &tracePath, const QString &cachePath, ScopeTable &scopeTable, SignalTable &signalTable, qint64 &timeEnd)
+{
+    // Checkpoint records are read in place as ValueStore checkpoints.
+    static_assert(sizeof(CheckpointRecord) == sizeof(ValueStore::Checkpoint) && offsetof(CheckpointRecord, time) == offsetof(ValueStore::Checkpoint, time) &&
+                      offsetof(CheckpointRecord, offset) == offsetof(ValueStore::Checkpoint, offset),
+                  "CheckpointRecord must match ValueStore::Checkpoint");
+
+    auto file = std::make_shared<QFile>(cachePath);
+    if (!file->open(QIODevice::ReadOnly) || file->size() < qint64(sizeof(Header)))
+    {
+        return false;
+    }
+    const uchar *data = file->map(0, file->size());
+    if (!data)
+    {
+        return false;
+    }
+    const MappedCache cache(data, file->size());
+
+    Header header;
+    std::memcpy(&header, data, sizeof(Header));
+    const QFileInfo source(tracePath);
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion || header.byteOrderMark != kByteOrderMark ||
+        header.sourceSize != source.size() || header.sourceModified != source.lastModified().toMSecsSinceEpoch())
+    {
+        return false;
+    }
+    QByteArray digest;
+    if (!sourceDigest(tracePath, digest) || std::memcmp(header.sourceDigest, digest.constData(), kDigestLength) != 0)
+    {
+        return false;
+    }
+
+    const StringRecord *stringRecords = cache.records<StringRecord>(header.strings);
+    const char *text = cache.records<char>(header.text);
+    const ScopeRecord *scopes = cache.records<ScopeRecord>(header.scopes);
+    const SignalRecord *signalRecords = cache.records<SignalRecord>(header.signalTable);
+    if (!stringRecords || !text || !scopes || !signalRecords || header.scopes.count == 0)
+    {
+        return false;
+    }
+
+    QVector<QString> strings;
+    strings.reserve(static_cast<int>(header.strings.count));
+    for (qint64 i = 0; i < header.strings.count; ++i)
+    {
+        const StringRecord &record = stringRecords[i];
+        if (qint64(record.offset) + record.length > header.text.count)
+        {
+            return false;
+        }
+        strings.append(QString::fromUtf8(text + record.offset, static_cast<int>(record.length)));
+    }
+
+    ScopeTable scopesRead;
+    if (!readScopes(strings, scopes, header.scopes.count, scopesRead))
+    {
+        return false;
+    }
+
+    // Every store keeps the mapping alive for as long as it points into it.
+    const std::shared_ptr<const void> backing = file;
+    SignalTable signalsRead;
+    signalsRead.reserve(static_cast<int>(header.signalTable.count));
+    for (qint64 i = 0; i < header.signalTable.count; ++i)
+    {
+        const SignalRecord &record = signalRecords[i];
+        // Records are in increasing handle order, which also keeps the signal
+        // chains of the scope table in declaration order.
+        if (record.handle <= signalsRead.maxHandle() || record.handle > header.signalTable.count)
+        {
+            return false;
+        }
+        const Signal *original = record.aliasOf > 0 ? signalsRead.find(record.aliasOf) : nullptr;
+        if (record.aliasOf != 0 && (!original || original->aliasOf > 0))
+        {
+            return false;
+        }
+        Signal signal;
+        signal.handle = record.handle;
+        signal.aliasOf = record.aliasOf > 0 ? record.aliasOf : -1;
+        signal.bitWidth = record.bitWidth;
+        signal.isEnum = record.isEnum != 0;
+        signal.scope = record.scope;
+        if (!stringAt(strings, record.name, signal.name) || record.scope < 0 || record.scope >= scopesRead.size() ||
+            !stringAt(strings, record.type, signal.type) || !stringAt(strings, record.direction, signal.direction) ||
+            record.kind > static_cast<quint8>(ValueStore::Kind::Text) || record.checkpoints.size % qint64(sizeof(CheckpointRecord)) != 0)
+        {
+            return false;
+        }
+
+        const ValueStore::Kind kind = static_cast<ValueStore::Kind>(record.kind);
+        const qint64 checkpointCount = record.checkpoints.size / qint64(sizeof(CheckpointRecord));
+        if (!plausibleStore(kind, record.width, record.size, record.values.size, record.offsets.size, checkpointCount) ||
+            record.lastTimeOffset < 0 || (record.size > 0 && record.lastTimeOffset >= record.times.size) ||
+            !cache.contains(record.checkpoints.offset, record.checkpoints.size))
+        {
+            return false;
+        }
+
+        ValueStore &values = signal.values;
+        bool ok = true;
+        values.m_kind = kind;
+        values.m_width = record.width;
+        values.m_size = record.size;
+        values.m_sorted = record.sorted != 0;
+        values.m_lastTime = record.lastTime;
+        values.m_lastTimeOffset = record.lastTimeOffset;
+        // The store borrows its columns and checkpoints from the mapping, so
+        // opening a cached trace allocates nothing per signal.
+        ValueStore::BorrowedColumns columns;
+        columns.times = cache.column(record.times, columns.timesSize, ok);
+        columns.values = cache.column(record.values, columns.valuesSize, ok);
+        columns.offsets = cache.column(record.offsets, columns.offsetsSize, ok);
+        const Section checkpointSection = {record.checkpoints.offset, checkpointCount};
+        columns.checkpoints = reinterpret_cast<const ValueStore::Checkpoint *>(cache.records<CheckpointRecord>(checkpointSection));
+        columns.checkpointCount = static_cast<int>(checkpointCount);
+        if (!ok || (checkpointCount > 0 && !columns.checkpoints))
+        {
+            return false;
+        }
+        if (kind == ValueStore::Kind::Text && record.size > 0)
+        {
+            quint32 textEnd = 0;
+            std::memcpy(&textEnd, columns.offsets + columns.offsetsSize - sizeof(quint32), sizeof(textEnd));
+            if (textEnd != static_cast<quint32>(columns.valuesSize))
+            {
+                return false;
+            }
+        }
+        for (int c = 0; c < columns.checkpointCount; ++c)
+        {
+            if (columns.checkpoints[c].offset < 0 || columns.checkpoints[c].offset > record.times.size)
+            {
+                return false;
+            }
+        }
+        values.borrow(columns, backing);
+        scopesRead.addSignal(signal.scope, signal.handle);
+        signalsRead.insert(signal);
+    }
+
+    scopeTable = scopesRead;
+    signalTable = signalsRead;
+    timeEnd = header.timeEnd;
+    return true;
+}
+} // namespace fst
@@ -0,0 +1,851 @@
+#include "trace_writer.h"
+
+#include "fst_binary_reader.h"
+#include "fst_compression.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QObject>
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include <zlib.h>
+
+namespace fst
+{
+namespace
+{
+// Output is collected in memory and handed to the file in pieces this large.
+constexpr int kFlushSize = 4 * 1024 * 1024;
+constexpr int kProgressInterval = 1 << 16;
+// Changes per FST value-change block; bounds the memory an export needs.
+constexpr qint64 kBlockChanges = 4 * 1024 * 1024;
+// Streams shorter than this are stored as they are.
+constexpr int kMinCompressSize = 32;
+
+// FST block types and hierarchy tags, as in FstBinaryReader.
+constexpr char kBlockHeader = 0;
+constexpr char kBlockValueChanges = 1;
+constexpr char kBlockGeometry = 3;
+constexpr char kBlockHierarchy = 4;
+constexpr uchar kTagScope = 254;
+constexpr uchar kTagUpscope = 255;
+constexpr qint64 kHeaderSectionLength = 329;
+constexpr int kVersionLength = 128;
+constexpr int kDateLength = 119;
+constexpr int kVarTypeReal = 3;
+constexpr int kVarTypeString = 21;
+constexpr quint32 kVariableLength = 0xFFFFFFFFu;
+constexpr double kEndianTestValue = 2.7182818284590452354;
+
+void appendNumber(QByteArray &out, qint64 value)
+{
+    char text[24];
+    const auto result = std::to_chars(text, text + sizeof(text), value);
+    out.append(text, static_cast<int>(result.ptr - text));
+}
+
+void appendVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80)
+    {
+        out.append(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+void appendBigEndian64(QByteArray &out, quint64 value)
+{
+    for (int shift = 56; shift >= 0; shift -= 8)
+    {
+        out.append(static_cast<char>((value >> shift) & 0xff));
+    }
+}
+
+void appendFixedString(QByteArray &out, const QByteArray &text, int length)
+{
+    const QByteArray truncated = text.left(length);
+    out.append(truncated);
+    out.append(QByteArray(length - truncated.size(), '\0'));
+}
+
+// VCD identifier codes in the base-94 order writers hand them out.
+QByteArray vcdIdentifier(int index)
+{
+    QByteArray identifier;
+    do
+    {
+        identifier.append(static_cast<char>('!' + index % 94));
+        index /= 94;
+    } while (index > 0);
+    return identifier;
+}
+
+// Index of `name` in the table behind one of FstBinaryReader's name
+// functions, or `fallback`.
+int fstCode(const QString &name, QString (*nameOf)(int), int fallback)
+{
+    for (int code = 0; code < 64; ++code)
+    {
+        if (nameOf(code) == name)
+        {
+            return code;
+        }
+    }
+    return fallback;
+}
+
+// Stores `data` behind its uncompressed length when compression pays off,
+// and behind a zero otherwise, the way FST value streams are framed.
+void appendStream(QByteArray &out, const QByteArray &data, QByteArray &scratch)
+{
+    if (data.size() >= kMinCompressSize && deflateZlib(data.constData(), data.size(), scratch, Z_BEST_SPEED) && scratch.size() < data.size())
+    {
+        appendVarint(out, static_cast<quint64>(data.size()));
+        out.append(scratch);
+        return;
+    }
+    appendVarint(out, 0);
+    out.append(data);
+}
+
+// How an FST channel is stored: one character per bit, a native double
+// (geometry 0) or a string of any length (kVariableLength, no frame slot).
+struct Layout
+{
+    quint32 geometry = 1;
+    int frameOffset = 0;
+    int frameBytes = 0;
+};
+
+// Compresses `data` when that pays off. FST sections that hold the same
+// length twice are stored as they are.
+QByteArray compressedSection(const QByteArray &data)
+{
+    QByteArray compressed;
+    if (deflateZlib(data.constData(), data.size(), compressed, Z_BEST_SPEED) && compressed.size() < data.size())
+    {
+        return compressed;
+    }
+    return data;
+}
+} // namespace
+
+// Walks the changes of every channel after the window start in time order,
+// merging the per-signal columns through a heap keyed by the next time.
+class TraceWriter::Changes
+{
+public:
+    explicit Changes(const QVector<Channel> &channels)
+        : m_channels(channels)
+    {
+        m_iterators.reserve(static_cast<size_t>(channels.size()));
+        for (int i = 0; i < channels.size(); ++i)
+        {
+            const Channel &channel = channels.at(i);
+            m_iterators.push_back(channel.values.at(channel.first + 1));
+            if (channel.first + 1 <= channel.last)
+            {
+                m_queue.push({m_iterators.back().time(), i});
+            }
+        }
+    }
+
+    // Moves to the next change and returns its channel, or -1 at the end.
+    int next()
+    {
+        if (m_current >= 0)
+        {
+            ValueStore::Iterator &it = m_iterators[static_cast<size_t>(m_current)];
+            ++it;
+            if (it.index() <= m_channels.at(m_current).last)
+            {
+                m_queue.push({it.time(), m_current});
+            }
+        }
+        if (m_queue.empty())
+        {
+            m_current = -1;
+            return -1;
+        }
+        m_current = m_queue.top().second;
+        m_queue.pop();
+        return m_current;
+    }
+
+    const ValueStore::Iterator &value() const { return m_iterators[static_cast<size_t>(m_current)]; }
+
+private:
+    using Position = std::pair<qint64, int>; // time, then channel for a stable order
+
+    const QVector<Channel> &m_channels;
+    std::vector<ValueStore::Iterator> m_iterators;
+    std::priority_queue<Position, std::vector<Position>, std::greater<Position>> m_queue;
+    int m_current = -1;
+};
+
+TraceWriter::Format TraceWriter::formatFor(const QString &filePath)
+{
+    return filePath.endsWith(QLatin1String(".fst"), Qt::CaseInsensitive) ? Format::Fst : Format::Vcd;
+}
+
+TraceWriter::TraceWriter(const ScopeTable &scopeTable, const SignalTable &signalTable, const QVector<int> &handles)
+    : m_scopes(scopeTable)
+{
+    for (int handle : handles)
+    {
+        const Signal *signal = signalTable.find(handle);
+        if (!signal)
+        {
+            continue;
+        }
+        Entry entry;
+        entry.signal = *signal;
+        for (int scope = signal->scope; scope > ScopeTable::kRoot; scope = scopeTable.parent(scope))
+        {
+            entry.scopeChain.prepend(scope);
+        }
+        m_entries.append(entry);
+    }
+
+    // Sorting by scope chain keeps every subtree together, so the scopes can
+    // be opened and closed once each; signals of a scope keep their order.
+    std::stable_sort(m_entries.begin(), m_entries.end(),
+                     [](const Entry &left, const Entry &right) { return left.scopeChain < right.scopeChain; });
+    assignChannels();
+}
+
+void TraceWriter::assignChannels()
+{
+    QHash<int, int> selected; // handle -> entry
+    for (int i = 0; i < m_entries.size(); ++i)
+    {
+        selected.insert(m_entries.at(i).signal.handle, i);
+    }
+
+    QHash<int, int> channelOf; // handle whose store a channel holds -> channel
+    for (Entry &entry : m_entries)
+    {
+        const int aliasOf = entry.signal.aliasOf;
+        const int source = aliasOf > 0 && selected.contains(aliasOf) ? aliasOf : entry.signal.handle;
+        const auto it = channelOf.constFind(source);
+        if (it != channelOf.constEnd())
+        {
+            entry.channel = it.value();
+            continue;
+        }
+        entry.channel = m_channels.size();
+        channelOf.insert(source, entry.channel);
+        Channel channel;
+        channel.values = entry.signal.values;
+        m_channels.append(channel);
+    }
+}
+
+void TraceWriter::setWindow(qint64 start, qint64 end)
+{
+    m_windowStart = qMax<qint64>(0, start);
+    m_windowEnd = qMax(m_windowStart, end);
+}
+
+void TraceWriter::setProgress(Progress progress)
+{
+    m_progress = std::move(progress);
+}
+
+bool TraceWriter::write(const QString &filePath, Format format)
+{
+    m_errorString.clear();
+    m_transitionCount = 0;
+    m_total = 0;
+    for (Channel &channel : m_channels)
+    {
+        channel.first = channel.values.indexAt(m_windowStart);
+        channel.last = channel.values.indexAt(m_windowEnd);
+        m_total += channel.last - channel.first;
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        return fail(QObject::tr("Unable to write %1: %2").arg(filePath, file.errorString()));
+    }
+    const bool ok = format == Format::Fst ? writeFst(file) : writeVcd(file);
+    file.close();
+    if (!ok)
+    {
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+bool TraceWriter::writeVcd(QFile &file)
+{
+    QByteArray out;
+    out.reserve(kFlushSize + 4096);
+    const auto flush = [&]() {
+        if (file.write(out) != out.size())
+        {
+            return fail(QObject::tr("Unable to write %1: %2").arg(file.fileName(), file.errorString()));
+        }
+        out.clear();
+        return true;
+    };
+
+    out += "$date\n\t" + QDateTime::currentDateTime().toString(Qt::ISODate).toLatin1() + "\n$end\n";
+    out += "$version\n\tgtkwave_cpp_clone export\n$end\n";
+    if (m_windowStart > 0 || m_windowEnd != std::numeric_limits<qint64>::max())
+    {
+        out += "$comment\n\tchanges from " + QByteArray::number(m_windowStart) + " to " +
+               QByteArray::number(m_windowEnd) + " in the time units of the source trace\n$end\n";
+    }
+
+    QVector<QByteArray> identifiers(m_channels.size());
+    for (int i = 0; i < m_channels.size(); ++i)
+    {
+        identifiers[i] = vcdIdentifier(i);
+    }
+
+    QVector<int> openScopes;
+    const auto moveTo = [&](const QVector<int> &chain) {
+        int common = 0;
+        while (common < openScopes.size() && common < chain.size() && openScopes.at(common) == chain.at(common))
+        {
+            ++common;
+        }
+        for (int i = openScopes.size(); i > common; --i)
+        {
+            out += "$upscope $end\n";
+        }
+        for (int i = common; i < chain.size(); ++i)
+        {
+            // VCD only knows a few scope kinds; the others become modules.
+            static const QStringList vcdTypes = {QStringLiteral("module"), QStringLiteral("task"), QStringLiteral("function"),
+                                                 QStringLiteral("begin"), QStringLiteral("fork")};
+            const QString &type = m_scopes.type(chain.at(i));
+            out += "$scope " + (vcdTypes.contains(type) ? type.toLatin1() : QByteArray("module")) + ' ' + m_scopes.name(chain.at(i)).toUtf8() +
+                   " $end\n";
+        }
+        openScopes = chain;
+    };
+
+    for (const Entry &entry : m_entries)
+    {
+        moveTo(entry.scopeChain);
+        const ValueStore &values = entry.signal.values;
+        QByteArray type = entry.signal.type.toLatin1();
+        int width = values.width();
+        if (values.kind() == ValueStore::Kind::Real)
+        {
+            type = "real";
+            width = 64;
+        }
+        else if (values.kind() == ValueStore::Kind::Text)
+        {
+            type = "string";
+            width = 1;
+        }
+        out += "$var " + type + ' ';
+        appendNumber(out, width);
+        out += ' ' + identifiers.at(entry.channel) + ' ' + entry.signal.name.toUtf8() + " $end\n";
+    }
+    moveTo(QVector<int>());
+    out += "$enddefinitions $end\n";
+
+    QByteArray bits;
+    char real[32];
+    const auto appendValue = [&](int channel, const ValueStore::Iterator *value) {
+        const ValueStore &values = m_channels.at(channel).values;
+        switch (values.kind())
+        {
+        case ValueStore::Kind::Scalar:
+            out += value ? value->scalar() : 'x';
+            out += identifiers.at(channel);
+            out += '\n';
+            return;
+        case ValueStore::Kind::Vector:
+        {
+            bits.resize(values.width());
+            if (value)
+            {
+                value->bits(bits.data());
+            }
+            else
+            {
+                bits.fill('x');
+            }
+            // Leading zeros may go as long as what is left does not start
+            // with x or z, which would be extended instead of zeros.
+            int start = 0;
+            while (start + 1 < bits.size() && bits.at(start) == '0' && bits.at(start + 1) != 'x' && bits.at(start + 1) != 'z')
+            {
+                ++start;
+            }
+            out += 'b';
+            out.append(bits.constData() + start, bits.size() - start);
+            break;
+        }
+        case ValueStore::Kind::Real:
+        {
+            if (!value)
+            {
+                return;
+            }
+            const int length = std::snprintf(real, sizeof(real), "%.16g", value->real());
+            out += 'r';
+            out.append(real, qBound(0, length, static_cast<int>(sizeof(real)) - 1));
+            break;
+        }
+        case ValueStore::Kind::Text:
+            if (!value)
+            {
+                return;
+            }
+            out += 's';
+            out += value->text().toUtf8();
+            break;
+        }
+        out += ' ';
+        out += identifiers.at(channel);
+        out += '\n';
+    };
+
+    out += '#';
+    appendNumber(out, m_windowStart);
+    out += "\n$dumpvars\n";
+    for (int i = 0; i < m_channels.size(); ++i)
+    {
+        const Channel &channel = m_channels.at(i);
+        if (channel.first >= 0)
+        {
+            const ValueStore::Iterator value = channel.values.at(channel.first);
+            appendValue(i, &value);
+        }
+        else
+        {
+            appendValue(i, nullptr);
+        }
+    }
+    out += "$end\n";
+
+    Changes changes(m_channels);
+    qint64 time = m_windowStart;
+    for (int channel = changes.next(); channel >= 0; channel = changes.next())
+    {
+        const ValueStore::Iterator &value = changes.value();
+        if (value.time() != time)
+        {
+            time = value.time();
+            out += '#';
+            appendNumber(out, time);
+            out += '\n';
+        }
+        appendValue(channel, &value);
+        ++m_transitionCount;
+        if (out.size() >= kFlushSize && !flush())
+        {
+            return false;
+        }
+        if ((m_transitionCount % kProgressInterval) == 0 && !reportProgress(m_transitionCount))
+        {
+            return false;
+        }
+    }
+    return flush() && reportProgress(m_transitionCount);
+}
+
+bool TraceWriter::writeFst(QFile &file)
+{
+    const auto put = [&](const QByteArray &data) {
+        if (file.write(data) != data.size())
+        {
+            return fail(QObject::tr("Unable to write %1: %2").arg(file.fileName(), file.errorString()));
+        }
+        return true;
+    };
+
+    QVector<Layout> layouts(m_channels.size());
+    int frameSize = 0;
+    for (int i = 0; i < m_channels.size(); ++i)
+    {
+        const ValueStore &values = m_channels.at(i).values;
+        Layout &layout = layouts[i];
+        switch (values.kind())
+        {
+        case ValueStore::Kind::Scalar:
+        case ValueStore::Kind::Vector:
+            layout.geometry = static_cast<quint32>(values.width());
+            layout.frameBytes = values.width();
+            break;
+        case ValueStore::Kind::Real:
+            layout.geometry = 0;
+            layout.frameBytes = sizeof(double);
+            break;
+        case ValueStore::Kind::Text:
+            layout.geometry = kVariableLength;
+            break;
+        }
+        layout.frameOffset = frameSize;
+        frameSize += layout.frameBytes;
+    }
+
+    // Values at the start of the block being collected; starts out with
+    // each channel's value at the window start.
+    QByteArray frame(frameSize, 'x');
+    const double unknown = std::numeric_limits<double>::quiet_NaN();
+    for (int i = 0; i < m_channels.size(); ++i)
+    {
+        const Channel &channel = m_channels.at(i);
+        const Layout &layout = layouts.at(i);
+        if (channel.values.kind() == ValueStore::Kind::Real)
+        {
+            const double value = channel.first >= 0 ? channel.values.at(channel.first).real() : unknown;
+            std::memcpy(frame.data() + layout.frameOffset, &value, sizeof(value));
+        }
+        else if (layout.frameBytes > 0 && channel.first >= 0)
+        {
+            channel.values.at(channel.first).bits(frame.data() + layout.frameOffset);
+        }
+    }
+
+    // The header is written again at the end, once its counts are known.
+    const auto header = [&](quint64 endTime, quint64 scopeCount, quint64 blockCount) {
+        QByteArray block;
+        block.append(kBlockHeader);
+        appendBigEndian64(block, kHeaderSectionLength);
+        appendBigEndian64(block, static_cast<quint64>(m_windowStart));
+        appendBigEndian64(block, endTime);
+        block.append(reinterpret_cast<const char *>(&kEndianTestValue), sizeof(kEndianTestValue));
+        appendBigEndian64(block, 0); // writer memory use
+        appendBigEndian64(block, scopeCount);
+        appendBigEndian64(block, static_cast<quint64>(m_entries.size()));
+        appendBigEndian64(block, static_cast<quint64>(m_channels.size()));
+        appendBigEndian64(block, blockCount);
+        // The source timescale is not kept by the reader; times are written
+        // in its units and labelled as nanoseconds.
+        block.append(static_cast<char>(-9));
+        appendFixedString(block, "gtkwave_cpp_clone export", kVersionLength);
+        appendFixedString(block, QDateTime::currentDateTime().toString(Qt::ISODate).toLatin1(), kDateLength);
+        block.append('\0'); // file type: Verilog
+        appendBigEndian64(block, 0); // time zero
+        return block;
+    };
+    if (!put(header(static_cast<quint64>(m_windowStart), 0, 0)))
+    {
+        return false;
+    }
+
+    // State of the value-change block being collected.
+    QVector<QByteArray> streams(m_channels.size());
+    QVector<int> lastTimeIndex(m_channels.size(), 0);
+    QByteArray blockFrame = frame;
+    QByteArray timeTable;
+    qint64 timeCount = 0;
+    qint64 blockBegin = m_windowStart;
+    qint64 lastTime = 0;
+    qint64 blockChanges = 0;
+    quint64 blockCount = 0;
+    QByteArray scratch;
+
+    const auto flushBlock = [&](qint64 blockEnd) {
+        QByteArray block;
+        block.append(kBlockValueChanges);
+        appendBigEndian64(block, 0); // section length, filled in below
+        appendBigEndian64(block, static_cast<quint64>(blockBegin));
+        appendBigEndian64(block, static_cast<quint64>(blockEnd));
+        appendBigEndian64(block, static_cast<quint64>(frameSize)); // memory a reader needs
+
+        const QByteArray frameData = compressedSection(blockFrame);
+        appendVarint(block, static_cast<quint64>(blockFrame.size()));
+        appendVarint(block, static_cast<quint64>(frameData.size()));
+        appendVarint(block, static_cast<quint64>(m_channels.size()));
+        block.append(frameData);
+
+        appendVarint(block, static_cast<quint64>(m_channels.size()));
+        const int valueStart = block.size();
+        block.append('Z');
+        // Chain table: the offset of each channel's data from valueStart as
+        // a delta to the previous one, and runs of channels without data.
+        QByteArray chain;
+        qint64 previousOffset = 0;
+        int skipped = 0;
+        for (int i = 0; i < streams.size(); ++i)
+        {
+            if (streams.at(i).isEmpty())
+            {
+                ++skipped;
+                continue;
+            }
+            if (skipped > 0)
+            {
+                appendVarint(chain, static_cast<quint64>(skipped) << 1);
+                skipped = 0;
+            }
+            const qint64 offset = block.size() - valueStart;
+            appendVarint(chain, (static_cast<quint64>(offset - previousOffset) << 1) | 1);
+            previousOffset = offset;
+            appendStream(block, streams.at(i), scratch);
+        }
+        if (skipped > 0)
+        {
+            appendVarint(chain, static_cast<quint64>(skipped) << 1);
+        }
+        block.append(chain);
+        appendBigEndian64(block, static_cast<quint64>(chain.size()));
+
+        const QByteArray timeData = compressedSection(timeTable);
+        block.append(timeData);
+        appendBigEndian64(block, static_cast<quint64>(timeTable.size()));
+        appendBigEndian64(block, static_cast<quint64>(timeData.size()));
+        appendBigEndian64(block, static_cast<quint64>(timeCount));
+
+        const quint64 sectionLength = static_cast<quint64>(block.size() - 1);
+        for (int i = 0; i < 8; ++i)
+        {
+            block[1 + i] = static_cast<char>((sectionLength >> (56 - 8 * i)) & 0xff);
+        }
+        ++blockCount;
+        return put(block);
+    };
+
+    const auto beginBlock = [&](qint64 begin) {
+        for (QByteArray &stream : streams)
+        {
+            stream.clear();
+        }
+        lastTimeIndex.fill(0);
+        blockFrame = frame;
+        timeTable.clear();
+        timeCount = 0;
+        lastTime = 0;
+        blockBegin = begin;
+        blockChanges = 0;
+    };
+
+    QByteArray bits;
+    const auto appendChange = [&](int channel, qint64 time, const ValueStore::Iterator &value) {
+        if (timeCount == 0 || time != lastTime)
+        {
+            appendVarint(timeTable, static_cast<quint64>(time - lastTime));
+            lastTime = time;
+            ++timeCount;
+        }
+        const int timeIndex = static_cast<int>(timeCount - 1);
+        const quint64 delta = static_cast<quint64>(timeIndex - lastTimeIndex.at(channel));
+        lastTimeIndex[channel] = timeIndex;
+
+        QByteArray &stream = streams[channel];
+        const Layout &layout = layouts.at(channel);
+        char *current = frame.data() + layout.frameOffset;
+        switch (m_channels.at(channel).values.kind())
+        {
+        case ValueStore::Kind::Real:
+        {
+            const double number = value.real();
+            appendVarint(stream, (delta << 1) | 1);
+            stream.append(reinterpret_cast<const char *>(&number), sizeof(number));
+            std::memcpy(current, &number, sizeof(number));
+            break;
+        }
+        case ValueStore::Kind::Text:
+        {
+            const QByteArray text = value.text().toUtf8();
+            appendVarint(stream, (delta << 1) | 1);
+            appendVarint(stream, static_cast<quint64>(text.size()));
+            stream.append(text);
+            break;
+        }
+        case ValueStore::Kind::Scalar:
+        case ValueStore::Kind::Vector:
+        {
+            value.bits(current);
+            if (layout.geometry == 1)
+            {
+                // 0 and 1 take two bits next to the time delta, the other
+                // states a code from "xzhuwl-?" in four.
+                const char state = current[0];
+                if (state == '0' || state == '1')
+                {
+                    appendVarint(stream, (delta << 2) | (static_cast<quint64>(state - '0') << 1));
+                }
+                else
+                {
+                    appendVarint(stream, (delta << 4) | ((state == 'z' ? 1u : 0u) << 1) | 1);
+                }
+                break;
+            }
+            const int width = layout.frameBytes;
+            const bool binary = std::all_of(current, current + width, [](char c) { return c == '0' || c == '1'; });
+            if (binary)
+            {
+                appendVarint(stream, delta << 1);
+                bits.fill('\0', (width + 7) / 8);
+                for (int bit = 0; bit < width; ++bit)
+                {
+                    bits[bit / 8] = static_cast<char>(bits.at(bit / 8) | ((current[bit] - '0') << (7 - (bit & 7))));
+                }
+                stream.append(bits);
+            }
+            else
+            {
+                appendVarint(stream, (delta << 1) | 1);
+                stream.append(current, width);
+            }
+            break;
+        }
+        }
+    };
+
+    // Strings have no frame slot, so their values at the window start open
+    // the first block.
+    for (int i = 0; i < m_channels.size(); ++i)
+    {
+        const Channel &channel = m_channels.at(i);
+        if (layouts.at(i).geometry == kVariableLength && channel.first >= 0)
+        {
+            appendChange(i, m_windowStart, channel.values.at(channel.first));
+        }
+    }
+
+    Changes changes(m_channels);
+    qint64 endTime = m_windowStart;
+    for (int channel = changes.next(); channel >= 0; channel = changes.next())
+    {
+        const ValueStore::Iterator &value = changes.value();
+        if (blockChanges >= kBlockChanges && value.time() != lastTime)
+        {
+            if (!flushBlock(lastTime))
+            {
+                return false;
+            }
+            beginBlock(value.time());
+        }
+        appendChange(channel, value.time(), value);
+        endTime = value.time();
+        ++blockChanges;
+        ++m_transitionCount;
+        if ((m_transitionCount % kProgressInterval) == 0 && !reportProgress(m_transitionCount))
+        {
+            return false;
+        }
+    }
+    if (!flushBlock(endTime))
+    {
+        return false;
+    }
+
+    QByteArray geometry;
+    for (const Layout &layout : layouts)
+    {
+        appendVarint(geometry, layout.geometry);
+    }
+    QByteArray block;
+    block.append(kBlockGeometry);
+    appendBigEndian64(block, static_cast<quint64>(24 + geometry.size()));
+    appendBigEndian64(block, static_cast<quint64>(geometry.size()));
+    appendBigEndian64(block, static_cast<quint64>(m_channels.size()));
+    block.append(geometry); // stored, since its two lengths are equal
+    if (!put(block))
+    {
+        return false;
+    }
+
+    QByteArray hierarchy;
+    quint64 scopeCount = 0;
+    QVector<int> openScopes;
+    const auto moveTo = [&](const QVector<int> &chain) {
+        int common = 0;
+        while (common < openScopes.size() && common < chain.size() && openScopes.at(common) == chain.at(common))
+        {
+            ++common;
+        }
+        for (int i = openScopes.size(); i > common; --i)
+        {
+            hierarchy.append(static_cast<char>(kTagUpscope));
+        }
+        for (int i = common; i < chain.size(); ++i)
+        {
+            hierarchy.append(static_cast<char>(kTagScope));
+            hierarchy.append(static_cast<char>(fstCode(m_scopes.type(chain.at(i)), &FstBinaryReader::scopeTypeName, 0)));
+            hierarchy.append(m_scopes.name(chain.at(i)).toUtf8());
+            hierarchy.append('\0');
+            hierarchy.append('\0'); // no component name
+            ++scopeCount;
+        }
+        openScopes = chain;
+    };
+    // FST handles are numbered in declaration order; later signals of a
+    // channel are declared as aliases of the first.
+    QVector<bool> declared(m_channels.size(), false);
+    for (const Entry &entry : m_entries)
+    {
+        moveTo(entry.scopeChain);
+        const ValueStore &values = entry.signal.values;
+        int type = fstCode(entry.signal.type, &FstBinaryReader::varTypeName, 16);
+        quint64 length = static_cast<quint64>(values.width());
+        if (values.kind() == ValueStore::Kind::Real)
+        {
+            type = FstBinaryReader::isRealType(type) ? type : kVarTypeReal;
+            length = 64;
+        }
+        else if (values.kind() == ValueStore::Kind::Text)
+        {
+            type = kVarTypeString;
+            length = 0;
+        }
+        hierarchy.append(static_cast<char>(type));
+        hierarchy.append(static_cast<char>(fstCode(entry.signal.direction, &FstBinaryReader::directionName, 0)));
+        hierarchy.append(entry.signal.name.toUtf8());
+        hierarchy.append('\0');
+        appendVarint(hierarchy, length);
+        appendVarint(hierarchy, declared.at(entry.channel) ? static_cast<quint64>(entry.channel + 1) : 0);
+        declared[entry.channel] = true;
+    }
+    moveTo(QVector<int>());
+
+    QByteArray compressed;
+    if (!deflateGzip(hierarchy.constData(), hierarchy.size(), compressed, Z_DEFAULT_COMPRESSION))
+    {
+        return fail(QObject::tr("Unable to compress the hierarchy of %1").arg(file.fileName()));
+    }
+    block.clear();
+    block.append(kBlockHierarchy);
+    appendBigEndian64(block, static_cast<quint64>(16 + compressed.size()));
+    appendBigEndian64(block, static_cast<quint64>(hierarchy.size()));
+    block.append(compressed);
+    if (!put(block))
+    {
+        return false;
+    }
+
+    if (!file.seek(0) || !put(header(static_cast<quint64>(endTime), scopeCount, blockCount)))
+    {
+        return fail(QObject::tr("Unable to write %1: %2").arg(file.fileName(), file.errorString()));
+    }
+    return reportProgress(m_transitionCount);
+}
+
+bool TraceWriter::reportProgress(qint64 written)
+{
+    if (m_progress && !m_progress(written, m_total))
+    {
+        return fail(QObject::tr("The export was canceled"));
+    }
+    return true;
+}
+
+bool TraceWriter::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
+} // namespace fst
@@ -0,0 +1,761 @@
+#include "value_store.h"
+
+#include "load_arena.h"
+
+#include <QPair>
+
+#include <algorithm>
+#include <cstring>
+
+namespace fst
+{
+namespace
+{
+const char kStateChars[] = {'0', '1', 'x', 'z'};
+
+// 0 and 1 are plain values; x and z set the unknown plane (bit 1), with z
+// also setting the value plane (bit 0).
+int stateCode(char c)
+{
+    switch (c)
+    {
+    case '0':
+        return 0;
+    case '1':
+        return 1;
+    case 'x':
+    case 'X':
+        return 2;
+    case 'z':
+    case 'Z':
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+void writeDelta(QByteArray &out, qint64 delta)
+{
+    quint64 zigzag = (static_cast<quint64>(delta) << 1) ^ static_cast<quint64>(delta >> 63);
+    while (zigzag >= 0x80)
+    {
+        out.append(static_cast<char>(zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    out.append(static_cast<char>(zigzag));
+}
+
+qint64 readDelta(const char *times, int &offset)
+{
+    const uchar *data = reinterpret_cast<const uchar *>(times);
+    quint64 zigzag = 0;
+    int shift = 0;
+    uchar byte = 0;
+    do
+    {
+        byte = data[offset++];
+        zigzag |= static_cast<quint64>(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return static_cast<qint64>(zigzag >> 1) ^ -static_cast<qint64>(zigzag & 1);
+}
+
+quint32 readOffset(const char *offsets, int index)
+{
+    quint32 value = 0;
+    std::memcpy(&value, offsets + index * static_cast<int>(sizeof(quint32)), sizeof(value));
+    return value;
+}
+
+void appendOffset(QByteArray &offsets, quint32 value)
+{
+    offsets.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+} // namespace
+
+ValueStore::Iterator::Iterator(const ValueStore *store, int index, qint64 time, int offset)
+    : m_store(store)
+    , m_index(index)
+    , m_time(time)
+    , m_offset(offset)
+{
+}
+
+QString ValueStore::Iterator::text() const
+{
+    return m_store->textAt(m_index);
+}
+
+char ValueStore::Iterator::scalar() const
+{
+    if (m_store->m_kind == Kind::Scalar)
+    {
+        const char *data = nullptr;
+        char code = 0;
+        m_store->entryBytes(m_index, data, code);
+        return kStateChars[static_cast<int>(*data)];
+    }
+
+    const QString value = text();
+    return value.isEmpty() ? '0' : value.at(0).toLower().toLatin1();
+}
+
+double ValueStore::Iterator::real() const
+{
+    if (m_store->m_kind == Kind::Real)
+    {
+        const char *data = nullptr;
+        char code = 0;
+        m_store->entryBytes(m_index, data, code);
+        double value = 0.0;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+    return text().toDouble();
+}
+
+void ValueStore::Iterator::bits(char *buffer) const
+{
+    const char *data = nullptr;
+    char code = 0;
+    const int length = m_store->entryBytes(m_index, data, code);
+    if (m_store->m_kind == Kind::Scalar)
+    {
+        buffer[0] = kStateChars[static_cast<int>(*data)];
+        return;
+    }
+
+    const uchar *valuePlane = reinterpret_cast<const uchar *>(data);
+    const uchar *unknownPlane = valuePlane + length / 2;
+    const int width = m_store->m_width;
+    for (int i = 0; i < width; ++i)
+    {
+        const int bit = width - 1 - i;
+        const int state = ((valuePlane[bit >> 3] >> (bit & 7)) & 1) | (((unknownPlane[bit >> 3] >> (bit & 7)) & 1) << 1);
+        buffer[i] = kStateChars[state];
+    }
+}
+
+ValueStore::Iterator &ValueStore::Iterator::operator++()
+{
+    ++m_index;
+    if (m_index < m_store->m_size)
+    {
+        m_time += readDelta(m_store->timesData(), m_offset);
+    }
+    return *this;
+}
+
+ValueStore::ValueStore(Kind kind, int width)
+    : m_kind(kind)
+    , m_width(qMax(1, width))
+{
+}
+
+ValueStore::Kind ValueStore::kindFor(const QString &type, int width, bool isEnum)
+{
+    if (isEnum || type == QLatin1String("string"))
+    {
+        return Kind::Text;
+    }
+    if (type == QLatin1String("real") || type == QLatin1String("realtime") || type == QLatin1String("real_parameter") ||
+        type == QLatin1String("shortreal"))
+    {
+        return Kind::Real;
+    }
+    return width > 1 ? Kind::Vector : Kind::Scalar;
+}
+
+ValueStore::Iterator ValueStore::begin() const
+{
+    if (m_size == 0)
+    {
+        return end();
+    }
+    const Checkpoint &first = checkpointData()[0];
+    return Iterator(this, 0, first.time, first.offset);
+}
+
+ValueStore::Iterator ValueStore::end() const
+{
+    return Iterator(this, m_size, 0, 0);
+}
+
+ValueStore::Iterator ValueStore::at(int index) const
+{
+    if (index < 0 || index >= m_size)
+    {
+        return end();
+    }
+    const int slot = index / kCheckpointInterval;
+    const Checkpoint &checkpoint = checkpointData()[slot];
+    Iterator it(this, slot * kCheckpointInterval, checkpoint.time, checkpoint.offset);
+    while (it.m_index < index)
+    {
+        ++it;
+    }
+    return it;
+}
+
+int ValueStore::indexAt(qint64 time) const
+{
+    // The checkpoints hold the time of every kCheckpointInterval-th entry,
+    // so only the entries after the last one at or before `time` are walked.
+    const Checkpoint *checkpoints = checkpointData();
+    const Checkpoint *after = std::upper_bound(checkpoints, checkpoints + checkpointCount(), time,
+                                               [](qint64 value, const Checkpoint &checkpoint) { return value < checkpoint.time; });
+    if (after == checkpoints)
+    {
+        return -1;
+    }
+    Iterator it = at(static_cast<int>(after - checkpoints - 1) * kCheckpointInterval);
+    int index = it.index();
+    for (++it; it != end() && it.time() <= time; ++it)
+    {
+        index = it.index();
+    }
+    return index;
+}
+
+void ValueStore::append(qint64 time, const char *value, int length)
+{
+    if (m_kind == Kind::Scalar && length == 1)
+    {
+        const int code = stateCode(value[0]);
+        if (code >= 0)
+        {
+            const char encoded = static_cast<char>(code);
+            appendEncoded(time, &encoded, 1);
+            return;
+        }
+    }
+    if (m_kind == Kind::Text)
+    {
+        appendEncoded(time, value, length);
+        return;
+    }
+
+    thread_local QByteArray encoded;
+    if (!encode(value, length, encoded))
+    {
+        convertToText();
+        appendEncoded(time, value, length);
+        return;
+    }
+    appendEncoded(time, encoded.constData(), encoded.size());
+}
+
+void ValueStore::append(qint64 time, const QString &value)
+{
+    const QByteArray bytes = value.toUtf8();
+    append(time, bytes.constData(), bytes.size());
+}
+
+void ValueStore::appendScalar(qint64 time, char value)
+{
+    append(time, &value, 1);
+}
+
+void ValueStore::appendRun(const ValueStore &run)
+{
+    if (run.isEmpty())
+    {
+        return;
+    }
+    if (isEmpty() && (run.m_kind == m_kind || run.m_kind == Kind::Text))
+    {
+        // Nothing to stitch against; share the run's columns.
+        const quint64 revision = m_revision;
+        *this = run;
+        m_revision = revision + 1;
+        return;
+    }
+    if (run.m_kind == Kind::Text && m_kind != Kind::Text)
+    {
+        convertToText();
+    }
+
+    if (run.m_kind != m_kind || run.m_width != m_width)
+    {
+        for (Iterator it = run.begin(); it != run.end(); ++it)
+        {
+            const QByteArray text = it.text().toUtf8();
+            append(it.time(), text.constData(), text.size());
+        }
+        return;
+    }
+
+    // Only the first entry can interact with what is already stored; the
+    // rest of the run is canonical on its own and is copied as is.
+    const char *data = nullptr;
+    char code = 0;
+    Iterator it = run.begin();
+    appendEncoded(it.time(), data, run.entryBytes(0, data, code));
+    for (++it; it != run.end(); ++it)
+    {
+        const int length = run.entryBytes(it.index(), data, code);
+        pushEntry(it.time(), data, length);
+    }
+}
+
+void ValueStore::sortByTime()
+{
+    if (m_sorted)
+    {
+        return;
+    }
+
+    // Out-of-order input is usually a few ascending runs (one per source
+    // block or per interleaved writer), so the runs are found while reading
+    // and merged pairwise instead of sorting from scratch.
+    using Entry = QPair<qint64, int>;
+    QVector<Entry> order;
+    order.reserve(m_size);
+    QVector<int> runStarts;
+    for (Iterator it = begin(); it != end(); ++it)
+    {
+        if (order.isEmpty() || it.time() < order.last().first)
+        {
+            runStarts.append(order.size());
+        }
+        order.append(qMakePair(it.time(), it.index()));
+    }
+    runStarts.append(order.size());
+
+    // Merging keeps entries of the earlier run first on equal times, so the
+    // last change written for a time still wins.
+    const auto earlier = [](const Entry &a, const Entry &b) { return a.first < b.first; };
+    QVector<Entry> buffer(order.size());
+    while (runStarts.size() > 2)
+    {
+        QVector<int> merged;
+        merged.reserve(runStarts.size() / 2 + 2);
+        int run = 0;
+        for (; run + 2 < runStarts.size(); run += 2)
+        {
+            const Entry *first = order.constData() + runStarts.at(run);
+            const Entry *middle = order.constData() + runStarts.at(run + 1);
+            const Entry *last = order.constData() + runStarts.at(run + 2);
+            std::merge(first, middle, middle, last, buffer.data() + runStarts.at(run), earlier);
+            merged.append(runStarts.at(run));
+        }
+        if (run + 1 < runStarts.size())
+        {
+            // An odd run out is carried over unchanged.
+            std::copy(order.constData() + runStarts.at(run), order.constData() + runStarts.at(run + 1), buffer.data() + runStarts.at(run));
+            merged.append(runStarts.at(run));
+        }
+        merged.append(order.size());
+        order.swap(buffer);
+        runStarts.swap(merged);
+    }
+
+    ValueStore sorted(m_kind, m_width);
+    const char *data = nullptr;
+    char code = 0;
+    for (const auto &entry : order)
+    {
+        const int length = entryBytes(entry.second, data, code);
+        sorted.appendEncoded(entry.first, data, length);
+    }
+    const quint64 revision = m_revision;
+    *this = sorted;
+    m_revision = revision + 1;
+}
+
+void ValueStore::squeeze()
+{
+    m_times.squeeze();
+    m_values.squeeze();
+    m_offsets.squeeze();
+    m_checkpoints.squeeze();
+}
+
+void ValueStore::moveTo(const std::shared_ptr<LoadArena> &arena)
+{
+    if (m_backing || m_size == 0)
+    {
+        return;
+    }
+
+    // One block per store: checkpoints first for their alignment, then the
+    // byte columns.
+    const qint64 checkpointBytes = static_cast<qint64>(m_checkpoints.size()) * static_cast<qint64>(sizeof(Checkpoint));
+    char *block = static_cast<char *>(
+        arena->allocate(checkpointBytes + m_times.size() + m_values.size() + m_offsets.size(), alignof(Checkpoint)));
+    BorrowedColumns columns;
+    columns.checkpoints = reinterpret_cast<const Checkpoint *>(block);
+    columns.checkpointCount = m_checkpoints.size();
+    std::memcpy(block, m_checkpoints.constData(), static_cast<size_t>(checkpointBytes));
+    char *cursor = block + checkpointBytes;
+    const auto place = [&cursor](const QByteArray &column, const char *&data, int &size) {
+        std::memcpy(cursor, column.constData(), static_cast<size_t>(column.size()));
+        data = cursor;
+        size = column.size();
+        cursor += column.size();
+    };
+    place(m_times, columns.times, columns.timesSize);
+    place(m_values, columns.values, columns.valuesSize);
+    place(m_offsets, columns.offsets, columns.offsetsSize);
+    borrow(columns, arena);
+}
+
+void ValueStore::borrow(const BorrowedColumns &columns, std::shared_ptr<const void> backing)
+{
+    m_times = QByteArray();
+    m_values = QByteArray();
+    m_offsets = QByteArray();
+    m_checkpoints = QVector<Checkpoint>();
+    m_borrowed = columns;
+    m_backing = std::move(backing);
+}
+
+void ValueStore::makeResident()
+{
+    if (!m_backing)
+    {
+        return;
+    }
+    const BorrowedColumns columns = m_borrowed;
+    m_times = QByteArray(columns.times, columns.timesSize);
+    m_values = QByteArray(columns.values, columns.valuesSize);
+    m_offsets = QByteArray(columns.offsets, columns.offsetsSize);
+    m_checkpoints = QVector<Checkpoint>(columns.checkpoints, columns.checkpoints + columns.checkpointCount);
+    m_borrowed = BorrowedColumns();
+    m_backing.reset();
+}
+
+qint64 ValueStore::memoryUsage() const
+{
+    return static_cast<qint64>(sizeof(ValueStore)) + m_times.capacity() + m_values.capacity() + m_offsets.capacity() +
+           static_cast<qint64>(m_checkpoints.capacity()) * static_cast<qint64>(sizeof(Checkpoint));
+}
+
+bool ValueStore::encode(const char *value, int length, QByteArray &encoded) const
+{
+    switch (m_kind)
+    {
+    case Kind::Scalar:
+    {
+        const int code = length == 1 ? stateCode(value[0]) : -1;
+        if (code < 0)
+        {
+            return false;
+        }
+        encoded = QByteArray(1, static_cast<char>(code));
+        return true;
+    }
+    case Kind::Vector:
+    {
+        if (length <= 0 || length > m_width)
+        {
+            return false;
+        }
+        const int planeBytes = valueBytes() / 2;
+        encoded.resize(planeBytes * 2);
+        std::memset(encoded.data(), 0, static_cast<size_t>(encoded.size()));
+        uchar *valuePlane = reinterpret_cast<uchar *>(encoded.data());
+        uchar *unknownPlane = valuePlane + planeBytes;
+
+        // Shorter values are extended on the left as VCD specifies: with x or
+        // z if that is the leading state, otherwise with zeros.
+        const int leading = stateCode(value[0]);
+        const int padCode = leading >= 2 ? leading : 0;
+        const int padding = m_width - length;
+        for (int i = 0; i < m_width; ++i)
+        {
+            const int code = i < padding ? padCode : stateCode(value[i - padding]);
+            if (code < 0)
+            {
+                return false;
+            }
+            const int bit = m_width - 1 - i;
+            valuePlane[bit >> 3] |= static_cast<uchar>((code & 1) << (bit & 7));
+            unknownPlane[bit >> 3] |= static_cast<uchar>((code >> 1) << (bit & 7));
+        }
+        return true;
+    }
+    case Kind::Real:
+    {
+        bool ok = false;
+        const double number = QByteArray::fromRawData(value, length).toDouble(&ok);
+        if (!ok)
+        {
+            return false;
+        }
+        encoded.resize(sizeof(number));
+        std::memcpy(encoded.data(), &number, sizeof(number));
+        return true;
+    }
+    case Kind::Text:
+        encoded = QByteArray(value, length);
+        return true;
+    }
+    return false;
+}
+
+void ValueStore::appendEncoded(qint64 time, const char *encoded, int length)
+{
+    if (m_size > 0 && time == m_lastTime)
+    {
+        overwriteLast(encoded, length);
+        if (m_size > 1 && entryEquals(m_size - 2, encoded, length))
+        {
+            removeLast();
+        }
+        return;
+    }
+    if (m_size > 0 && entryEquals(m_size - 1, encoded, length))
+    {
+        return;
+    }
+    pushEntry(time, encoded, length);
+}
+
+bool ValueStore::entryEquals(int index, const char *encoded, int length) const
+{
+    const char *data = nullptr;
+    char code = 0;
+    const int stored = entryBytes(index, data, code);
+    return stored == length && std::memcmp(data, encoded, static_cast<size_t>(length)) == 0;
+}
+
+int ValueStore::entryBytes(int index, const char *&data, char &scratch) const
+{
+    switch (m_kind)
+    {
+    case Kind::Scalar:
+        scratch = static_cast<char>((static_cast<uchar>(valuesData()[index >> 2]) >> ((index & 3) * 2)) & 3);
+        data = &scratch;
+        return 1;
+    case Kind::Vector:
+    case Kind::Real:
+    {
+        const int bytes = valueBytes();
+        data = valuesData() + index * bytes;
+        return bytes;
+    }
+    case Kind::Text:
+    {
+        const char *offsets = offsetsData();
+        const quint32 start = index > 0 ? readOffset(offsets, index - 1) : 0;
+        data = valuesData() + start;
+        return static_cast<int>(readOffset(offsets, index) - start);
+    }
+    }
+    return 0;
+}
+
+void ValueStore::pushEntry(qint64 time, const char *encoded, int length)
+{
+    ++m_revision;
+    if (m_backing)
+    {
+        makeResident();
+    }
+    if (m_size > 0 && time < m_lastTime)
+    {
+        m_sorted = false;
+    }
+    m_lastTimeOffset = m_times.size();
+    writeDelta(m_times, time - m_lastTime);
+    m_lastTime = time;
+    if (m_size % kCheckpointInterval == 0)
+    {
+        m_checkpoints.append({time, m_times.size()});
+    }
+
+    switch (m_kind)
+    {
+    case Kind::Scalar:
+        if ((m_size & 3) == 0)
+        {
+            m_values.append('\0');
+        }
+        m_values.data()[m_size >> 2] |= static_cast<char>(*encoded << ((m_size & 3) * 2));
+        break;
+    case Kind::Vector:
+    case Kind::Real:
+        m_values.append(encoded, length);
+        break;
+    case Kind::Text:
+        m_values.append(encoded, length);
+        appendOffset(m_offsets, static_cast<quint32>(m_values.size()));
+        break;
+    }
+    ++m_size;
+}
+
+void ValueStore::overwriteLast(const char *encoded, int length)
+{
+    ++m_revision;
+    if (m_backing)
+    {
+        makeResident();
+    }
+    const int index = m_size - 1;
+    switch (m_kind)
+    {
+    case Kind::Scalar:
+    {
+        char &byte = m_values.data()[index >> 2];
+        const int shift = (index & 3) * 2;
+        byte = static_cast<char>((byte & ~(3 << shift)) | (*encoded << shift));
+        break;
+    }
+    case Kind::Vector:
+    case Kind::Real:
+        std::memcpy(m_values.data() + index * length, encoded, static_cast<size_t>(length));
+        break;
+    case Kind::Text:
+    {
+        const quint32 start = index > 0 ? readOffset(m_offsets.constData(), index - 1) : 0;
+        m_values.truncate(static_cast<int>(start));
+        m_values.append(encoded, length);
+        const quint32 end = static_cast<quint32>(m_values.size());
+        std::memcpy(m_offsets.data() + index * static_cast<int>(sizeof(quint32)), &end, sizeof(end));
+        break;
+    }
+    }
+}
+
+void ValueStore::removeLast()
+{
+    ++m_revision;
+    if (m_backing)
+    {
+        makeResident();
+    }
+    --m_size;
+    m_times.truncate(m_lastTimeOffset);
+    if (m_size % kCheckpointInterval == 0)
+    {
+        m_checkpoints.removeLast();
+    }
+
+    switch (m_kind)
+    {
+    case Kind::Scalar:
+        if ((m_size & 3) == 0)
+        {
+            m_values.chop(1);
+        }
+        else
+        {
+            m_values.data()[m_size >> 2] &= static_cast<char>(~(3 << ((m_size & 3) * 2)));
+        }
+        break;
+    case Kind::Vector:
+    case Kind::Real:
+        m_values.chop(valueBytes());
+        break;
+    case Kind::Text:
+        m_values.truncate(m_size > 0 ? static_cast<int>(readOffset(m_offsets.constData(), m_size - 1)) : 0);
+        m_offsets.chop(sizeof(quint32));
+        break;
+    }
+
+    // Recover the time and delta offset of the new last entry from its
+    // checkpoint; removals are rare, so this does not need to be cheap.
+    if (m_size == 0)
+    {
+        m_lastTime = 0;
+        m_lastTimeOffset = 0;
+        return;
+    }
+    const int last = m_size - 1;
+    const int slot = last / kCheckpointInterval;
+    const Checkpoint &checkpoint = m_checkpoints.at(slot);
+    int start = checkpoint.offset - 1;
+    while (start > 0 && (static_cast<uchar>(m_times.at(start - 1)) & 0x80))
+    {
+        --start;
+    }
+    qint64 time = checkpoint.time;
+    int offset = checkpoint.offset;
+    for (int index = slot * kCheckpointInterval; index < last; ++index)
+    {
+        start = offset;
+        time += readDelta(m_times.constData(), offset);
+    }
+    m_lastTime = time;
+    m_lastTimeOffset = start;
+}
+
+void ValueStore::convertToText()
+{
+    if (m_kind == Kind::Text)
+    {
+        return;
+    }
+
+    ValueStore text(Kind::Text, m_width);
+    for (Iterator it = begin(); it != end(); ++it)
+    {
+        const QByteArray bytes = it.text().toUtf8();
+        text.pushEntry(it.time(), bytes.constData(), bytes.size());
+    }
+    const quint64 revision = m_revision;
+    *this = text;
+    m_revision = revision + 1;
+}
+
+int ValueStore::valueBytes() const
+{
+    switch (m_kind)
+    {
+    case Kind::Vector:
+        return ((m_width + 7) / 8) * 2;
+    case Kind::Real:
+        return static_cast<int>(sizeof(double));
+    default:
+        return 0;
+    }
+}
+
+QString ValueStore::textAt(int index) const
+{
+    const char *data = nullptr;
+    char code = 0;
+    const int length = entryBytes(index, data, code);
+
+    switch (m_kind)
+    {
+    case Kind::Scalar:
+        switch (*data)
+        {
+        case 0:
+            return QStringLiteral("0");
+        case 1:
+            return QStringLiteral("1");
+        case 2:
+            return QStringLiteral("X");
+        default:
+            return QStringLiteral("Z");
+        }
+    case Kind::Vector:
+    {
+        const uchar *valuePlane = reinterpret_cast<const uchar *>(data);
+        const uchar *unknownPlane = valuePlane + length / 2;
+        QString text(m_width, QLatin1Char('0'));
+        QChar *out = text.data();
+        for (int i = 0; i < m_width; ++i)
+        {
+            const int bit = m_width - 1 - i;
+            const int state = ((valuePlane[bit >> 3] >> (bit & 7)) & 1) | (((unknownPlane[bit >> 3] >> (bit & 7)) & 1) << 1);
+            out[i] = QLatin1Char(kStateChars[state]);
+        }
+        return text;
+    }
+    case Kind::Real:
+    {
+        double value = 0.0;
+        std::memcpy(&value, data, sizeof(value));
+        return QString::number(value, 'g', 16);
+    }
+    case Kind::Text:
+        return QString::fromUtf8(data, length);
+    }
+    return QString();
+}
+} // namespace fst
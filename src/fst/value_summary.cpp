@@ -0,0 +1,115 @@
+#include "value_summary.h"
+
+#include <cstring>
+#include <vector>
+
+namespace fst
+{
+namespace
+{
+ValueSummary::Bucket merge(const ValueSummary::Bucket &left, const ValueSummary::Bucket &right)
+{
+    if (left.count == 0)
+    {
+        return right;
+    }
+    if (right.count == 0)
+    {
+        return left;
+    }
+    ValueSummary::Bucket bucket = left;
+    bucket.count += right.count;
+    bucket.last = right.last;
+    bucket.lastState = right.lastState;
+    bucket.unknown = left.unknown || right.unknown;
+    return bucket;
+}
+} // namespace
+
+ValueSummary::ValueSummary(const ValueStore &values)
+    : m_sourceSize(values.size())
+    , m_sourceRevision(values.revision())
+{
+    if (values.isEmpty())
+    {
+        return;
+    }
+
+    // The last change is found from the final checkpoint rather than by
+    // walking the whole store a second time.
+    const ValueStore::Iterator last = values.at(values.size() - 1);
+    m_origin = values.begin().time();
+    const qint64 span = last.time() - m_origin;
+    const qint64 wanted = qMax(1, values.size() / kChangesPerBucket);
+    while ((span >> m_shift) + 1 > wanted)
+    {
+        ++m_shift;
+    }
+
+    QVector<Bucket> level(static_cast<int>((span >> m_shift) + 1));
+    const ValueStore::Kind kind = values.kind();
+    std::vector<char> bits(kind == ValueStore::Kind::Vector ? static_cast<size_t>(values.width()) : 0);
+    for (auto it = values.begin(); it != values.end(); ++it)
+    {
+        Bucket &bucket = level[static_cast<int>((it.time() - m_origin) >> m_shift)];
+        char state = 0;
+        bool unknown = false;
+        if (kind == ValueStore::Kind::Vector)
+        {
+            it.bits(bits.data());
+            unknown = std::memchr(bits.data(), 'x', bits.size()) || std::memchr(bits.data(), 'z', bits.size());
+        }
+        else if (kind != ValueStore::Kind::Real)
+        {
+            state = it.scalar();
+            unknown = state == 'x' || state == 'z';
+        }
+        if (bucket.count == 0)
+        {
+            bucket.first = it.index();
+            bucket.firstState = state;
+        }
+        ++bucket.count;
+        bucket.last = it.index();
+        bucket.lastState = state;
+        bucket.unknown = bucket.unknown || unknown;
+    }
+
+    m_levels.append(level);
+    while (m_levels.last().size() > 1)
+    {
+        const QVector<Bucket> &finer = m_levels.last();
+        QVector<Bucket> coarser((finer.size() + 1) / 2);
+        for (int i = 0; i < coarser.size(); ++i)
+        {
+            coarser[i] = 2 * i + 1 < finer.size() ? merge(finer.at(2 * i), finer.at(2 * i + 1)) : finer.at(2 * i);
+        }
+        m_levels.append(coarser);
+    }
+}
+
+bool ValueSummary::matches(const ValueStore &values) const
+{
+    return values.size() == m_sourceSize && values.revision() == m_sourceRevision;
+}
+
+int ValueSummary::levelFor(qreal timeUnits) const
+{
+    int level = -1;
+    while (level + 1 < m_levels.size() && shift(level + 1) < 62 && static_cast<qreal>(qint64(1) << shift(level + 1)) <= timeUnits)
+    {
+        ++level;
+    }
+    return level;
+}
+
+qint64 ValueSummary::memoryUsage() const
+{
+    qint64 bytes = sizeof(ValueSummary);
+    for (const QVector<Bucket> &level : m_levels)
+    {
+        bytes += static_cast<qint64>(level.capacity()) * sizeof(Bucket);
+    }
+    return bytes;
+}
+} // namespace fst
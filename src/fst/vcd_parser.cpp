@@ -0,0 +1,311 @@
+#include "vcd_parser.h"
+
+#include "vcd_scanner.h"
+
+#include <QObject>
+
+#include <charconv>
+
+namespace fst
+{
+namespace
+{
+QByteArray toByteArray(std::string_view view)
+{
+    return QByteArray(view.data(), static_cast<int>(view.size()));
+}
+} // namespace
+
+VcdParser::VcdParser(Handler &handler)
+    : m_handler(handler)
+    , m_definedSymbols(std::make_shared<SymbolTable>())
+    , m_symbols(m_definedSymbols)
+{
+}
+
+VcdParser::VcdParser(Handler &handler, std::shared_ptr<const SymbolTable> symbols)
+    : m_handler(handler)
+    , m_symbols(std::move(symbols))
+    , m_inDefinitions(false)
+{
+}
+
+qint64 VcdParser::parseDefinitions(const char *begin, const char *end, bool atEnd)
+{
+    m_stopAfterDefinitions = true;
+    const qint64 consumed = parse(begin, end, atEnd);
+    m_stopAfterDefinitions = false;
+    return consumed;
+}
+
+VcdParser::TokenResult VcdParser::nextToken(VcdScanner &scanner, const char *&cursor, bool atEnd, std::string_view &token) const
+{
+    cursor = scanner.skipSpace(cursor);
+    if (cursor == scanner.end())
+    {
+        return TokenResult::Exhausted;
+    }
+
+    const char *start = cursor;
+    cursor = scanner.findSpace(cursor);
+    // A token running into the end of a partial buffer may continue in the
+    // next piece, so it is only complete once followed by whitespace.
+    if (cursor == scanner.end() && !atEnd)
+    {
+        cursor = start;
+        return TokenResult::Incomplete;
+    }
+
+    token = std::string_view(start, static_cast<size_t>(cursor - start));
+    return TokenResult::Token;
+}
+
+VcdParser::TokenResult VcdParser::collectUntilEnd(VcdScanner &scanner, const char *&cursor, bool atEnd)
+{
+    m_parts.clear();
+    std::string_view token;
+    while (true)
+    {
+        const TokenResult result = nextToken(scanner, cursor, atEnd, token);
+        if (result != TokenResult::Token)
+        {
+            return result == TokenResult::Exhausted && !atEnd ? TokenResult::Incomplete : result;
+        }
+        if (token == "$end")
+        {
+            return TokenResult::Token;
+        }
+        m_parts.append(token);
+    }
+}
+
+qint64 VcdParser::parse(const char *begin, const char *end, bool atEnd)
+{
+    VcdScanner scanner(end);
+    const char *cursor = begin;
+    std::string_view token;
+
+    while (true)
+    {
+        const char *commandStart = cursor;
+        const TokenResult result = nextToken(scanner, cursor, atEnd, token);
+        if (result == TokenResult::Exhausted)
+        {
+            return cursor - begin;
+        }
+        if (result == TokenResult::Incomplete)
+        {
+            return commandStart - begin;
+        }
+
+        if (m_inDefinitions)
+        {
+            if (token.front() != '$')
+            {
+                continue;
+            }
+
+            const TokenResult body = collectUntilEnd(scanner, cursor, atEnd);
+            if (body == TokenResult::Incomplete)
+            {
+                return commandStart - begin;
+            }
+            // An unterminated command at end of input is treated like the
+            // old line-based reader did: as if $end had been seen.
+            if (!handleDefinition(token))
+            {
+                return -1;
+            }
+            if (!m_inDefinitions && m_stopAfterDefinitions)
+            {
+                return cursor - begin;
+            }
+            continue;
+        }
+
+        switch (VcdScanner::leadOf(token.front()))
+        {
+        case VcdScanner::Lead::Timestamp:
+        {
+            qint64 time = 0;
+            const char *digitsEnd = token.data() + token.size();
+            const auto parsed = std::from_chars(token.data() + 1, digitsEnd, time);
+            if (parsed.ec != std::errc() || parsed.ptr != digitsEnd)
+            {
+                fail(QObject::tr("Invalid timestamp in VCD"));
+                return -1;
+            }
+            m_currentTime = time;
+            if (time > m_maxTime)
+            {
+                m_maxTime = time;
+            }
+            break;
+        }
+        case VcdScanner::Lead::Command:
+            if (token == "$dumpvars")
+            {
+                m_inDumpvars = true;
+            }
+            else if (token == "$end")
+            {
+                m_inDumpvars = false;
+            }
+            else if (token == "$comment")
+            {
+                if (collectUntilEnd(scanner, cursor, atEnd) == TokenResult::Incomplete)
+                {
+                    return commandStart - begin;
+                }
+            }
+            // Other runtime commands ($dumpall, $dumpon, $dumpoff) carry no data.
+            break;
+        case VcdScanner::Lead::Vector:
+        {
+            std::string_view identifier;
+            const TokenResult idResult = nextToken(scanner, cursor, atEnd, identifier);
+            if (idResult == TokenResult::Incomplete || (idResult == TokenResult::Exhausted && !atEnd))
+            {
+                return commandStart - begin;
+            }
+            if (token.size() < 2 || idResult != TokenResult::Token)
+            {
+                fail(QObject::tr("Malformed vector change in VCD"));
+                return -1;
+            }
+            if (!emitChange(identifier, token.data() + 1, static_cast<int>(token.size() - 1), false))
+            {
+                return -1;
+            }
+            break;
+        }
+        case VcdScanner::Lead::Scalar:
+            if (token.size() >= 2 && !emitChange(token.substr(1), token.data(), 1, true))
+            {
+                return -1;
+            }
+            break;
+        }
+    }
+}
+
+bool VcdParser::handleDefinition(std::string_view keyword)
+{
+    if (keyword == "$scope")
+    {
+        if (m_parts.size() < 2)
+        {
+            return fail(QObject::tr("Invalid scope definition in VCD"));
+        }
+        m_handler.beginScope(toByteArray(m_parts.at(0)), toByteArray(m_parts.at(1)));
+        return true;
+    }
+
+    if (keyword == "$upscope")
+    {
+        if (!m_handler.endScope())
+        {
+            return fail(QObject::tr("Unexpected $upscope in VCD"));
+        }
+        return true;
+    }
+
+    if (keyword == "$var")
+    {
+        if (m_parts.size() < 4)
+        {
+            return fail(QObject::tr("Invalid $var definition in VCD"));
+        }
+
+        VarDeclaration var;
+        var.type = toByteArray(m_parts.at(0));
+        const std::string_view widthText = m_parts.at(1);
+        const auto parsed = std::from_chars(widthText.data(), widthText.data() + widthText.size(), var.width);
+        if (parsed.ec != std::errc() || parsed.ptr != widthText.data() + widthText.size())
+        {
+            return fail(QObject::tr("Invalid bit width in VCD"));
+        }
+        var.symbol = internSymbol(m_parts.at(2));
+        for (int i = 3; i < m_parts.size(); ++i)
+        {
+            if (!var.reference.isEmpty())
+            {
+                var.reference += ' ';
+            }
+            var.reference.append(m_parts.at(i).data(), static_cast<int>(m_parts.at(i).size()));
+        }
+        m_handler.declareVar(var);
+        return true;
+    }
+
+    if (keyword == "$enddefinitions")
+    {
+        m_inDefinitions = false;
+    }
+
+    // $timescale, $date, $version, $comment and friends carry nothing we keep.
+    return true;
+}
+
+bool VcdParser::emitChange(std::string_view identifier, const char *value, int length, bool scalar)
+{
+    const int symbol = m_symbols->find(identifier);
+    if (symbol < 0)
+    {
+        if (!m_inDumpvars)
+        {
+            return fail(QObject::tr("Unknown symbol '%1' in VCD").arg(QString::fromLatin1(identifier.data(), static_cast<int>(identifier.size()))));
+        }
+        return true;
+    }
+    if (!m_symbolMask.isEmpty() && (symbol >= m_symbolMask.size() || !m_symbolMask.at(symbol)))
+    {
+        return true;
+    }
+
+    if (scalar)
+    {
+        m_handler.scalarChange(symbol, m_currentTime, *value);
+    }
+    else
+    {
+        m_handler.vectorChange(symbol, m_currentTime, value, length);
+    }
+    return true;
+}
+
+int VcdParser::internSymbol(std::string_view identifier)
+{
+    SymbolTable &table = *m_definedSymbols;
+    const int existing = table.find(identifier);
+    if (existing >= 0)
+    {
+        return existing;
+    }
+
+    const int symbol = table.size();
+    const qint64 code = SymbolTable::directCode(identifier);
+    if (code >= 0)
+    {
+        if (code >= qint64(table.direct.size()))
+        {
+            table.direct.resize(static_cast<size_t>(code) + 1, -1);
+        }
+        table.direct[static_cast<size_t>(code)] = symbol;
+        table.identifiers.emplace_back(identifier);
+        return symbol;
+    }
+
+    // std::deque never relocates existing elements, so the views used as map
+    // keys stay valid as more identifiers are added.
+    table.identifiers.emplace_back(identifier);
+    table.symbols.emplace(std::string_view(table.identifiers.back()), symbol);
+    return symbol;
+}
+
+bool VcdParser::fail(const QString &message)
+{
+    m_lastError = message;
+    return false;
+}
+} // namespace fst
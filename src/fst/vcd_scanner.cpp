@@ -0,0 +1,161 @@
+#include "vcd_scanner.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define VCD_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace fst
+{
+namespace
+{
+quint64 scalarSpaces(const char *block, int count)
+{
+    quint64 spaces = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        spaces |= quint64(VcdScanner::isSpace(block[i])) << i;
+    }
+    return spaces;
+}
+
+quint64 scalarBlock(const char *block)
+{
+    return scalarSpaces(block, 64);
+}
+
+#ifdef VCD_SCANNER_X86
+// Whitespace is ' ' or '\t'..'\r'. The signed compares leave bytes of 0x80
+// and above out, as they should.
+__attribute__((target("sse2"))) quint64 sse2Block(const char *block)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i below = _mm_set1_epi8('\t' - 1);
+    const __m128i above = _mm_set1_epi8('\r' + 1);
+    quint64 spaces = 0;
+    for (int i = 0; i < 64; i += 16)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + i));
+        const __m128i control = _mm_and_si128(_mm_cmpgt_epi8(bytes, below), _mm_cmplt_epi8(bytes, above));
+        const __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(bytes, space), control);
+        spaces |= quint64(quint32(_mm_movemask_epi8(matches))) << i;
+    }
+    return spaces;
+}
+
+__attribute__((target("avx2"))) quint64 avx2Block(const char *block)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i below = _mm256_set1_epi8('\t' - 1);
+    const __m256i above = _mm256_set1_epi8('\r' + 1);
+    quint64 spaces = 0;
+    for (int i = 0; i < 64; i += 32)
+    {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + i));
+        const __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, below), _mm256_cmpgt_epi8(above, bytes));
+        const __m256i matches = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, space), control);
+        spaces |= quint64(quint32(_mm256_movemask_epi8(matches))) << i;
+    }
+    return spaces;
+}
+#endif
+} // namespace
+
+VcdScanner::Kernel VcdScanner::bestKernel()
+{
+    static const Kernel best = isSupported(Kernel::Avx2) ? Kernel::Avx2 : isSupported(Kernel::Sse2) ? Kernel::Sse2 : Kernel::Scalar;
+    return best;
+}
+
+bool VcdScanner::isSupported(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::Scalar:
+        return true;
+#ifdef VCD_SCANNER_X86
+    case Kernel::Sse2:
+        return __builtin_cpu_supports("sse2");
+    case Kernel::Avx2:
+        return __builtin_cpu_supports("avx2");
+#else
+    case Kernel::Sse2:
+    case Kernel::Avx2:
+        return false;
+#endif
+    }
+    return false;
+}
+
+const char *VcdScanner::kernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::Scalar:
+        return "scalar";
+    case Kernel::Sse2:
+        return "sse2";
+    case Kernel::Avx2:
+        return "avx2";
+    }
+    return "";
+}
+
+VcdScanner::VcdScanner(const char *end, Kernel kernel)
+    : m_end(end)
+    , m_kernel(scalarBlock)
+{
+#ifdef VCD_SCANNER_X86
+    if (kernel == Kernel::Avx2 && isSupported(Kernel::Avx2))
+    {
+        m_kernel = avx2Block;
+    }
+    else if (kernel != Kernel::Scalar && isSupported(Kernel::Sse2))
+    {
+        m_kernel = sse2Block;
+    }
+#else
+    Q_UNUSED(kernel);
+#endif
+}
+
+const char *VcdScanner::scan(const char *cursor, bool space)
+{
+    if (cursor >= m_block && cursor < m_blockEnd)
+    {
+        // The rest of the current block has been looked at already.
+        cursor = m_blockEnd;
+    }
+    while (cursor < m_end)
+    {
+        load(cursor);
+        const quint64 bits = space ? m_spaces : ~m_spaces & m_valid;
+        if (bits)
+        {
+            return cursor + countTrailingZeros(bits);
+        }
+        cursor = m_blockEnd;
+    }
+    return m_end;
+}
+
+void VcdScanner::load(const char *cursor)
+{
+    m_block = cursor;
+    if (m_end - cursor >= 64)
+    {
+        m_blockEnd = cursor + 64;
+        m_spaces = m_kernel(cursor);
+        m_valid = ~quint64(0);
+    }
+    else
+    {
+        // The tail of the input is shorter than a block, and reading past
+        // its end is not allowed.
+        const int count = static_cast<int>(m_end - cursor);
+        m_blockEnd = m_end;
+        m_spaces = scalarSpaces(cursor, count);
+        m_valid = (quint64(1) << count) - 1;
+    }
+}
+} // namespace fst
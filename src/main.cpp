@@ -1,19 +1,182 @@
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QString>
+#include <QTextStream>
 
+#include <limits>
+
+#include "benchmark.h"
 #include "main_window.h"
+#include "self_test.h"
+#include "signal_filter.h"
+#include "simple_fst_reader.h"
+#include "trace_writer.h"
+
+namespace
+{
+// Parses "start:end"; either side may be left out to keep that end open.
+bool parseWindow(const QString &text, qint64 &start, qint64 &end)
+{
+    const int colon = text.indexOf(QLatin1Char(':'));
+    if (colon < 0)
+    {
+        return false;
+    }
+    bool ok = true;
+    const QString first = text.left(colon).trimmed();
+    const QString second = text.mid(colon + 1).trimmed();
+    start = first.isEmpty() ? 0 : first.toLongLong(&ok);
+    if (ok && !second.isEmpty())
+    {
+        end = second.toLongLong(&ok);
+    }
+    return ok && start >= 0 && start <= end;
+}
+
+// Loads `trace` without opening the main window, restricted to the signal
+// filter and to [windowStart, windowEnd] so only what is exported is
+// decoded, and writes the selected signals over that window to `output`.
+int exportTrace(const QString &trace, const QString &output, const QStringList &signalFilter, qint64 windowStart, qint64 windowEnd)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    fst::LoadOptions options;
+    options.signalFilter = signalFilter;
+    if (windowStart > 0 || windowEnd != std::numeric_limits<qint64>::max())
+    {
+        options.windowStart = windowStart;
+        options.windowEnd = windowEnd;
+    }
+    fst::SimpleFstReader reader;
+    if (!reader.load(trace, options))
+    {
+        err << QObject::tr("Failed to load %1: %2").arg(trace, reader.lastError()) << '\n';
+        return 1;
+    }
+
+    QVector<int> handles = reader.selectedHandles();
+    if (signalFilter.isEmpty())
+    {
+        for (const fst::Signal &signal : reader.signalTable())
+        {
+            handles.append(signal.handle);
+        }
+    }
+    if (handles.isEmpty())
+    {
+        err << QObject::tr("No signal of %1 matches %2").arg(trace, signalFilter.join(QLatin1Char(','))) << '\n';
+        return 1;
+    }
+
+    fst::TraceWriter writer(reader.scopeTable(), reader.signalTable(), handles);
+    writer.setWindow(windowStart, windowEnd);
+    if (!writer.write(output, fst::TraceWriter::formatFor(output)))
+    {
+        err << QObject::tr("Failed to export %1: %2").arg(output, writer.errorString()) << '\n';
+        return 1;
+    }
+    out << QObject::tr("Exported %1 signals, %2 transitions to %3").arg(writer.signalCount()).arg(writer.transitionCount()).arg(output)
+        << '\n';
+    return 0;
+}
+} // namespace
 
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
+    QApplication::setApplicationName(QStringLiteral("gtkwave_cpp_clone"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QObject::tr("Waveform viewer for FST and VCD traces"));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("trace"), QObject::tr("Trace file(s) to open."), QStringLiteral("[trace...]"));
+    const QCommandLineOption benchmarkOption(QStringLiteral("benchmark"),
+                                             QObject::tr("Run the microbenchmarks and load the given traces without a window, printing throughput."));
+    const QCommandLineOption selfTestOption(QStringLiteral("self-test"),
+                                            QObject::tr("Run the behavioural checks of the loaders, the writer and the spill file, "
+                                                        "printing one line per check."));
+    const QCommandLineOption iterationsOption(QStringLiteral("iterations"), QObject::tr("Repeat each benchmark <n> times."),
+                                              QStringLiteral("n"), QStringLiteral("3"));
+    const QCommandLineOption signalsOption(QStringLiteral("signals"),
+                                           QObject::tr("Only decode the signals matching <patterns>: comma-separated wildcards on the "
+                                                       "hierarchical path (top.cpu.*) or one /regular expression/. May be repeated."),
+                                           QStringLiteral("patterns"));
+    const QCommandLineOption memoryBudgetOption(QStringLiteral("memory-budget"),
+                                                QObject::tr("Keep at most <MiB> of signal values in memory and spill the least recently "
+                                                            "used ones to a temporary file."),
+                                                QStringLiteral("MiB"), QStringLiteral("0"));
+    const QCommandLineOption writeCacheOption(QStringLiteral("write-cache"),
+                                              QObject::tr("Decode every value when opening a trace and write a cache that "
+                                                          "makes later opens of it instant, instead of opening lazily."));
+    const QCommandLineOption exportOption(QStringLiteral("export"),
+                                          QObject::tr("Write the signals selected by --signals (all when not given) of the trace to "
+                                                      "<file>, as FST when it ends in .fst and as VCD otherwise, without opening the main window."),
+                                          QStringLiteral("file"));
+    const QCommandLineOption windowOption(QStringLiteral("window"),
+                                          QObject::tr("Only export the changes from <start> to <end>, in the time units of the trace."),
+                                          QStringLiteral("start:end"));
+    parser.addOption(benchmarkOption);
+    parser.addOption(selfTestOption);
+    parser.addOption(iterationsOption);
+    parser.addOption(signalsOption);
+    parser.addOption(memoryBudgetOption);
+    parser.addOption(writeCacheOption);
+    parser.addOption(exportOption);
+    parser.addOption(windowOption);
+    parser.process(app);
+
+    const QStringList traces = parser.positionalArguments();
+    QStringList signalFilter;
+    for (const QString &value : parser.values(signalsOption))
+    {
+        signalFilter += fst::SignalFilter::splitPatterns(value);
+    }
+    if (parser.isSet(benchmarkOption))
+    {
+        const int iterations = qMax(1, parser.value(iterationsOption).toInt());
+        int result = benchmark::runSignalTableBenchmark(iterations);
+        result |= benchmark::runPaintBenchmark(iterations);
+        if (!traces.isEmpty())
+        {
+            result |= benchmark::runLoadBenchmark(traces, iterations, signalFilter);
+        }
+        return result;
+    }
+
+    if (parser.isSet(selfTestOption))
+    {
+        return selftest::runSelfTests();
+    }
+
+    if (parser.isSet(exportOption))
+    {
+        QTextStream err(stderr);
+        if (traces.size() != 1)
+        {
+            err << QObject::tr("--export needs exactly one trace") << '\n';
+            return 1;
+        }
+        qint64 windowStart = 0;
+        qint64 windowEnd = std::numeric_limits<qint64>::max();
+        if (parser.isSet(windowOption) && !parseWindow(parser.value(windowOption), windowStart, windowEnd))
+        {
+            err << QObject::tr("Invalid --window %1, expected start:end").arg(parser.value(windowOption)) << '\n';
+            return 1;
+        }
+        return exportTrace(traces.first(), parser.value(exportOption), signalFilter, windowStart, windowEnd);
+    }
 
     MainWindow window;
     window.resize(1280, 720);
+    window.setSignalFilter(signalFilter);
+    window.setMemoryBudget(qMax<qint64>(0, parser.value(memoryBudgetOption).toLongLong()) * 1024 * 1024);
+    window.setCacheWriting(parser.isSet(writeCacheOption));
     window.show();
 
-    if (argc > 1)
+    if (!traces.isEmpty())
     {
-        window.openFstFile(QString::fromLocal8Bit(argv[1]));
+        window.openFstFile(traces.first());
     }
 
     return app.exec();
@@ -0,0 +1,88 @@
+#include "parallel.h"
+
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
+namespace parallel
+{
+namespace
+{
+struct LoopState
+{
+    LoopState(int count, const std::function<void(int)> &body)
+        : count(count)
+        , body(body)
+    {
+    }
+
+    void drain()
+    {
+        for (int index = next.fetchAndAddRelaxed(1); index < count; index = next.fetchAndAddRelaxed(1))
+        {
+            body(index);
+        }
+    }
+
+    const int count;
+    const std::function<void(int)> &body;
+    QAtomicInt next = 0;
+    QSemaphore finished;
+};
+
+class LoopWorker : public QRunnable
+{
+public:
+    explicit LoopWorker(LoopState &state)
+        : m_state(state)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        m_state.drain();
+        m_state.finished.release();
+    }
+
+private:
+    LoopState &m_state;
+};
+} // namespace
+
+int threadCount()
+{
+    return qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+}
+
+void forEach(int count, const std::function<void(int)> &body)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    if (count == 1)
+    {
+        body(0);
+        return;
+    }
+
+    LoopState state(count, body);
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const int wanted = qMin(count, threadCount()) - 1;
+    int started = 0;
+    for (; started < wanted; ++started)
+    {
+        LoopWorker *worker = new LoopWorker(state);
+        if (!pool->tryStart(worker))
+        {
+            delete worker;
+            break;
+        }
+    }
+
+    state.drain();
+    state.finished.acquire(started);
+}
+} // namespace parallel
@@ -0,0 +1,601 @@
+#include "self_test.h"
+
+#include "simple_fst_reader.h"
+#include "spill_file.h"
+#include "trace_cache.h"
+#include "trace_writer.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QVector>
+
+#include <vector>
+
+namespace selftest
+{
+namespace
+{
+// Large enough for the parallel VCD load to cut the value section into
+// several slices, and the lazy index into a few dozen blocks.
+constexpr int kSliceSteps = 200000;
+// Every that many steps the generated VCD holds a $comment block of
+// kCommentLines lines that look like timestamps followed by changes. The
+// blocks take most of the file, so most cuts are first tried inside one.
+constexpr int kCommentEvery = 16;
+constexpr int kCommentLines = 64;
+// A $dumpall block every that many steps.
+constexpr int kDumpallEvery = 1000;
+// Every that many steps the timestamp of the previous step is repeated.
+constexpr int kRepeatTimeEvery = 97;
+// Once halfway, a vector holds a '-' bit every that many steps.
+constexpr int kDontCareEvery = 3000;
+// A signal changing this rarely is only found in a few index blocks.
+constexpr int kRareEvery = 60000;
+
+using Check = bool (*)(const QString &directory, QString &error);
+
+// Compares two stores entry by entry through their displayed values.
+bool sameValues(const fst::ValueStore &actual, const fst::ValueStore &expected, const QString &name, QString &error)
+{
+    if (actual.size() != expected.size())
+    {
+        error = QStringLiteral("%1: %2 changes, expected %3").arg(name).arg(actual.size()).arg(expected.size());
+        return false;
+    }
+    for (auto a = actual.begin(), e = expected.begin(); e != expected.end(); ++a, ++e)
+    {
+        if (a.time() != e.time() || a.text() != e.text())
+        {
+            error = QStringLiteral("%1: change %2 is %3 at %4, expected %5 at %6")
+                        .arg(name)
+                        .arg(e.index())
+                        .arg(a.text())
+                        .arg(a.time())
+                        .arg(e.text())
+                        .arg(e.time());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checks that `reader` holds every signal of `signalTable`, by path, with
+// the same values.
+bool sameTrace(const fst::SimpleFstReader &reader, const fst::ScopeTable &scopeTable, const fst::SignalTable &signalTable,
+               QString &error)
+{
+    QHash<QString, const fst::Signal *> loaded;
+    for (const fst::Signal &signal : reader.signalTable())
+    {
+        loaded.insert(reader.scopeTable().signalPath(signal), &signal);
+    }
+    for (const fst::Signal &signal : signalTable)
+    {
+        const QString path = scopeTable.signalPath(signal);
+        const fst::Signal *actual = loaded.value(path);
+        if (!actual)
+        {
+            error = QStringLiteral("%1 is missing").arg(path);
+            return false;
+        }
+        if (!actual->valuesLoaded)
+        {
+            error = QStringLiteral("%1 is not loaded").arg(path);
+            return false;
+        }
+        if (!sameValues(actual->values, signal.values, path, error))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool load(fst::SimpleFstReader &reader, const QString &path, const fst::LoadOptions &options, QString &error)
+{
+    if (!reader.load(path, options))
+    {
+        error = QStringLiteral("loading %1: %2").arg(path, reader.lastError());
+        return false;
+    }
+    return true;
+}
+
+// A small trace with a signal of every store kind and an alias. Every
+// signal has a value at time 0, as after a $dumpvars: an FST frame holds X
+// or NaN for a signal without one, which would read back as a change.
+void buildSmallTrace(fst::ScopeTable &scopeTable, fst::SignalTable &signalTable)
+{
+    const int top = scopeTable.addScope(fst::ScopeTable::kRoot, QStringLiteral("top"), QStringLiteral("module"));
+    const int sub = scopeTable.addScope(top, QStringLiteral("sub"), QStringLiteral("module"));
+    // The signals are filled in through references into the table.
+    signalTable.reserve(5);
+    const auto add = [&](int handle, const char *name, int scope, const char *type, int width) -> fst::Signal & {
+        fst::Signal signal;
+        signal.handle = handle;
+        signal.name = QString::fromLatin1(name);
+        signal.scope = scope;
+        signal.type = QString::fromLatin1(type);
+        signal.bitWidth = width;
+        signal.values = fst::ValueStore(fst::ValueStore::kindFor(signal.type, width, false), width);
+        signalTable.insert(signal);
+        scopeTable.addSignal(scope, handle);
+        return *signalTable.find(handle);
+    };
+
+    fst::Signal &clock = add(1, "clk", top, "wire", 1);
+    for (int time = 0; time < 40; time += 5)
+    {
+        clock.values.appendScalar(time, (time / 5) % 2 ? '1' : '0');
+    }
+    fst::Signal &bus = add(2, "bus", top, "reg", 8);
+    bus.values.append(0, "xxxxxxxx", 8);
+    bus.values.append(7, "00001010", 8);
+    bus.values.append(12, "1z0x1111", 8);
+    bus.values.append(30, "00000000", 8);
+    fst::Signal &real = add(3, "r", sub, "real", 64);
+    real.values.append(0, "0.5", 3);
+    real.values.append(3, "1.5", 3);
+    real.values.append(22, "-2.25", 5);
+    fst::Signal &state = add(4, "state", sub, "string", 1);
+    state.values.append(0, QStringLiteral("IDLE"));
+    state.values.append(18, QStringLiteral("RUN"));
+    state.values.append(33, QStringLiteral("DONE"));
+    fst::Signal &alias = add(5, "clk_alias", sub, "wire", 1);
+    alias.aliasOf = 1;
+    alias.values = clock.values;
+}
+
+QVector<int> allHandles(const fst::SignalTable &signalTable)
+{
+    QVector<int> handles;
+    for (const fst::Signal &signal : signalTable)
+    {
+        handles.append(signal.handle);
+    }
+    return handles;
+}
+
+// Exports the small trace as VCD and FST and reads both back, which covers
+// the FST encoding of reals and variable-length strings both ways.
+bool checkWriterRoundTrip(const QString &directory, QString &error)
+{
+    fst::ScopeTable scopeTable;
+    fst::SignalTable signalTable;
+    buildSmallTrace(scopeTable, signalTable);
+    fst::TraceWriter writer(scopeTable, signalTable, allHandles(signalTable));
+    for (const QString &name : {QStringLiteral("round_trip.vcd"), QStringLiteral("round_trip.fst")})
+    {
+        const QString path = directory + QLatin1Char('/') + name;
+        if (!writer.write(path, fst::TraceWriter::formatFor(path)))
+        {
+            error = QStringLiteral("writing %1: %2").arg(name, writer.errorString());
+            return false;
+        }
+        fst::SimpleFstReader reader;
+        if (!load(reader, path, fst::LoadOptions(), error) || !sameTrace(reader, scopeTable, signalTable, error))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A full load writes the sidecar, the next load maps it, and a load after
+// the trace changed parses the trace again.
+bool checkTraceCache(const QString &directory, QString &error)
+{
+    fst::ScopeTable scopeTable;
+    fst::SignalTable signalTable;
+    buildSmallTrace(scopeTable, signalTable);
+    const QString path = directory + QStringLiteral("/cached.vcd");
+    fst::TraceWriter writer(scopeTable, signalTable, allHandles(signalTable));
+    if (!writer.write(path, fst::TraceWriter::Format::Vcd))
+    {
+        error = QStringLiteral("writing %1: %2").arg(path, writer.errorString());
+        return false;
+    }
+
+    fst::LoadOptions options;
+    options.useCache = true;
+    options.cacheDirectory = directory;
+    for (bool expectCache : {false, true})
+    {
+        fst::SimpleFstReader reader;
+        if (!load(reader, path, options, error) || !sameTrace(reader, scopeTable, signalTable, error))
+        {
+            return false;
+        }
+        if (reader.loadStatistics().fromCache != expectCache)
+        {
+            error = expectCache ? QStringLiteral("the second load did not use the cache") : QStringLiteral("the first load used a cache");
+            return false;
+        }
+        if (!QFile::exists(fst::TraceCache::cachePath(path, directory)))
+        {
+            error = QStringLiteral("no cache was written");
+            return false;
+        }
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::Append) || file.write("$comment edited $end\n") < 0)
+    {
+        error = QStringLiteral("cannot append to %1").arg(path);
+        return false;
+    }
+    file.close();
+    fst::SimpleFstReader reader;
+    if (!load(reader, path, options, error))
+    {
+        return false;
+    }
+    if (reader.loadStatistics().fromCache)
+    {
+        error = QStringLiteral("a stale cache was used");
+        return false;
+    }
+    return true;
+}
+
+// Generated VCD whose value section the parallel load cuts into slices.
+// Cuts may be tried inside $comment blocks full of lines starting with '#',
+// timestamps repeat so that a slice can start at the time the previous one
+// ended with, $dumpall blocks add changes outside of timestamps and one
+// vector, written without its leading zeros, turns into text halfway. The
+// expected stores are built by appending the same values in file order, as
+// a serial load would.
+struct SliceTrace
+{
+    QStringList names;
+    std::vector<fst::ValueStore> expected;
+};
+
+bool writeSliceTrace(const QString &path, SliceTrace &trace, QString &error)
+{
+    // name, VCD type, width, identifier
+    struct Declaration
+    {
+        const char *name;
+        const char *type;
+        int width;
+        char identifier;
+    };
+    const Declaration declarations[] = {
+        {"clk", "wire", 1, '!'}, {"bus", "wire", 8, '"'}, {"r", "real", 64, '#'}, {"mixed", "wire", 4, '$'}, {"rare", "wire", 1, '%'},
+    };
+    enum
+    {
+        Clock,
+        Bus,
+        Real,
+        Mixed,
+        Rare
+    };
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        error = QStringLiteral("cannot write %1").arg(path);
+        return false;
+    }
+    QByteArray text = "$timescale 1ns $end\n$scope module top $end\n";
+    for (const Declaration &declaration : declarations)
+    {
+        text += "$var " + QByteArray(declaration.type) + ' ' + QByteArray::number(declaration.width) + ' ' + declaration.identifier + ' ' +
+                declaration.name + " $end\n";
+        trace.names.append(QStringLiteral("top.") + QString::fromLatin1(declaration.name));
+        trace.expected.emplace_back(fst::ValueStore::kindFor(QString::fromLatin1(declaration.type), declaration.width, false),
+                                    declaration.width);
+    }
+    text += "$upscope $end\n$enddefinitions $end\n";
+
+    qint64 time = 0;
+    const auto change = [&](int signal, const QByteArray &value) {
+        const Declaration &declaration = declarations[signal];
+        if (declaration.width == 1)
+        {
+            text += value + declaration.identifier + '\n';
+        }
+        else
+        {
+            text += (signal == Real ? 'r' : 'b') + value + ' ' + declaration.identifier + '\n';
+        }
+        trace.expected[static_cast<size_t>(signal)].append(time, value.constData(), value.size());
+    };
+    quint32 state = 0x2545f491u;
+    const auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    };
+    const auto bits = [&random](int width, const char *alphabet, quint32 choices) {
+        QByteArray value(width, '0');
+        for (char &bit : value)
+        {
+            bit = alphabet[random() % choices];
+        }
+        return value;
+    };
+
+    text += "$dumpvars\n";
+    change(Clock, "0");
+    change(Bus, bits(8, "01xz", 4));
+    change(Real, "0");
+    change(Mixed, "0000");
+    change(Rare, "0");
+    text += "$end\n";
+    for (int step = 1; step <= kSliceSteps; ++step)
+    {
+        if (step % kRepeatTimeEvery != 0)
+        {
+            time += 1 + random() % 3;
+        }
+        text += '#' + QByteArray::number(time) + '\n';
+        change(Clock, step % 2 ? "1" : "0");
+        if (random() % 2)
+        {
+            change(Bus, bits(8, "01xz", random() % 8 ? 2 : 4));
+        }
+        if (step % 5 == 0)
+        {
+            change(Real, QByteArray::number((static_cast<int>(random() % 2001) - 1000) / 8.0, 'g', 10));
+        }
+        if (step % 3 == 0)
+        {
+            // Rare don't-care bits leave slices whose stores of it are
+            // still vectors after the signal has turned to text.
+            QByteArray value = step > kSliceSteps / 2 && step % kDontCareEvery == 0 ? QByteArray("1-") : bits(4, "01", 2);
+            while (value.size() > 1 && value.startsWith('0'))
+            {
+                value.remove(0, 1);
+            }
+            change(Mixed, value);
+        }
+        if (step % kRareEvery == 0)
+        {
+            change(Rare, step / kRareEvery % 2 ? "1" : "0");
+        }
+        if (step % kCommentEvery == 0)
+        {
+            text += "$comment\n";
+            for (int line = 1; line <= kCommentLines; ++line)
+            {
+                text += '#' + QByteArray::number(time + line) + " 1! 1% b11111111 \"\n";
+            }
+            text += "$end\n";
+        }
+        if (step % kDumpallEvery == 0)
+        {
+            text += "$dumpall\n";
+            change(Clock, step % 2 ? "1" : "0");
+            change(Mixed, "1010");
+            text += "$end\n";
+        }
+        if (text.size() > (1 << 20))
+        {
+            if (file.write(text) != text.size())
+            {
+                error = QStringLiteral("cannot write %1").arg(path);
+                return false;
+            }
+            text.clear();
+        }
+    }
+    if (file.write(text) != text.size())
+    {
+        error = QStringLiteral("cannot write %1").arg(path);
+        return false;
+    }
+    return true;
+}
+
+// Lets parallel loops use at least four threads while in scope, so that
+// the sliced load paths run on machines with fewer cores too.
+class FourThreads
+{
+public:
+    FourThreads()
+        : m_threads(QThreadPool::globalInstance()->maxThreadCount())
+    {
+        QThreadPool::globalInstance()->setMaxThreadCount(qMax(m_threads, 4));
+    }
+
+    ~FourThreads()
+    {
+        QThreadPool::globalInstance()->setMaxThreadCount(m_threads);
+    }
+
+private:
+    const int m_threads;
+};
+
+const fst::Signal *findSignal(const fst::SimpleFstReader &reader, const QString &path)
+{
+    for (const fst::Signal &signal : reader.signalTable())
+    {
+        if (reader.scopeTable().signalPath(signal) == path)
+        {
+            return &signal;
+        }
+    }
+    return nullptr;
+}
+
+bool sameSliceTrace(const fst::SimpleFstReader &reader, const SliceTrace &trace, QString &error)
+{
+    for (int i = 0; i < trace.names.size(); ++i)
+    {
+        const fst::Signal *signal = findSignal(reader, trace.names.at(i));
+        if (!signal)
+        {
+            error = QStringLiteral("%1 is missing").arg(trace.names.at(i));
+            return false;
+        }
+        if (!sameValues(signal->values, trace.expected[static_cast<size_t>(i)], trace.names.at(i), error))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Loads the generated VCD in parallel slices, whatever the machine's core
+// count, and compares it with the serial result.
+bool checkVcdSlices(const QString &directory, QString &error)
+{
+    const QString path = directory + QStringLiteral("/slices.vcd");
+    SliceTrace trace;
+    if (!writeSliceTrace(path, trace, error))
+    {
+        return false;
+    }
+
+    FourThreads threads;
+    fst::SimpleFstReader reader;
+    return load(reader, path, fst::LoadOptions(), error) && sameSliceTrace(reader, trace, error);
+}
+
+// Opens the generated VCD lazily and decodes the rare signal alone, which
+// parses only the index blocks it changes in, then the rest in slices.
+bool checkLazyIndex(const QString &directory, QString &error)
+{
+    const QString path = directory + QStringLiteral("/lazy.vcd");
+    SliceTrace trace;
+    if (!writeSliceTrace(path, trace, error))
+    {
+        return false;
+    }
+
+    FourThreads threads;
+    fst::LoadOptions options;
+    options.lazy = true;
+    fst::SimpleFstReader reader;
+    if (!load(reader, path, options, error))
+    {
+        return false;
+    }
+    const fst::Signal *rare = findSignal(reader, QStringLiteral("top.rare"));
+    if (!rare || rare->valuesLoaded)
+    {
+        error = QStringLiteral("top.rare is missing or was decoded while opening");
+        return false;
+    }
+    if (!reader.ensureLoaded({rare->handle}))
+    {
+        error = reader.lastError();
+        return false;
+    }
+    if (!sameValues(rare->values, trace.expected.back(), QStringLiteral("top.rare"), error))
+    {
+        return false;
+    }
+    if (!reader.ensureLoaded(allHandles(reader.signalTable())))
+    {
+        error = reader.lastError();
+        return false;
+    }
+    return sameSliceTrace(reader, trace, error);
+}
+
+fst::ValueStore scalarRun(int changes, int phase)
+{
+    fst::ValueStore values(fst::ValueStore::Kind::Scalar, 1);
+    for (int i = 0; i < changes; ++i)
+    {
+        values.appendScalar(i * 2, (i + phase) % 2 ? '1' : '0');
+    }
+    return values;
+}
+
+// A batch that fits the space freed by another takes it instead of growing
+// the file, and freeing the last batch shrinks it.
+bool checkSpillReuse(const QString &directory, QString &error)
+{
+    fst::SpillFile spill(directory);
+    std::vector<fst::ValueStore> stores;
+    for (int i = 0; i < 3; ++i)
+    {
+        stores.push_back(scalarRun(50000, i));
+    }
+    for (fst::ValueStore &values : stores)
+    {
+        if (!spill.spill({&values}))
+        {
+            error = spill.errorString();
+            return false;
+        }
+    }
+    const qint64 size = spill.size();
+
+    stores[1] = fst::ValueStore();
+    fst::ValueStore smaller = scalarRun(20000, 7);
+    if (!spill.spill({&smaller}))
+    {
+        error = spill.errorString();
+        return false;
+    }
+    if (spill.size() != size)
+    {
+        error = QStringLiteral("the file grew from %1 to %2 bytes with free space left").arg(size).arg(spill.size());
+        return false;
+    }
+    if (!sameValues(smaller, scalarRun(20000, 7), QStringLiteral("reused batch"), error) ||
+        !sameValues(stores[0], scalarRun(50000, 0), QStringLiteral("first batch"), error) ||
+        !sameValues(stores[2], scalarRun(50000, 2), QStringLiteral("last batch"), error))
+    {
+        return false;
+    }
+
+    stores[2] = fst::ValueStore();
+    if (spill.size() >= size)
+    {
+        error = QStringLiteral("freeing the last batch left the file at %1 bytes").arg(spill.size());
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+int runSelfTests()
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QTemporaryDir directory;
+    if (!directory.isValid())
+    {
+        err << QObject::tr("Cannot create a temporary directory for the self tests") << '\n';
+        return 1;
+    }
+
+    const QPair<const char *, Check> checks[] = {
+        {"writer round trip", checkWriterRoundTrip},
+        {"trace cache", checkTraceCache},
+        {"vcd slices", checkVcdSlices},
+        {"lazy index", checkLazyIndex},
+        {"spill reuse", checkSpillReuse},
+    };
+    int failures = 0;
+    for (const auto &check : checks)
+    {
+        QString error;
+        if (check.second(directory.path(), error))
+        {
+            out << QStringLiteral("PASS %1").arg(QString::fromLatin1(check.first)) << '\n';
+        }
+        else
+        {
+            out << QStringLiteral("FAIL %1: %2").arg(QString::fromLatin1(check.first), error) << '\n';
+            ++failures;
+        }
+    }
+    out.flush();
+    return failures == 0 ? 0 : 1;
+}
+} // namespace selftest
@@ -4,6 +4,7 @@
 #include <QApplication>
 #include <QCloseEvent>
 #include <QFileDialog>
+#include <QFileSystemWatcher>
 #include <QColor>
 #include <QIcon>
 #include <QLabel>
@@ -12,9 +13,11 @@
 #include <QMenuBar>
 #include <QMessageBox>
 #include <QPalette>
+#include <QProgressBar>
 #include <QShortcut>
 #include <QSplitter>
 #include <QStatusBar>
+#include <QTimer>
 #include <QToolBar>
 #include <QVBoxLayout>
 
@@ -22,6 +25,7 @@ namespace
 {
 constexpr int kDefaultWidth = 1280;
 constexpr int kDefaultHeight = 720;
+constexpr int kFollowIntervalMs = 250;
 }
 
 MainWindow::MainWindow(QWidget *parent)
@@ -32,7 +36,9 @@ MainWindow::MainWindow(QWidget *parent)
 
     QWidget *leftPane = createLeftPane();
     m_waveformView = new WaveformView(this);
-
+    m_loader = new TraceLoader(this);
+    m_exporter = new TraceExporter(this);
+    
     QSplitter *splitter = new QSplitter(this);
     splitter->setObjectName(QStringLiteral("workspaceSplitter"));
     splitter->addWidget(leftPane);
@@ -48,7 +54,27 @@ MainWindow::MainWindow(QWidget *parent)
 
     connect(m_signalTree, &SignalTree::signalActivated, this, &MainWindow::addSignalToWaveform);
     connect(m_waveformView, &WaveformView::cursorMoved, this, &MainWindow::updateStatusBar);
+    connect(m_waveformView, &WaveformView::visibleSignalsChanged, this, &MainWindow::touchVisibleSignals);
     connect(m_filterEdit, &QLineEdit::textChanged, this, &MainWindow::filterSignals);
+    connect(m_loader, &TraceLoader::hierarchyReady, this, &MainWindow::showLoadedHierarchy);
+    connect(m_loader, &TraceLoader::progress, this, &MainWindow::showLoadProgress);
+    connect(m_loader, &TraceLoader::finished, this, &MainWindow::finishLoading);
+    connect(m_exporter, &TraceExporter::progress, this, &MainWindow::showExportProgress);
+    connect(m_exporter, &TraceExporter::finished, this, &MainWindow::finishExport);
+
+    // A running simulation writes in bursts; changes are picked up at most
+    // once per interval.
+    m_fileWatcher = new QFileSystemWatcher(this);
+    m_followTimer = new QTimer(this);
+    m_followTimer->setSingleShot(true);
+    m_followTimer->setInterval(kFollowIntervalMs);
+    connect(m_fileWatcher, &QFileSystemWatcher::fileChanged, this, [this]() {
+        if (!m_followTimer->isActive())
+        {
+            m_followTimer->start();
+        }
+    });
+    connect(m_followTimer, &QTimer::timeout, this, &MainWindow::readAppendedData);
 
     auto *focusSearchShortcut = new QShortcut(QKeySequence::Find, this);
     connect(focusSearchShortcut, &QShortcut::activated, this, [this]() {
@@ -76,6 +102,20 @@ void MainWindow::createActions()
     m_openAction->setShortcut(QKeySequence::Open);
     connect(m_openAction, &QAction::triggered, this, &MainWindow::openFstFileDialog);
 
+    m_cancelLoadAction = new QAction(QIcon::fromTheme(QStringLiteral("process-stop")), tr("&Cancel Loading"), this);
+    m_cancelLoadAction->setShortcut(QKeySequence(Qt::Key_Escape));
+    m_cancelLoadAction->setEnabled(false);
+    // Stops whichever of a load or an export is running.
+    connect(m_cancelLoadAction, &QAction::triggered, this, [this]() {
+        m_loader->cancel();
+        m_exporter->cancel();
+    });
+
+    m_exportAction = new QAction(QIcon::fromTheme(QStringLiteral("document-save-as")), tr("&Export Signals…"), this);
+    m_exportAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_E));
+    m_exportAction->setToolTip(tr("Write the signals shown in the waveform to a VCD or FST file, between the cursors when both are set"));
+    connect(m_exportAction, &QAction::triggered, this, &MainWindow::exportSignalsDialog);
+
     m_exitAction = new QAction(tr("E&xit"), this);
     m_exitAction->setShortcut(QKeySequence::Quit);
     connect(m_exitAction, &QAction::triggered, this, &QWidget::close);
@@ -91,12 +131,19 @@ void MainWindow::createActions()
     m_resetViewAction = new QAction(QIcon::fromTheme(QStringLiteral("view-refresh")), tr("Reset View"), this);
     m_resetViewAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_0));
     connect(m_resetViewAction, &QAction::triggered, m_waveformView, &WaveformView::resetView);
+
+    m_followAction = new QAction(QIcon::fromTheme(QStringLiteral("media-playback-start")), tr("&Follow File"), this);
+    m_followAction->setCheckable(true);
+    m_followAction->setToolTip(tr("Show data appended to the open VCD file while a simulation is writing it"));
+    connect(m_followAction, &QAction::toggled, this, &MainWindow::setFollowEnabled);
 }
 
 void MainWindow::createMenus()
 {
     QMenu *fileMenu = menuBar()->addMenu(tr("&File"));
     fileMenu->addAction(m_openAction);
+    fileMenu->addAction(m_cancelLoadAction);
+    fileMenu->addAction(m_exportAction);
     fileMenu->addSeparator();
     fileMenu->addAction(m_exitAction);
 
@@ -104,6 +151,8 @@ void MainWindow::createMenus()
     viewMenu->addAction(m_zoomInAction);
     viewMenu->addAction(m_zoomOutAction);
     viewMenu->addAction(m_resetViewAction);
+    viewMenu->addSeparator();
+    viewMenu->addAction(m_followAction);
 }
 
 void MainWindow::createToolBars()
@@ -111,12 +160,14 @@ void MainWindow::createToolBars()
     QToolBar *fileBar = addToolBar(tr("File"));
     fileBar->setMovable(false);
     fileBar->addAction(m_openAction);
+    fileBar->addAction(m_cancelLoadAction);
 
     QToolBar *viewBar = addToolBar(tr("View"));
     viewBar->setMovable(false);
     viewBar->addAction(m_zoomInAction);
     viewBar->addAction(m_zoomOutAction);
     viewBar->addAction(m_resetViewAction);
+    viewBar->addAction(m_followAction);
 }
 
 void MainWindow::createStatusBar()
@@ -125,6 +176,13 @@ void MainWindow::createStatusBar()
     m_primaryCursorLabel = new QLabel(tr("Time: —"), this);
     m_referenceCursorLabel = new QLabel(tr("Baseline: —"), this);
     m_deltaLabel = new QLabel(tr("Δ: —"), this);
+    m_loadProgress = new QProgressBar(this);
+    m_loadProgress->setRange(0, 1000);
+    m_loadProgress->setTextVisible(false);
+    m_loadProgress->setMaximumWidth(160);
+    m_loadProgress->hide();
+
+    statusBar()->addPermanentWidget(m_loadProgress);
 
     statusBar()->addPermanentWidget(m_primaryCursorLabel);
     statusBar()->addPermanentWidget(m_referenceCursorLabel);
@@ -191,34 +249,317 @@ void MainWindow::openFstFile(const QString &filePath)
     loadFstFile(filePath);
 }
 
+void MainWindow::setSignalFilter(const QStringList &patterns)
+{
+    m_signalFilter = patterns;
+}
+
+void MainWindow::setMemoryBudget(qint64 bytes)
+{
+    m_memoryBudget = bytes;
+}
+
+void MainWindow::setCacheWriting(bool enabled)
+{
+    m_writeCache = enabled;
+}
+
 void MainWindow::openFstFileDialog()
 {
-    const QString filePath = QFileDialog::getOpenFileName(this, tr("Open FST File"), QString(), tr("FST Files (*.fst);;VCD Files (*.vcd);;All Files (*.*)"));
+    const QString filePath = QFileDialog::getOpenFileName(this, tr("Open FST File"), QString(), tr("FST Files (*.fst);;VCD Files (*.vcd *.vcd.gz *.vcd.zst);;All Files (*.*)"));
     openFstFile(filePath);
 }
 
-void MainWindow::loadFstFile(const QString &filePath)
+void MainWindow::loadFstFile(const QString &filePath, bool keepSignals)
 {
-    if (!m_reader.load(filePath))
+    // The previous trace is released before the new one is read. Waveform
+    // rows only hold handles and are resolved again when loading finishes.
+    m_signalTree->clear();
+    if (!keepSignals)
     {
-        QMessageBox::critical(this, tr("Unable to Load"), tr("Failed to load trace file: %1").arg(m_reader.lastError()));
+        m_waveformView->clearSignals();
+    }
+    m_waveformView->setSignalSource(nullptr, nullptr);
+    m_reader = std::make_unique<fst::SimpleFstReader>();
+    m_currentFile.clear();
+    updateWatchedFile();
+
+    // A trace with a valid cache is mapped from it. Otherwise only the
+    // hierarchy is read and values are decoded as signals are added, unless
+    // cache writing was asked for: then every value is decoded now and the
+    // cache is written for next time. A signal filter bypasses the cache and
+    // decodes just its matches.
+    fst::LoadOptions options;
+    options.lazy = !m_writeCache;
+    options.useCache = true;
+    options.follow = m_followAction->isChecked();
+    options.signalFilter = m_signalFilter;
+    options.memoryBudget = m_memoryBudget;
+    m_loader->start(filePath, options);
+
+    m_cancelLoadAction->setEnabled(true);
+    m_loadProgress->setValue(0);
+    m_loadProgress->show();
+    statusBar()->showMessage(tr("Loading %1…").arg(filePath));
+}
+
+void MainWindow::showLoadedHierarchy()
+{
+    m_signalTree->populate(m_loader->scopeTable(), m_loader->signalTable());
+}
+
+void MainWindow::showLoadProgress(const fst::LoadProgress &progress)
+{
+    if (progress.totalBytes > 0)
+    {
+        m_loadProgress->setValue(static_cast<int>(qBound<qint64>(0, progress.bytesRead * 1000 / progress.totalBytes, 1000)));
+    }
+    statusBar()->showMessage(tr("Loading %1: %2 signals, %3 transitions")
+                                 .arg(m_loader->filePath())
+                                 .arg(progress.signalCount)
+                                 .arg(progress.transitionCount));
+}
+
+void MainWindow::finishLoading(bool ok, bool canceled, const QString &error)
+{
+    m_cancelLoadAction->setEnabled(m_exporter->isRunning());
+    m_loadProgress->setVisible(m_exporter->isRunning());
+    if (!ok)
+    {
+        m_signalTree->clear();
+        m_waveformView->clearSignals();
+        if (canceled)
+        {
+            statusBar()->showMessage(tr("Loading %1 was canceled").arg(m_loader->filePath()), 4000);
+        }
+        else
+        {
+            statusBar()->clearMessage();
+            QMessageBox::critical(this, tr("Unable to Load"), tr("Failed to load trace file: %1").arg(error));
+        }
         return;
     }
 
-    m_signalTree->clear();
-    m_waveformView->clearSignals();
-    m_signalTree->populate(m_reader.rootScope(), m_reader.signalMap());
-    const qint64 maxTime = qMax<qint64>(100, m_reader.maxTime());
+    m_reader = m_loader->takeReader();
+    m_currentFile = m_loader->filePath();
+    m_waveformView->setSignalSource(&m_reader->signalTable(), &m_reader->scopeTable());
+    updateWatchedFile();
+
+    // Rows added while loading, or kept across a reload, are decoded now.
+    // Handles are assigned in declaration order, so they survive a reload
+    // of the same trace.
+    const QVector<int> handles = m_waveformView->signalHandles();
+    for (int handle : handles)
+    {
+        if (!m_reader->signalTable().contains(handle))
+        {
+            m_waveformView->removeSignal(handle);
+        }
+    }
+    if (!m_reader->ensureLoaded(handles))
+    {
+        QMessageBox::warning(this, tr("Unable to Load"), tr("Failed to read signal values: %1").arg(m_reader->lastError()));
+    }
+    m_waveformView->requestSummaries();
+
+    // A filtered load shows its selection unless rows were kept.
+    if (m_waveformView->signalHandles().isEmpty())
+    {
+        for (int handle : m_reader->selectedHandles())
+        {
+            m_waveformView->addSignal(handle);
+        }
+    }
+
+    const qint64 maxTime = qMax<qint64>(100, m_reader->maxTime());
     m_waveformView->setTimeRange(0, maxTime == 0 ? 100 : maxTime);
     m_lastPrimaryTime = -1;
     m_lastReferenceTime = -1;
     updateStatusBar(-1, 0);
-    statusBar()->showMessage(tr("Loaded %1").arg(filePath), 4000);
+    const fst::LoadStatistics &stats = m_reader->loadStatistics();
+    const QString message = stats.fromCache ? tr("Opened %1 from cache in %2 ms") : tr("Opened %1 in %2 ms");
+    statusBar()->showMessage(message.arg(m_currentFile).arg(stats.elapsedNs / 1e6, 0, 'f', 1), 4000);
+}
+
+void MainWindow::exportSignalsDialog()
+{
+    if (m_exporter->isRunning())
+    {
+        QMessageBox::information(this, tr("Export Signals"), tr("An export to %1 is still running.").arg(m_exporter->filePath()));
+        return;
+    }
+    if (m_loader->isRunning() || m_currentFile.isEmpty())
+    {
+        QMessageBox::information(this, tr("Export Signals"), tr("Open a trace before exporting signals."));
+        return;
+    }
+    const QVector<int> handles = m_waveformView->signalHandles();
+    if (handles.isEmpty())
+    {
+        QMessageBox::information(this, tr("Export Signals"), tr("Add the signals to export to the waveform first."));
+        return;
+    }
+
+    const QString filePath = QFileDialog::getSaveFileName(this, tr("Export Signals"), QString(), tr("VCD Files (*.vcd);;FST Files (*.fst)"));
+    if (filePath.isEmpty())
+    {
+        return;
+    }
+    if (!m_reader->ensureLoaded(handles))
+    {
+        QMessageBox::warning(this, tr("Unable to Export"), tr("Failed to read signal values: %1").arg(m_reader->lastError()));
+        return;
+    }
+
+    // With both cursors placed, only the changes between them are written.
+    auto writer = std::make_unique<fst::TraceWriter>(m_reader->scopeTable(), m_reader->signalTable(), handles);
+    const qint64 reference = m_waveformView->referenceCursor();
+    const qint64 primary = m_waveformView->primaryCursor();
+    if (reference >= 0 && primary >= 0)
+    {
+        writer->setWindow(qMin(reference, primary), qMax(reference, primary));
+    }
+    m_exporter->start(std::move(writer), filePath);
+
+    m_exportAction->setEnabled(false);
+    m_cancelLoadAction->setEnabled(true);
+    m_loadProgress->setValue(0);
+    m_loadProgress->show();
+    statusBar()->showMessage(tr("Exporting to %1…").arg(filePath));
+}
+
+void MainWindow::showExportProgress(qint64 written, qint64 total)
+{
+    if (total > 0)
+    {
+        m_loadProgress->setValue(static_cast<int>(qBound<qint64>(0, written * 1000 / total, 1000)));
+    }
+    statusBar()->showMessage(tr("Exporting to %1: %2 of %3 transitions").arg(m_exporter->filePath()).arg(written).arg(total));
+}
+
+void MainWindow::finishExport(bool ok, bool canceled, const QString &error, qint64 transitions)
+{
+    m_exportAction->setEnabled(true);
+    m_cancelLoadAction->setEnabled(m_loader->isRunning());
+    if (!m_loader->isRunning())
+    {
+        m_loadProgress->hide();
+    }
+    if (ok)
+    {
+        statusBar()->showMessage(tr("Exported %1 transitions to %2").arg(transitions).arg(m_exporter->filePath()), 4000);
+    }
+    else if (canceled)
+    {
+        statusBar()->showMessage(tr("Exporting to %1 was canceled").arg(m_exporter->filePath()), 4000);
+    }
+    else
+    {
+        statusBar()->clearMessage();
+        QMessageBox::critical(this, tr("Unable to Export"), tr("Failed to export signals: %1").arg(error));
+    }
+}
+
+void MainWindow::reloadCurrentFile()
+{
+    const QString filePath = m_loader->isRunning() ? m_loader->filePath() : m_currentFile;
+    if (!filePath.isEmpty())
+    {
+        loadFstFile(filePath, true);
+    }
+}
+
+void MainWindow::updateWatchedFile()
+{
+    const QStringList watched = m_fileWatcher->files();
+    if (!watched.isEmpty())
+    {
+        m_fileWatcher->removePaths(watched);
+    }
+    if (m_followAction->isChecked() && m_reader->isFollowing())
+    {
+        m_fileWatcher->addPath(m_currentFile);
+    }
+}
+
+void MainWindow::setFollowEnabled(bool enabled)
+{
+    if (m_loader->isRunning())
+    {
+        // Follow mode is chosen when a load starts.
+        reloadCurrentFile();
+        return;
+    }
+    if (m_currentFile.isEmpty())
+    {
+        return;
+    }
+    if (enabled && !m_reader->isFollowing())
+    {
+        // The parser state at the end of the file is only kept by a load in
+        // follow mode, so the trace is read once more.
+        reloadCurrentFile();
+        return;
+    }
+    updateWatchedFile();
+    if (enabled)
+    {
+        readAppendedData();
+    }
+}
+
+void MainWindow::readAppendedData()
+{
+    if (!m_reader->isFollowing())
+    {
+        return;
+    }
+
+    const qint64 previousEnd = m_reader->maxTime();
+    if (!m_reader->readAppended())
+    {
+        // Most likely the simulation was restarted and rewrote the file.
+        statusBar()->showMessage(tr("Reloading %1: %2").arg(m_currentFile, m_reader->lastError()), 4000);
+        reloadCurrentFile();
+        return;
+    }
+    m_waveformView->extendTimeRange(previousEnd, m_reader->maxTime());
+
+    // Editors and some tools replace the file, which drops it from the watcher.
+    if (!m_fileWatcher->files().contains(m_currentFile))
+    {
+        m_fileWatcher->addPath(m_currentFile);
+    }
 }
 
 void MainWindow::addSignalToWaveform(const fst::Signal &signal)
 {
-    m_waveformView->addSignal(signal);
+    if (m_loader->isRunning())
+    {
+        // Values are decoded once loading finishes.
+        m_waveformView->addSignal(signal.handle);
+        return;
+    }
+    if (!m_reader->ensureLoaded({signal.handle}))
+    {
+        QMessageBox::warning(this, tr("Unable to Load"), tr("Failed to read values of %1: %2").arg(m_reader->scopeTable().signalPath(signal), m_reader->lastError()));
+        return;
+    }
+    m_waveformView->addSignal(signal.handle);
+}
+
+void MainWindow::touchVisibleSignals(const QVector<int> &handles)
+{
+    // Under a memory budget, the rows on screen are kept resident and the
+    // ones scrolled away are the first to be spilled.
+    if (m_loader->isRunning())
+    {
+        return;
+    }
+    if (!m_reader->touch(handles))
+    {
+        statusBar()->showMessage(tr("Unable to spill signal values: %1").arg(m_reader->lastError()), 4000);
+    }
 }
 
 void MainWindow::updateStatusBar(qint64 primary, qint64 delta)
@@ -26,33 +26,27 @@ SignalTree::SignalTree(QWidget *parent)
         }
 
         const int handle = handleVariant.toInt();
-        const auto it = m_signals->find(handle);
-        if (it != m_signals->end())
+        const fst::Signal *signal = m_signals->find(handle);
+        if (signal)
         {
-            emit signalActivated(it.value());
+            emit signalActivated(*signal);
         }
     });
 }
 
-void SignalTree::populate(const fst::Scope &rootScope, const QMap<int, fst::Signal> &signalMap)
+void SignalTree::populate(const fst::ScopeTable &scopeTable, const fst::SignalTable &signalTable)
 {
     clear();
-    m_signals = &signalMap;
-    if (rootScope.path.isEmpty() && rootScope.type == QLatin1String("root"))
+    m_scopes = &scopeTable;
+    m_signals = &signalTable;
+    for (int child = scopeTable.firstChild(fst::ScopeTable::kRoot); child >= 0; child = scopeTable.nextSibling(child))
     {
-        for (const fst::Scope &child : rootScope.children)
-        {
-            addScopeItem(nullptr, child);
-        }
-    }
-    else
-    {
-        addScopeItem(nullptr, rootScope);
+        addScopeItem(nullptr, child);
     }
     expandAll();
 }
 
-void SignalTree::addScopeItem(QTreeWidgetItem *parentItem, const fst::Scope &scope)
+void SignalTree::addScopeItem(QTreeWidgetItem *parentItem, int scope)
 {
     QTreeWidgetItem *scopeItem = nullptr;
     if (parentItem)
@@ -64,25 +58,29 @@ void SignalTree::addScopeItem(QTreeWidgetItem *parentItem, const fst::Scope &sco
         scopeItem = new QTreeWidgetItem(this);
     }
 
-    scopeItem->setText(0, scope.name);
-    scopeItem->setText(1, scope.type);
+    scopeItem->setText(0, m_scopes->name(scope));
+    scopeItem->setText(1, m_scopes->type(scope));
 
     if (m_signals)
     {
-        for (int handle : scope.signalHandles)
+        for (int handle = m_scopes->firstSignal(scope); handle > 0; handle = m_scopes->nextSignal(handle))
         {
-            const fst::Signal signal = m_signals->value(handle);
+            const fst::Signal *signal = m_signals->find(handle);
+            if (!signal)
+            {
+                continue;
+            }
             QTreeWidgetItem *signalItem = new QTreeWidgetItem(scopeItem);
-            signalItem->setText(0, signal.name);
-            signalItem->setText(1, signal.type);
-            signalItem->setText(2, signal.direction);
-            signalItem->setData(0, Qt::UserRole, signal.handle);
+            signalItem->setText(0, signal->name);
+            signalItem->setText(1, signal->type);
+            signalItem->setText(2, signal->direction);
+            signalItem->setData(0, Qt::UserRole, signal->handle);
         }
     }
 
-    for (const fst::Scope &childScope : scope.children)
+    for (int child = m_scopes->firstChild(scope); child >= 0; child = m_scopes->nextSibling(child))
     {
-        addScopeItem(scopeItem, childScope);
+        addScopeItem(scopeItem, child);
     }
 }
 
@@ -0,0 +1,174 @@
+#include "summary_builder.h"
+
+#include <QAtomicInt>
+#include <QMetaObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QThread>
+#include <QVector>
+
+#include <functional>
+
+class SummaryBuilder::Job
+{
+public:
+    using Result = QPair<int, std::shared_ptr<const fst::ValueSummary>>;
+
+    Job(SummaryBuilder *builder, int generation)
+        : m_builder(builder)
+        , m_generation(generation)
+    {
+    }
+
+    // Returns false if a build for `handle` is queued or running already.
+    // `startThread` is set when the worker has to be started for it.
+    bool enqueue(int handle, const fst::ValueStore &values, bool &startThread)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_pending.contains(handle))
+        {
+            return false;
+        }
+        m_pending.append(handle);
+        m_queue.append(qMakePair(handle, values));
+        startThread = !m_running;
+        m_running = true;
+        return true;
+    }
+
+    // Runs on the worker thread until the queue is empty.
+    void run()
+    {
+        for (;;)
+        {
+            QPair<int, fst::ValueStore> request;
+            {
+                QMutexLocker locker(&m_mutex);
+                if (m_queue.isEmpty() || canceled.loadAcquire() != 0)
+                {
+                    m_running = false;
+                    return;
+                }
+                request = m_queue.takeFirst();
+            }
+            auto summary = std::make_shared<const fst::ValueSummary>(request.second);
+            {
+                QMutexLocker locker(&m_mutex);
+                m_pending.removeOne(request.first);
+                m_results.append(qMakePair(request.first, summary));
+            }
+            QMetaObject::invokeMethod(m_builder, "deliverResults", Qt::QueuedConnection, Q_ARG(int, m_generation));
+        }
+    }
+
+    QVector<Result> takeResults()
+    {
+        QMutexLocker locker(&m_mutex);
+        QVector<Result> results;
+        results.swap(m_results);
+        return results;
+    }
+
+    QAtomicInt canceled = 0;
+
+private:
+    SummaryBuilder *m_builder;
+    const int m_generation;
+    QMutex m_mutex;
+    QVector<QPair<int, fst::ValueStore>> m_queue;
+    QVector<int> m_pending; // handles queued or being built
+    QVector<Result> m_results;
+    bool m_running = false;
+};
+
+namespace
+{
+class SummaryThread : public QThread
+{
+public:
+    explicit SummaryThread(std::function<void()> body)
+        : m_body(std::move(body))
+    {
+    }
+
+protected:
+    void run() override
+    {
+        m_body();
+    }
+
+private:
+    std::function<void()> m_body;
+};
+} // namespace
+
+SummaryBuilder::SummaryBuilder(QObject *parent)
+    : QObject(parent)
+    , m_job(std::make_shared<Job>(this, 0))
+{
+}
+
+SummaryBuilder::~SummaryBuilder()
+{
+    stop();
+}
+
+const fst::ValueSummary *SummaryBuilder::summary(int handle) const
+{
+    const auto it = m_summaries.constFind(handle);
+    return it != m_summaries.constEnd() ? it.value().get() : nullptr;
+}
+
+void SummaryBuilder::request(int handle, const fst::ValueStore &values)
+{
+    bool startThread = false;
+    if (!m_job->enqueue(handle, values, startThread) || !startThread)
+    {
+        return;
+    }
+    // The previous worker has already left its loop, so waiting for it
+    // only covers the few instructions it has left.
+    if (m_thread)
+    {
+        m_thread->wait();
+        delete m_thread;
+    }
+    std::shared_ptr<Job> job = m_job;
+    m_thread = new SummaryThread([job]() { job->run(); });
+    m_thread->start();
+}
+
+void SummaryBuilder::clear()
+{
+    stop();
+    m_summaries.clear();
+    // Results of the old job that are still queued carry an older
+    // generation and are dropped on delivery.
+    m_job = std::make_shared<Job>(this, ++m_generation);
+}
+
+void SummaryBuilder::deliverResults(int generation)
+{
+    if (generation != m_generation)
+    {
+        return;
+    }
+    for (const Job::Result &result : m_job->takeResults())
+    {
+        m_summaries.insert(result.first, result.second);
+        emit summaryReady(result.first);
+    }
+}
+
+void SummaryBuilder::stop()
+{
+    if (!m_thread)
+    {
+        return;
+    }
+    m_job->canceled.storeRelease(1);
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+}
@@ -0,0 +1,159 @@
+#include "trace_exporter.h"
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QMetaObject>
+#include <QPair>
+#include <QThread>
+
+#include <functional>
+
+class TraceExporter::Job
+{
+public:
+    Job(TraceExporter *exporter, int generation, std::unique_ptr<fst::TraceWriter> writer, const QString &filePath)
+        : writer(std::move(writer))
+        , m_exporter(exporter)
+        , m_generation(generation)
+        , m_filePath(filePath)
+    {
+        this->writer->setProgress([this](qint64 written, qint64 total) { return reportProgress(written, total); });
+    }
+
+    // Runs on the worker thread.
+    void run()
+    {
+        ok = writer->write(m_filePath, fst::TraceWriter::formatFor(m_filePath));
+        QMetaObject::invokeMethod(m_exporter, "deliverResult", Qt::QueuedConnection, Q_ARG(int, m_generation));
+    }
+
+    // Reports are coalesced like those of a load: while one is waiting to
+    // be delivered, later ones only replace its numbers.
+    bool reportProgress(qint64 written, qint64 total)
+    {
+        m_written.storeRelease(written);
+        m_total.storeRelease(total);
+        if (m_progressPosted.testAndSetOrdered(0, 1))
+        {
+            QMetaObject::invokeMethod(m_exporter, "deliverProgress", Qt::QueuedConnection, Q_ARG(int, m_generation));
+        }
+        return canceled.loadAcquire() == 0;
+    }
+
+    QPair<qint64, qint64> takeProgress()
+    {
+        m_progressPosted.storeRelease(0);
+        return qMakePair(m_written.loadAcquire(), m_total.loadAcquire());
+    }
+
+    std::unique_ptr<fst::TraceWriter> writer;
+    QAtomicInt canceled = 0;
+    bool ok = false;
+
+private:
+    TraceExporter *m_exporter;
+    const int m_generation;
+    const QString m_filePath;
+    QAtomicInteger<qint64> m_written = 0;
+    QAtomicInteger<qint64> m_total = 0;
+    QAtomicInt m_progressPosted = 0;
+};
+
+namespace
+{
+class ExportThread : public QThread
+{
+public:
+    explicit ExportThread(std::function<void()> body)
+        : m_body(std::move(body))
+    {
+    }
+
+protected:
+    void run() override
+    {
+        m_body();
+    }
+
+private:
+    std::function<void()> m_body;
+};
+} // namespace
+
+TraceExporter::TraceExporter(QObject *parent)
+    : QObject(parent)
+{
+}
+
+TraceExporter::~TraceExporter()
+{
+    stop();
+}
+
+void TraceExporter::start(std::unique_ptr<fst::TraceWriter> writer, const QString &filePath)
+{
+    stop();
+
+    // Results of earlier exports that are still queued carry an older
+    // generation and are dropped on delivery.
+    ++m_generation;
+    m_filePath = filePath;
+    m_job = std::make_shared<Job>(this, m_generation, std::move(writer), filePath);
+
+    std::shared_ptr<Job> job = m_job;
+    m_thread = new ExportThread([job]() { job->run(); });
+    m_thread->start();
+}
+
+void TraceExporter::cancel()
+{
+    if (m_thread)
+    {
+        m_job->canceled.storeRelease(1);
+    }
+}
+
+bool TraceExporter::isRunning() const
+{
+    return m_thread != nullptr;
+}
+
+QString TraceExporter::filePath() const
+{
+    return m_filePath;
+}
+
+void TraceExporter::deliverProgress(int generation)
+{
+    if (generation != m_generation || !m_thread)
+    {
+        return;
+    }
+    const QPair<qint64, qint64> progress = m_job->takeProgress();
+    emit this->progress(progress.first, progress.second);
+}
+
+void TraceExporter::deliverResult(int generation)
+{
+    if (generation != m_generation || !m_thread)
+    {
+        return;
+    }
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+    const bool canceled = !m_job->ok && m_job->canceled.loadAcquire() != 0;
+    emit finished(m_job->ok, canceled, m_job->writer->errorString(), m_job->writer->transitionCount());
+}
+
+void TraceExporter::stop()
+{
+    if (!m_thread)
+    {
+        return;
+    }
+    m_job->canceled.storeRelease(1);
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+}
@@ -0,0 +1,212 @@
+#include "trace_loader.h"
+
+#include <QAtomicInt>
+#include <QMetaObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <functional>
+
+class TraceLoader::Job : public fst::LoadObserver
+{
+public:
+    Job(TraceLoader *loader, int generation, const QString &filePath, const fst::LoadOptions &options)
+        : m_loader(loader)
+        , m_generation(generation)
+        , m_filePath(filePath)
+        , m_options(options)
+    {
+        m_options.observer = this;
+    }
+
+    // Runs on the worker thread.
+    void run()
+    {
+        ok = reader->load(m_filePath, m_options);
+        QMetaObject::invokeMethod(m_loader, "deliverResult", Qt::QueuedConnection, Q_ARG(int, m_generation));
+    }
+
+    void hierarchyReady(const fst::ScopeTable &scopes, const fst::SignalTable &signalTable) override
+    {
+        // Only the hierarchy is handed over. Copying the value stores would
+        // share columns that the reader is still appending to.
+        scopeTable = scopes;
+        hierarchySignals = signalTable;
+        for (fst::Signal &signal : hierarchySignals)
+        {
+            signal.values = fst::ValueStore(signal.values.kind(), signal.values.width());
+        }
+        QMetaObject::invokeMethod(m_loader, "deliverHierarchy", Qt::QueuedConnection, Q_ARG(int, m_generation));
+    }
+
+    // Reports are coalesced: while one is waiting to be delivered, later
+    // ones only replace its numbers.
+    void progress(const fst::LoadProgress &progress) override
+    {
+        {
+            QMutexLocker locker(&m_progressMutex);
+            m_latestProgress = progress;
+        }
+        if (m_progressPosted.testAndSetOrdered(0, 1))
+        {
+            QMetaObject::invokeMethod(m_loader, "deliverProgress", Qt::QueuedConnection, Q_ARG(int, m_generation));
+        }
+    }
+
+    bool isCanceled() const override
+    {
+        return canceled.loadAcquire() != 0;
+    }
+
+    fst::LoadProgress takeProgress()
+    {
+        QMutexLocker locker(&m_progressMutex);
+        m_progressPosted.storeRelease(0);
+        return m_latestProgress;
+    }
+
+    std::unique_ptr<fst::SimpleFstReader> reader = std::make_unique<fst::SimpleFstReader>();
+    QAtomicInt canceled = 0;
+    bool ok = false;
+    fst::ScopeTable scopeTable;
+    fst::SignalTable hierarchySignals;
+
+private:
+    TraceLoader *m_loader;
+    const int m_generation;
+    const QString m_filePath;
+    fst::LoadOptions m_options;
+    QMutex m_progressMutex;
+    fst::LoadProgress m_latestProgress;
+    QAtomicInt m_progressPosted = 0;
+};
+
+namespace
+{
+class LoadThread : public QThread
+{
+public:
+    explicit LoadThread(std::function<void()> body)
+        : m_body(std::move(body))
+    {
+    }
+
+protected:
+    void run() override
+    {
+        m_body();
+    }
+
+private:
+    std::function<void()> m_body;
+};
+} // namespace
+
+TraceLoader::TraceLoader(QObject *parent)
+    : QObject(parent)
+{
+}
+
+TraceLoader::~TraceLoader()
+{
+    stop();
+}
+
+void TraceLoader::start(const QString &filePath, const fst::LoadOptions &options)
+{
+    stop();
+
+    // Results of earlier loads that are still queued carry an older
+    // generation and are dropped on delivery.
+    ++m_generation;
+    m_filePath = filePath;
+    m_scopeTable.clear();
+    m_signalTable.clear();
+    m_job = std::make_shared<Job>(this, m_generation, filePath, options);
+
+    std::shared_ptr<Job> job = m_job;
+    m_thread = new LoadThread([job]() { job->run(); });
+    m_thread->start();
+}
+
+void TraceLoader::cancel()
+{
+    if (m_thread)
+    {
+        m_job->canceled.storeRelease(1);
+    }
+}
+
+bool TraceLoader::isRunning() const
+{
+    return m_thread != nullptr;
+}
+
+QString TraceLoader::filePath() const
+{
+    return m_filePath;
+}
+
+const fst::ScopeTable &TraceLoader::scopeTable() const
+{
+    return m_scopeTable;
+}
+
+const fst::SignalTable &TraceLoader::signalTable() const
+{
+    return m_signalTable;
+}
+
+std::unique_ptr<fst::SimpleFstReader> TraceLoader::takeReader()
+{
+    if (!m_job || m_thread || !m_job->ok)
+    {
+        return nullptr;
+    }
+    return std::move(m_job->reader);
+}
+
+void TraceLoader::deliverHierarchy(int generation)
+{
+    if (generation != m_generation)
+    {
+        return;
+    }
+    m_scopeTable = std::move(m_job->scopeTable);
+    m_signalTable = std::move(m_job->hierarchySignals);
+    emit hierarchyReady();
+}
+
+void TraceLoader::deliverProgress(int generation)
+{
+    if (generation != m_generation || !m_thread)
+    {
+        return;
+    }
+    emit progress(m_job->takeProgress());
+}
+
+void TraceLoader::deliverResult(int generation)
+{
+    if (generation != m_generation || !m_thread)
+    {
+        return;
+    }
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+    emit finished(m_job->ok, !m_job->ok && m_job->isCanceled(), m_job->reader->lastError());
+}
+
+void TraceLoader::stop()
+{
+    if (!m_thread)
+    {
+        return;
+    }
+    m_job->canceled.storeRelease(1);
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+}
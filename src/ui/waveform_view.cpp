@@ -1,14 +1,25 @@
 #include "waveform_view.h"
 
+#include "parallel.h"
+#include "summary_builder.h"
+#include "value_summary.h"
+
+#include <QElapsedTimer>
+#include <QFontDatabase>
 #include <QFontMetrics>
 #include <QLinearGradient>
 #include <QMouseEvent>
 #include <QPainter>
 #include <QPaintEvent>
+#include <QResizeEvent>
+#include <QScrollBar>
+#include <QTimer>
 #include <QWheelEvent>
 
 #include <algorithm>
 #include <cmath>
+#include <limits>
+#include <vector>
 #include <QtGlobal>
 
 namespace
@@ -17,28 +28,32 @@ constexpr qreal kTimeAxisHeight = 36.0;
 constexpr qreal kSignalRowHeight = 28.0;
 constexpr qreal kSignalGap = 4.0;
 constexpr qreal kNameColumnWidth = 260.0;
-
-QString normalizeLogicValue(const QString &value)
+// Shorter signals are always drawn change by change.
+constexpr int kSummaryMinChanges = 4096;
+// Bus segments narrower than this are drawn without their value.
+constexpr qreal kMinLabelWidth = 24.0;
+// Width of a row tile in device-independent pixels, and the memory all
+// tiles may take together: about 2,300 tiles at a device pixel ratio of 1.
+constexpr qreal kTileWidth = 256.0;
+constexpr int kTileCacheBytes = 64 * 1024 * 1024;
+// Tiles rendered ahead of a pan, per row.
+constexpr int kPrefetchTiles = 2;
+// Default frame budget for rasterizing tiles, about two frames at 60 Hz.
+constexpr int kFrameBudgetMs = 30;
+
+// X and Z are drawn high like 1; anything else is drawn low.
+bool isLogicLow(char state)
 {
-    if (value.isEmpty())
-    {
-        return QStringLiteral("0");
-    }
-    const QChar c = value.at(0).toLower();
-    if (c == QLatin1Char('x'))
-    {
-        return QStringLiteral("X");
-    }
-    if (c == QLatin1Char('z'))
-    {
-        return QStringLiteral("Z");
-    }
-    if (c == QLatin1Char('1'))
-    {
-        return QStringLiteral("1");
-    }
-    return QStringLiteral("0");
+    return state != '1' && state != 'x' && state != 'z';
 }
+
+// Changes of a row that land in one pixel column.
+struct SummaryColumn
+{
+    int count = 0;
+    bool unknown = false;
+    char lastState = 0;
+};
 }
 
 WaveformView::WaveformView(QWidget *parent)
@@ -48,32 +63,84 @@ WaveformView::WaveformView(QWidget *parent)
     setMouseTracking(true);
     setFocusPolicy(Qt::StrongFocus);
     setAutoFillBackground(false);
+
+    m_scrollBar = new QScrollBar(Qt::Vertical, this);
+    m_scrollBar->hide();
+    connect(m_scrollBar, &QScrollBar::valueChanged, this, [this]() {
+        updateVisibleSignals();
+        update();
+    });
+
+    m_summaryBuilder = new SummaryBuilder(this);
+    connect(m_summaryBuilder, &SummaryBuilder::summaryReady, this, [this]() { update(); });
+
+    m_tiles.setMaxCost(kTileCacheBytes);
+    m_frameBudgetMs = kFrameBudgetMs;
+    m_prefetchTimer = new QTimer(this);
+    m_prefetchTimer->setSingleShot(true);
+    m_prefetchTimer->setInterval(0);
+    connect(m_prefetchTimer, &QTimer::timeout, this, &WaveformView::prefetchTiles);
+}
+
+void WaveformView::setSignalSource(const fst::SignalTable *signalTable, const fst::ScopeTable *scopeTable)
+{
+    m_signalTable = signalTable;
+    m_scopeTable = scopeTable;
+    m_summaryBuilder->clear();
+    // Handles and revisions of a new trace may repeat those of the old one.
+    clearRenderCache();
+    update();
 }
 
-void WaveformView::addSignal(const fst::Signal &signal)
+void WaveformView::addSignal(int handle)
 {
     for (const auto &existing : m_signals)
     {
-        if (existing.signal.handle == signal.handle)
+        if (existing.handle == handle)
         {
             return;
         }
     }
 
     RenderSignal renderSignal;
-    renderSignal.signal = signal;
+    renderSignal.handle = handle;
     renderSignal.height = static_cast<int>(kSignalRowHeight);
     m_signals.append(renderSignal);
+    // The caller has loaded the values by now, so the pyramid is built on
+    // the builder's thread while the row waits for its first paint.
+    const fst::Signal *signal = m_signalTable ? m_signalTable->find(handle) : nullptr;
+    if (signal && signal->valuesLoaded)
+    {
+        summaryFor(*signal);
+    }
+    updateScrollBar();
     update();
 }
 
+void WaveformView::requestSummaries()
+{
+    if (!m_signalTable)
+    {
+        return;
+    }
+    for (const auto &renderSignal : m_signals)
+    {
+        const fst::Signal *signal = m_signalTable->find(renderSignal.handle);
+        if (signal && signal->valuesLoaded)
+        {
+            summaryFor(*signal);
+        }
+    }
+}
+
 void WaveformView::removeSignal(int handle)
 {
     for (int i = 0; i < m_signals.size(); ++i)
     {
-        if (m_signals[i].signal.handle == handle)
+        if (m_signals[i].handle == handle)
         {
             m_signals.removeAt(i);
+            updateScrollBar();
             update();
             break;
         }
@@ -85,6 +152,24 @@ void WaveformView::clearSignals()
     m_signals.clear();
     m_primaryCursor = -1;
     m_referenceCursor = -1;
+    updateScrollBar();
+    update();
+}
+
+QVector<int> WaveformView::signalHandles() const
+{
+    QVector<int> handles;
+    handles.reserve(m_signals.size());
+    for (const auto &renderSignal : m_signals)
+    {
+        handles.append(renderSignal.handle);
+    }
+    return handles;
+}
+
+void WaveformView::clearRenderCache()
+{
+    m_tiles.clear();
     update();
 }
 
@@ -99,6 +184,17 @@ void WaveformView::setTimeRange(qint64 start, qint64 end)
     update();
 }
 
+void WaveformView::extendTimeRange(qint64 previousEnd, qint64 end)
+{
+    if (end > previousEnd && m_timeStart <= previousEnd && m_timeEnd >= previousEnd && m_timeEnd < end)
+    {
+        const qint64 shift = end - m_timeEnd;
+        m_timeStart += shift;
+        m_timeEnd += shift;
+    }
+    update();
+}
+
 void WaveformView::zoomIn()
 {
     const qreal span = qMax<qreal>(1.0, m_timeEnd - m_timeStart);
@@ -153,19 +249,68 @@ void WaveformView::paintEvent(QPaintEvent *event)
     const QRectF waveRect = waveformRect();
     drawGrid(painter, waveRect);
 
+    // Rows above and below the viewport are never visited.
+    const QPair<int, int> visible = visibleRows();
+    QVector<const fst::Signal *> rows;
+    for (int i = visible.first; m_signalTable && i < visible.second; ++i)
+    {
+        rows.append(m_signalTable->find(m_signals.at(i).handle));
+    }
+
+    // Uncached tiles of the frame are rasterized together on the thread pool
+    // before any row is composed. The cache must hold a whole frame several
+    // times over, or tiles rendered for it could be evicted before use.
+    const qreal ppt = pixelsPerTime(waveRect);
+    if (ppt > 0 && !rows.isEmpty())
+    {
+        const QPair<qint64, qint64> columns = tileColumns(ppt, waveRect.width());
+        const qreal ratio = devicePixelRatioF();
+        const qint64 tileBytes = qint64(std::ceil(kTileWidth * ratio)) * qint64(std::ceil(kSignalRowHeight * ratio)) * 4;
+        const qint64 frameBytes = tileBytes * rows.size() * (columns.second - columns.first + 1);
+        m_tiles.setMaxCost(static_cast<int>(qBound<qint64>(kTileCacheBytes, 3 * frameBytes, std::numeric_limits<int>::max())));
+        if (!renderTiles(rows, columns.first, columns.second, ppt))
+        {
+            QTimer::singleShot(0, this, [this]() { update(); });
+        }
+    }
+
+    // A row scrolled partly out at the top must not paint over the axis.
     const qreal baseTop = axisRect.bottom();
-    for (int i = 0; i < m_signals.size(); ++i)
+    painter.save();
+    painter.setClipRect(QRectF(0.0, baseTop, viewportWidth(), height() - baseTop));
+    for (int i = 0; i < rows.size(); ++i)
     {
-        QRectF rowRect = signalRect(i);
+        if (!rows.at(i))
+        {
+            continue;
+        }
+        const int index = visible.first + i;
+        QRectF rowRect = signalRect(index);
         rowRect.translate(0, baseTop);
-        drawSignal(painter, m_signals.at(i), rowRect, i % 2 == 1);
+        drawSignal(painter, *rows.at(i), rowRect, index % 2 == 1);
     }
+    painter.restore();
 
     drawCursors(painter, waveRect);
 }
 
+void WaveformView::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    updateScrollBar();
+}
+
 void WaveformView::wheelEvent(QWheelEvent *event)
 {
+    // Over the names, or with Shift held, the wheel scrolls the rows by
+    // three per notch instead of zooming.
+    if ((event->modifiers() & Qt::ShiftModifier) || event->position().x() < kNameColumnWidth)
+    {
+        const int delta = event->angleDelta().y() != 0 ? event->angleDelta().y() : event->angleDelta().x();
+        m_scrollBar->setValue(m_scrollBar->value() - delta * 3 * m_scrollBar->singleStep() / 120);
+        return;
+    }
+
     const QRectF waveRect = waveformRect();
     if (waveRect.width() <= 0)
     {
@@ -229,6 +374,10 @@ void WaveformView::mouseMoveEvent(QMouseEvent *event)
 
         const qreal dx = event->pos().x() - m_lastMousePos.x();
         const qreal deltaTime = -dx / ppt;
+        if (dx != 0)
+        {
+            m_panDirection = dx < 0 ? 1 : -1;
+        }
         m_timeStart += static_cast<qint64>(deltaTime);
         m_timeEnd += static_cast<qint64>(deltaTime);
         if (m_timeStart < 0)
@@ -241,6 +390,7 @@ void WaveformView::mouseMoveEvent(QMouseEvent *event)
         m_lastMousePos = event->pos();
         updateCursorFromPosition(event->pos());
         update();
+        m_prefetchTimer->start();
     }
 }
 
@@ -255,8 +405,52 @@ void WaveformView::mouseReleaseEvent(QMouseEvent *event)
 
 QRectF WaveformView::signalRect(int index) const
 {
-    const qreal top = index * (kSignalRowHeight + kSignalGap);
-    return QRectF(0.0, top, width(), kSignalRowHeight);
+    const qreal top = index * (kSignalRowHeight + kSignalGap) - m_scrollBar->value();
+    return QRectF(0.0, top, viewportWidth(), kSignalRowHeight);
+}
+
+QPair<int, int> WaveformView::visibleRows() const
+{
+    const qreal pitch = kSignalRowHeight + kSignalGap;
+    const qreal top = m_scrollBar->value();
+    const int first = static_cast<int>(top / pitch);
+    const int last = static_cast<int>(std::ceil((top + height() - kTimeAxisHeight) / pitch));
+    return qMakePair(qMin(first, m_signals.size()), qBound(0, last, m_signals.size()));
+}
+
+qreal WaveformView::viewportWidth() const
+{
+    return width() - (m_scrollBar->isHidden() ? 0 : m_scrollBar->width());
+}
+
+void WaveformView::updateScrollBar()
+{
+    const int viewportHeight = qMax(0, height() - static_cast<int>(kTimeAxisHeight));
+    const qint64 contentHeight = qint64(m_signals.size()) * static_cast<qint64>(kSignalRowHeight + kSignalGap);
+    const int maximum = static_cast<int>(qMin<qint64>(std::numeric_limits<int>::max(), qMax<qint64>(0, contentHeight - viewportHeight)));
+    m_scrollBar->setRange(0, maximum);
+    m_scrollBar->setPageStep(viewportHeight);
+    m_scrollBar->setSingleStep(static_cast<int>(kSignalRowHeight + kSignalGap));
+    const int barWidth = m_scrollBar->sizeHint().width();
+    m_scrollBar->setGeometry(width() - barWidth, static_cast<int>(kTimeAxisHeight), barWidth, viewportHeight);
+    m_scrollBar->setHidden(maximum == 0);
+    updateVisibleSignals();
+}
+
+void WaveformView::updateVisibleSignals()
+{
+    const QPair<int, int> rows = visibleRows();
+    QVector<int> handles;
+    handles.reserve(rows.second - rows.first);
+    for (int i = rows.first; i < rows.second; ++i)
+    {
+        handles.append(m_signals.at(i).handle);
+    }
+    if (handles != m_visibleHandles)
+    {
+        m_visibleHandles = handles;
+        emit visibleSignalsChanged(handles);
+    }
 }
 
 QRectF WaveformView::timeAxisRect() const
@@ -266,7 +460,7 @@ QRectF WaveformView::timeAxisRect() const
 
 QRectF WaveformView::waveformRect() const
 {
-    return QRectF(kNameColumnWidth, kTimeAxisHeight, width() - kNameColumnWidth, height() - kTimeAxisHeight);
+    return QRectF(kNameColumnWidth, kTimeAxisHeight, viewportWidth() - kNameColumnWidth, height() - kTimeAxisHeight);
 }
 
 void WaveformView::updateCursorFromPosition(const QPoint &pos)
@@ -331,28 +525,29 @@ void WaveformView::drawGrid(QPainter &painter, const QRectF &rect)
     painter.setPen(QPen(m_gridColor.darker(130), 1));
     const qreal rowHeight = kSignalRowHeight + kSignalGap;
     const int rowCount = std::ceil(rect.height() / rowHeight);
+    const qreal offset = std::fmod(static_cast<qreal>(m_scrollBar->value()), rowHeight);
     for (int i = 0; i <= rowCount; ++i)
     {
-        const qreal y = rect.top() + i * rowHeight;
+        const qreal y = rect.top() + i * rowHeight - offset;
         painter.drawLine(QPointF(rect.left(), y), QPointF(rect.right(), y));
     }
 
     painter.restore();
 }
 
-void WaveformView::drawSignal(QPainter &painter, const RenderSignal &sig, const QRectF &rect, bool alternateRow)
+void WaveformView::drawSignal(QPainter &painter, const fst::Signal &signal, const QRectF &rect, bool alternateRow)
 {
     painter.save();
-    drawSignalBackground(painter, rect, sig, alternateRow);
+    drawSignalBackground(painter, rect, signal, alternateRow);
 
     QRectF waveRect = rect;
     waveRect.setLeft(kNameColumnWidth);
     waveRect.setWidth(rect.width() - kNameColumnWidth);
-    drawSignalWave(painter, sig, waveRect.adjusted(0, 2, 0, -2));
+    drawSignalTiles(painter, signal, waveRect);
     painter.restore();
 }
 
-void WaveformView::drawSignalBackground(QPainter &painter, const QRectF &rect, const RenderSignal &sig, bool alternateRow) const
+void WaveformView::drawSignalBackground(QPainter &painter, const QRectF &rect, const fst::Signal &signal, bool alternateRow) const
 {
     QRectF nameRect(0.0, rect.top(), kNameColumnWidth, rect.height());
     QColor nameBg = alternateRow ? m_nameBackground.darker(110) : m_nameBackground;
@@ -362,58 +557,284 @@ void WaveformView::drawSignalBackground(QPainter &painter, const QRectF &rect, c
     painter.drawLine(QPointF(nameRect.right(), nameRect.top()), QPointF(nameRect.right(), nameRect.bottom()));
 
     painter.setPen(QColor(220, 220, 220));
-    painter.drawText(nameRect.adjusted(8, 0, -8, 0), Qt::AlignVCenter | Qt::AlignLeft, sig.signal.path);
+    painter.drawText(nameRect.adjusted(8, 0, -8, 0), Qt::AlignVCenter | Qt::AlignLeft,
+                     m_scopeTable ? m_scopeTable->signalPath(signal) : signal.name);
 
     QRectF waveRect(kNameColumnWidth, rect.top(), rect.width() - kNameColumnWidth, rect.height());
     QColor waveBg = alternateRow ? m_backgroundColor.darker(120) : m_backgroundColor.darker(105);
     painter.fillRect(waveRect, waveBg);
 }
 
-void WaveformView::drawSignalWave(QPainter &painter, const RenderSignal &sig, const QRectF &rect)
+void WaveformView::drawSignalTiles(QPainter &painter, const fst::Signal &signal, const QRectF &rect)
 {
-    painter.save();
     const qreal ppt = pixelsPerTime(rect);
     if (ppt <= 0)
     {
-        painter.restore();
         return;
     }
 
+    // Tile `column` covers pixels [column * kTileWidth, (column + 1) *
+    // kTileWidth) counted from time 0, and the view's left edge sits at
+    // pixel m_timeStart * ppt of that grid.
+    const qreal viewLeft = m_timeStart * ppt;
+    const QPair<qint64, qint64> columns = tileColumns(ppt, rect.width());
+    painter.save();
+    painter.setClipRect(rect);
+    for (qint64 column = columns.first; column <= columns.second; ++column)
+    {
+        if (const QImage *tile = m_tiles.object(tileKey(signal, column, ppt)))
+        {
+            painter.drawImage(QPointF(rect.left() + column * kTileWidth - viewLeft, rect.top()), *tile);
+        }
+    }
+    if (signal.bitWidth > 1)
+    {
+        drawBusLabels(painter, signal, rect.adjusted(0, 2, 0, -2), ppt);
+    }
+    painter.restore();
+}
+
+void WaveformView::drawBusBody(QPainter &painter, const QRectF &rect) const
+{
+    painter.fillRect(rect, m_busFill);
+    painter.setPen(QPen(m_gridColor.lighter(160), 1));
+    painter.drawLine(rect.topLeft(), rect.topRight());
+    painter.drawLine(rect.bottomLeft(), rect.bottomRight());
+}
+
+void WaveformView::drawBusLabels(QPainter &painter, const fst::Signal &signal, const QRectF &rect, qreal ppt) const
+{
+    const fst::ValueStore &values = signal.values;
+    painter.setPen(Qt::white);
+    if (values.isEmpty())
+    {
+        painter.drawText(rect.adjusted(4, 0, -4, 0), Qt::AlignCenter, QStringLiteral("0"));
+        return;
+    }
+
+    // Each value is centred in the visible part of its whole segment. A
+    // segment too narrow for a label is skipped together with every change
+    // within kMinLabelWidth of its start, found by search, so a dense
+    // stretch costs one lookup per label width rather than one per change.
     const qreal leftX = rect.left();
     const qreal rightX = rect.right();
+    int index = qMax(0, values.indexAt(m_timeStart));
+    while (index < values.size())
+    {
+        const fst::ValueStore::Iterator value = values.at(index);
+        const qreal startX = qMax(leftX, leftX + (value.time() - m_timeStart) * ppt);
+        if (startX >= rightX)
+        {
+            break;
+        }
+        const bool last = index + 1 >= values.size();
+        const qreal endX = last ? rightX : qMin(rightX, leftX + (values.at(index + 1).time() - m_timeStart) * ppt);
+        if (endX - startX >= kMinLabelWidth)
+        {
+            painter.drawText(QRectF(startX, rect.top(), endX - startX, rect.height()).adjusted(4, 0, -4, 0), Qt::AlignCenter,
+                             value.text());
+            ++index;
+            continue;
+        }
+        if (last)
+        {
+            break;
+        }
+        const qint64 skipTime = m_timeStart + static_cast<qint64>(std::floor((startX + kMinLabelWidth - leftX) / ppt));
+        index = qMax(index + 1, values.indexAt(skipTime));
+    }
+}
+
+QPair<qint64, qint64> WaveformView::tileColumns(qreal ppt, qreal width) const
+{
+    const qreal viewLeft = m_timeStart * ppt;
+    return qMakePair(static_cast<qint64>(std::floor(viewLeft / kTileWidth)),
+                     static_cast<qint64>(std::floor((viewLeft + width) / kTileWidth)));
+}
+
+WaveformView::TileKey WaveformView::tileKey(const fst::Signal &signal, qint64 column, qreal ppt) const
+{
+    TileKey key;
+    key.handle = signal.handle;
+    key.revision = signal.values.revision();
+    key.pixelsPerTime = ppt;
+    key.column = column;
+    key.devicePixelRatio = devicePixelRatioF();
+    return key;
+}
 
-    if (sig.signal.bitWidth > 1)
+bool WaveformView::renderTiles(const QVector<const fst::Signal *> &rows, qint64 firstColumn, qint64 lastColumn, qreal ppt)
+{
+    struct TileJob
+    {
+        const fst::Signal *signal;
+        const fst::ValueSummary *summary;
+        TileKey key;
+        QImage tile;
+    };
+
+    // Everything that touches the cache, the summary builder or the widget
+    // happens here on the GUI thread; the workers only draw.
+    std::vector<TileJob> jobs;
+    for (const fst::Signal *signal : rows)
     {
-        qreal currentX = leftX;
-        QString currentValue = sig.signal.values.isEmpty() ? QStringLiteral("0") : sig.signal.values.first().value;
-        for (const auto &value : sig.signal.values)
+        if (!signal)
+        {
+            continue;
+        }
+        const fst::ValueSummary *summary = nullptr;
+        bool summaryResolved = false;
+        for (qint64 column = qMax<qint64>(0, firstColumn); column <= lastColumn; ++column)
         {
-            const qreal x = leftX + (value.time - m_timeStart) * ppt;
-            if (x <= leftX)
+            const TileKey key = tileKey(*signal, column, ppt);
+            if (m_tiles.contains(key))
             {
-                currentValue = value.value;
                 continue;
             }
-            if (currentX < rightX)
+            if (!summaryResolved)
             {
-                QRectF busRect(currentX, rect.top(), qMin<qreal>(rightX - currentX, qMax<qreal>(4.0, x - currentX)), rect.height());
-                painter.fillRect(busRect, m_busFill);
-                painter.setPen(QPen(m_gridColor.lighter(160), 1));
-                painter.drawRect(busRect);
-                painter.setPen(Qt::white);
-                painter.drawText(busRect.adjusted(4, 0, -4, 0), Qt::AlignCenter, currentValue);
-                currentX = x;
-                currentValue = value.value;
+                summary = summaryFor(*signal);
+                summaryResolved = true;
             }
+            jobs.push_back(TileJob{signal, summary, key, QImage()});
+        }
+    }
+    if (jobs.empty())
+    {
+        return true;
+    }
+
+    // Jobs are handed out top row first, so a frame cut short by the budget
+    // is missing tiles at the bottom rather than scattered ones. The signal
+    // table cannot change meanwhile: the GUI thread takes part in the loop
+    // and only returns once every job is done or skipped.
+    const qreal ratio = devicePixelRatioF();
+    const QFont rowFont = font();
+    QElapsedTimer frame;
+    frame.start();
+    const auto render = [&](int index) {
+        if (m_frameBudgetMs > 0 && frame.elapsed() >= m_frameBudgetMs)
+        {
+            return;
+        }
+        TileJob &job = jobs[static_cast<size_t>(index)];
+        job.tile = renderTile(*job.signal, job.summary, job.key.column, ppt, ratio, rowFont);
+    };
+    if (QFontDatabase::supportsThreadedFontRendering())
+    {
+        parallel::forEach(static_cast<int>(jobs.size()), render);
+    }
+    else
+    {
+        for (int i = 0; i < static_cast<int>(jobs.size()); ++i)
+        {
+            render(i);
+        }
+    }
+
+    bool complete = true;
+    for (const TileJob &job : jobs)
+    {
+        if (job.tile.isNull())
+        {
+            complete = false;
+            continue;
+        }
+        m_tiles.insert(job.key, new QImage(job.tile), job.tile.bytesPerLine() * job.tile.height());
+    }
+    return complete;
+}
+
+QImage WaveformView::renderTile(const fst::Signal &signal, const fst::ValueSummary *summary, qint64 column, qreal ppt,
+                                qreal devicePixelRatio, const QFont &font) const
+{
+    QImage tile(QSize(static_cast<int>(std::ceil(kTileWidth * devicePixelRatio)),
+                      static_cast<int>(std::ceil(kSignalRowHeight * devicePixelRatio))),
+                QImage::Format_ARGB32_Premultiplied);
+    tile.setDevicePixelRatio(devicePixelRatio);
+    // Transparent, so the row background underneath stays the row's own.
+    tile.fill(Qt::transparent);
+
+    QPainter painter(&tile);
+    painter.setRenderHint(QPainter::Antialiasing, false);
+    painter.setFont(font);
+    const QRectF rect(0.0, 2.0, kTileWidth, kSignalRowHeight - 4.0);
+    drawSignalWave(painter, signal, summary, rect, column * kTileWidth / ppt, ppt);
+    return tile;
+}
+
+void WaveformView::prefetchTiles()
+{
+    if (!m_signalTable || m_panDirection == 0)
+    {
+        return;
+    }
+    const QRectF waveRect = waveformRect();
+    const qreal ppt = pixelsPerTime(waveRect);
+    if (ppt <= 0)
+    {
+        return;
+    }
+
+    const QPair<qint64, qint64> columns = tileColumns(ppt, waveRect.width());
+    const qint64 edgeColumn = m_panDirection > 0 ? columns.second : columns.first;
+    const qint64 firstColumn = m_panDirection > 0 ? edgeColumn + 1 : edgeColumn - kPrefetchTiles;
+    const qint64 lastColumn = m_panDirection > 0 ? edgeColumn + kPrefetchTiles : edgeColumn - 1;
+    const QPair<int, int> visible = visibleRows();
+    QVector<const fst::Signal *> rows;
+    for (int i = visible.first; i < visible.second; ++i)
+    {
+        rows.append(m_signalTable->find(m_signals.at(i).handle));
+    }
+    renderTiles(rows, firstColumn, lastColumn, ppt);
+}
+
+void WaveformView::drawSignalWave(QPainter &painter, const fst::Signal &signal, const fst::ValueSummary *summary,
+                                  const QRectF &rect, qreal timeStart, qreal ppt) const
+{
+    painter.save();
+
+    // Zoomed out far enough that a summary bucket fits in a pixel, the
+    // pyramid stands in for the individual changes.
+    if (summary)
+    {
+        const int level = summary->levelFor(1.0 / ppt);
+        if (level >= 0)
+        {
+            drawSummarizedWave(painter, signal, *summary, level, rect, timeStart, ppt);
+            painter.restore();
+            return;
         }
-        if (currentX < rightX)
+    }
+
+    const qreal leftX = rect.left();
+    const qreal rightX = rect.right();
+
+    // Only the transitions on screen are visited: iteration starts at the
+    // last change at or before the left edge, found by a binary search over
+    // the store's checkpoints, and stops at the first one past the right
+    // edge, so the cost of a row does not depend on where the view sits.
+    const fst::ValueStore &values = signal.values;
+    const fst::ValueStore::Iterator first = values.at(qMax(0, values.indexAt(static_cast<qint64>(std::floor(timeStart)))));
+
+    if (signal.bitWidth > 1)
+    {
+        // The body runs through the whole tile; only changes that fall in
+        // it get an edge, so tile seams stay invisible. Labels are drawn per
+        // row by drawBusLabels().
+        drawBusBody(painter, rect);
+        for (auto value = first; value != values.end(); ++value)
         {
-            QRectF busRect(currentX, rect.top(), rightX - currentX, rect.height());
-            painter.fillRect(busRect, m_busFill);
-            painter.setPen(QPen(m_gridColor.lighter(160), 1));
-            painter.drawRect(busRect);
-            painter.setPen(Qt::white);
-            painter.drawText(busRect.adjusted(4, 0, -4, 0), Qt::AlignCenter, currentValue);
+            const qreal x = leftX + (value.time() - timeStart) * ppt;
+            if (x < leftX)
+            {
+                continue;
+            }
+            if (x >= rightX)
+            {
+                break;
+            }
+            painter.drawLine(QPointF(x, rect.top()), QPointF(x, rect.bottom()));
         }
     }
     else
@@ -421,23 +842,23 @@ void WaveformView::drawSignalWave(QPainter &painter, const RenderSignal &sig, co
         const qreal highY = rect.top() + 4.0;
         const qreal lowY = rect.bottom() - 4.0;
 
-        QString lastValue = sig.signal.values.isEmpty() ? QStringLiteral("0") : sig.signal.values.first().value;
+        char lastState = values.isEmpty() ? '0' : first.scalar();
         qreal lastX = leftX;
-        qreal lastY = normalizeLogicValue(lastValue) == QLatin1String("0") ? lowY : highY;
-        if (sig.signal.values.isEmpty())
+        qreal lastY = isLogicLow(lastState) ? lowY : highY;
+        if (values.isEmpty())
         {
             painter.setPen(QPen(m_digitalLow.lighter(), 2));
             painter.drawLine(QPointF(leftX, lowY), QPointF(rightX, lowY));
         }
         else
         {
-            for (const auto &value : sig.signal.values)
+            for (auto value = first; value != values.end(); ++value)
             {
-                qreal x = leftX + (value.time - m_timeStart) * ppt;
+                qreal x = leftX + (value.time() - timeStart) * ppt;
                 if (x <= leftX)
                 {
-                    lastValue = value.value;
-                    lastY = normalizeLogicValue(lastValue) == QLatin1String("0") ? lowY : highY;
+                    lastState = value.scalar();
+                    lastY = isLogicLow(lastState) ? lowY : highY;
                     lastX = leftX;
                     continue;
                 }
@@ -446,15 +867,15 @@ void WaveformView::drawSignalWave(QPainter &painter, const RenderSignal &sig, co
                     x = rightX;
                 }
 
-                const QColor segmentColor = normalizeLogicValue(lastValue) == QLatin1String("0") ? m_digitalLow : m_digitalHigh;
+                const QColor segmentColor = isLogicLow(lastState) ? m_digitalLow : m_digitalHigh;
                 painter.setPen(QPen(segmentColor, 2));
                 painter.drawLine(QPointF(lastX, lastY), QPointF(x, lastY));
 
-                const QString normalized = normalizeLogicValue(value.value);
-                const qreal newY = normalized == QLatin1String("0") ? lowY : highY;
+                const char state = value.scalar();
+                const qreal newY = isLogicLow(state) ? lowY : highY;
                 painter.drawLine(QPointF(x, lastY), QPointF(x, newY));
 
-                lastValue = value.value;
+                lastState = state;
                 lastY = newY;
                 lastX = x;
 
@@ -466,7 +887,7 @@ void WaveformView::drawSignalWave(QPainter &painter, const RenderSignal &sig, co
 
             if (lastX < rightX)
             {
-                const QColor segmentColor = normalizeLogicValue(lastValue) == QLatin1String("0") ? m_digitalLow : m_digitalHigh;
+                const QColor segmentColor = isLogicLow(lastState) ? m_digitalLow : m_digitalHigh;
                 painter.setPen(QPen(segmentColor, 2));
                 painter.drawLine(QPointF(lastX, lastY), QPointF(rightX, lastY));
             }
@@ -476,6 +897,155 @@ void WaveformView::drawSignalWave(QPainter &painter, const RenderSignal &sig, co
     painter.restore();
 }
 
+void WaveformView::drawSummarizedWave(QPainter &painter, const fst::Signal &signal, const fst::ValueSummary &summary, int level,
+                                      const QRectF &rect, qreal timeStart, qreal ppt) const
+{
+    const qreal leftX = rect.left();
+    const qreal rightX = rect.right();
+    const fst::ValueStore &values = signal.values;
+
+    // Buckets are no wider than a pixel, so each is added to the column it
+    // starts in; a bucket straddling the left edge counts for column 0.
+    QVector<SummaryColumn> columns(qMax(1, static_cast<int>(std::ceil(rect.width()))));
+    const QVector<fst::ValueSummary::Bucket> &buckets = summary.buckets(level);
+    const qint64 startTime = static_cast<qint64>(std::floor(timeStart));
+    const qint64 endTime = static_cast<qint64>(std::ceil(timeStart + rect.width() / ppt));
+    const qint64 firstBucket = qMax<qint64>(0, summary.bucketAt(level, startTime));
+    const qint64 lastBucket = qMin<qint64>(buckets.size() - 1, summary.bucketAt(level, endTime));
+    int startIndex = -1;
+    for (qint64 b = firstBucket; b <= lastBucket; ++b)
+    {
+        const fst::ValueSummary::Bucket &bucket = buckets.at(static_cast<int>(b));
+        if (bucket.count == 0)
+        {
+            continue;
+        }
+        if (startIndex < 0)
+        {
+            startIndex = qMax(0, bucket.first - 1);
+        }
+        const qint64 bucketStart = summary.origin() + (b << summary.shift(level));
+        SummaryColumn &column = columns[qBound(0, static_cast<int>((bucketStart - timeStart) * ppt), columns.size() - 1)];
+        column.count += bucket.count;
+        column.unknown = column.unknown || bucket.unknown;
+        column.lastState = bucket.lastState;
+    }
+    if (startIndex < 0)
+    {
+        startIndex = qMax(0, values.indexAt(startTime));
+    }
+
+    // Adjacent columns with several changes, or with an X or Z, merge into
+    // one filled block.
+    qreal busyStart = leftX;
+    qreal busyEnd = leftX;
+    bool busyUnknown = false;
+    const auto flushBusy = [&](const QColor &color, qreal top, qreal height) {
+        if (busyEnd > busyStart)
+        {
+            painter.fillRect(QRectF(busyStart, top, busyEnd - busyStart, height), busyUnknown ? m_unknownColor : color);
+        }
+        busyStart = busyEnd;
+        busyUnknown = false;
+    };
+
+    if (signal.bitWidth > 1)
+    {
+        QColor busyColor = m_busFill;
+        busyColor.setAlpha(200);
+        drawBusBody(painter, rect);
+        for (int i = 0; i < columns.size(); ++i)
+        {
+            const SummaryColumn &column = columns.at(i);
+            if (column.count == 0)
+            {
+                continue;
+            }
+            const qreal x = leftX + i;
+            const bool busy = column.count > 1 || column.unknown;
+            if (!busy || x > busyEnd)
+            {
+                flushBusy(busyColor, rect.top(), rect.height());
+                busyStart = x;
+            }
+            if (busy)
+            {
+                busyEnd = x + 1.0;
+                busyUnknown = busyUnknown || column.unknown;
+            }
+            else
+            {
+                // A lone change: the edge of a real transition.
+                painter.drawLine(QPointF(x, rect.top()), QPointF(x, rect.bottom()));
+            }
+        }
+        flushBusy(busyColor, rect.top(), rect.height());
+        return;
+    }
+
+    const qreal highY = rect.top() + 4.0;
+    const qreal lowY = rect.bottom() - 4.0;
+    const auto levelY = [&](char state) { return isLogicLow(state) ? lowY : highY; };
+    const auto drawRun = [&](qreal fromX, qreal toX, char state) {
+        if (toX > fromX)
+        {
+            painter.setPen(QPen(isLogicLow(state) ? m_digitalLow : m_digitalHigh, 2));
+            painter.drawLine(QPointF(fromX, levelY(state)), QPointF(toX, levelY(state)));
+        }
+    };
+
+    char state = values.at(startIndex).scalar();
+    qreal runX = leftX;
+    for (int i = 0; i < columns.size(); ++i)
+    {
+        const SummaryColumn &column = columns.at(i);
+        if (column.count == 0)
+        {
+            continue;
+        }
+        const qreal x = leftX + i;
+        const bool busy = column.count > 1 || column.unknown;
+        if (!busy || x > busyEnd)
+        {
+            flushBusy(m_digitalHigh, highY, lowY - highY);
+            drawRun(runX, x, state);
+            busyStart = x;
+        }
+        if (busy)
+        {
+            busyEnd = x + 1.0;
+            busyUnknown = busyUnknown || column.unknown;
+        }
+        else
+        {
+            painter.setPen(QPen(isLogicLow(state) ? m_digitalLow : m_digitalHigh, 2));
+            painter.drawLine(QPointF(x, levelY(state)), QPointF(x, levelY(column.lastState)));
+        }
+        state = column.lastState;
+        runX = busy ? x + 1.0 : x;
+    }
+    flushBusy(m_digitalHigh, highY, lowY - highY);
+    drawRun(runX, rightX, state);
+}
+
+const fst::ValueSummary *WaveformView::summaryFor(const fst::Signal &signal)
+{
+    if (signal.values.size() < kSummaryMinChanges)
+    {
+        return nullptr;
+    }
+    // Aliases share the store of the signal they alias, and its summary.
+    const int handle = signal.aliasOf > 0 ? signal.aliasOf : signal.handle;
+    const fst::ValueSummary *summary = m_summaryBuilder->summary(handle);
+    if (summary && summary->matches(signal.values))
+    {
+        return summary;
+    }
+    // Normally queued by addSignal(); this covers stores appended to since.
+    m_summaryBuilder->request(handle, signal.values);
+    return nullptr;
+}
+
 void WaveformView::drawTimeAxis(QPainter &painter, const QRectF &rect)
 {
     painter.save();